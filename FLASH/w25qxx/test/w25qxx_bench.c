@@ -0,0 +1,245 @@
+/*
+ * host benchmark of the w25qxx driver over the flash model (w25qxx_sim.h) : a 2MB W25Q16, 20 MHz SPI,
+ * times are model time (SPI clock, delays, busy), not host time. run from FLASH/w25qxx/ :
+ *   gcc -O2 test/w25qxx_bench.c -o bench && ./bench
+ * write throughput, erase of a range, single / dual / quad reads, the page cache, a chip stuck busy.
+ * every result is read back first, exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../w25qxx.c"
+#include "w25qxx_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define BENCH_WRITE_SIZE		(64UL * 1024)
+#define BENCH_WRITE_AT			0x10000UL
+#define BENCH_RECORDS_SIZE		190000UL		// log of random sized records, mostly small
+#define BENCH_READ_SIZE			(1024UL * 1024)
+#define BENCH_READ_CHUNK		(32UL * 1024)	// spi_read takes 16-bit lengths
+#define BENCH_HOT_READS			100000UL
+#define BENCH_HOT_PAGES			12
+
+#define BENCH_EXPECT(cond, ...)	do{ if(!(cond)){ if(bench_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long bench_fail = 0;
+static w25qxx_handle_t bench_flash;
+static uint8_t bench_data[BENCH_READ_SIZE];
+static uint8_t bench_scratch[W25Q_SECTOR_SIZE];
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static void bench_random(uint8_t *data, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++)
+	{
+		data[i] = (uint8_t)rand();
+	}
+}
+
+static void bench_start(void)
+{
+	sim_init(SIM_W25Q16, 1, false);
+	sim_lines(1);
+	sim_if.get_us = NULL;
+	w25qxx_init(&bench_flash, &sim_if);
+}
+
+static void bench_writes(void)
+{
+	unsigned long long start;
+	uint32_t pos;
+	uint8_t record[600];
+	float value = 3.25f;
+	w25qxx_writer_t writer;
+
+	bench_start();
+	bench_random(bench_data, BENCH_WRITE_SIZE);
+	start = sim_ns;
+	BENCH_EXPECT(true == flash_WriteMemory(&bench_flash, BENCH_WRITE_AT, bench_data, BENCH_WRITE_SIZE), "flash_WriteMemory failed");
+	printf("%-42s : %7.1f ms, %4.0f KB/s, %lu programs\n",
+		   "flash_WriteMemory 64KB into erased flash", sim_ms(start), 64.0 / (sim_ms(start) / 1000.0), sim_programs);
+	BENCH_EXPECT(0 == memcmp(&sim_mem[BENCH_WRITE_AT], bench_data, BENCH_WRITE_SIZE), "flash_WriteMemory data");
+
+	start = sim_ns;
+	BENCH_EXPECT(true == w25qxx_Write_NUM(&bench_flash, 1000, 4, value), "w25qxx_Write_NUM failed");
+	printf("%-42s : %7.2f ms\n", "w25qxx_Write_NUM into erased flash", sim_ms(start));
+	BENCH_EXPECT(w25qxx_Read_NUM(&bench_flash, 1000, 4) == value, "w25qxx_Write_NUM data");
+
+	/* a bit back to 1 : read, merge, erase, program the sector */
+	w25qxx_Set_Scratch(&bench_flash, bench_scratch);
+	value = -7.5f;
+	start = sim_ns;
+	BENCH_EXPECT(true == w25qxx_Write_NUM(&bench_flash, 1000, 4, value), "w25qxx_Write_NUM merge failed");
+	printf("%-42s : %7.2f ms\n", "w25qxx_Write_NUM over written data (merge)", sim_ms(start));
+	BENCH_EXPECT(w25qxx_Read_NUM(&bench_flash, 1000, 4) == value, "w25qxx_Write_NUM merge data");
+
+	/* the same records through the page writer, then one flash_WriteMemory each */
+	bench_start();
+	srand(5);
+	w25qxx_Writer_Init(&writer, &bench_flash, BENCH_WRITE_AT, BENCH_WRITE_AT + BENCH_READ_SIZE);
+	start = sim_ns;
+	for (pos = 0; pos < BENCH_RECORDS_SIZE; )
+	{
+		uint32_t len = 1 + rand() % ((rand() % 8) ? 40 : sizeof(record));
+		bench_random(record, len);
+		memcpy(&bench_data[pos], record, len);
+		BENCH_EXPECT(true == w25qxx_Writer_Append(&writer, record, len), "writer append at %u", pos);
+		pos += len;
+	}
+	BENCH_EXPECT(true == w25qxx_Writer_Flush(&writer), "writer flush");
+	printf("%-42s : %7.1f ms, %4.0f KB/s\n", "writer, 190KB of records", sim_ms(start), pos / 1.024 / sim_ms(start));
+	BENCH_EXPECT(0 == memcmp(&sim_mem[BENCH_WRITE_AT], bench_data, pos), "writer data");
+
+	bench_start();
+	srand(5);
+	start = sim_ns;
+	for (pos = 0; pos < BENCH_RECORDS_SIZE; )
+	{
+		uint32_t len = 1 + rand() % ((rand() % 8) ? 40 : sizeof(record));
+		bench_random(record, len);
+		BENCH_EXPECT(true == flash_WriteMemory(&bench_flash, BENCH_WRITE_AT + pos, record, len), "flash_WriteMemory record at %u", pos);
+		pos += len;
+	}
+	printf("%-42s : %7.1f ms, %4.0f KB/s\n", "flash_WriteMemory per record", sim_ms(start), pos / 1.024 / sim_ms(start));
+	BENCH_EXPECT(0 == memcmp(&sim_mem[BENCH_WRITE_AT], bench_data, pos), "flash_WriteMemory records data");
+}
+
+static void bench_erase(void)
+{
+	unsigned long long start;
+
+	bench_start();
+	memset(sim_mem, 0, SIM_W25Q16);
+	start = sim_ns;
+	BENCH_EXPECT(true == flash_EraseRange(&bench_flash, W25Q_SECTOR_SIZE, W25Q_SECTOR_SIZE + BENCH_READ_SIZE - 1, NULL, NULL), "flash_EraseRange failed");
+	printf("%-42s : %7.1f ms, %lu x 4KB %lu x 32KB %lu x 64KB\n",
+		   "flash_EraseRange 1MB, one sector in", sim_ms(start), sim_erases[0], sim_erases[1], sim_erases[2]);
+	for (uint32_t i = 0; i < SIM_W25Q16; i++)
+	{
+		bool is_inside = (i >= W25Q_SECTOR_SIZE) && (i < W25Q_SECTOR_SIZE + BENCH_READ_SIZE);
+		if (sim_mem[i] != (is_inside ? 0xFF : 0x00))
+		{
+			BENCH_EXPECT(false, "flash_EraseRange : byte %x", i);
+			break;
+		}
+	}
+}
+
+static void bench_read(const char *name, uint8_t lines, w25qxx_read_mode_e mode)
+{
+	static uint8_t read[BENCH_READ_SIZE];
+	unsigned long long start;
+
+	sim_lines(lines);
+	w25qxx_init(&bench_flash, &sim_if);
+	BENCH_EXPECT(true == w25qxx_Set_ReadMode(&bench_flash, mode), "%s : mode refused", name);
+	memset(read, 0, sizeof(read));
+	start = sim_ns;
+	for (uint32_t at = 0; at < BENCH_READ_SIZE; at += BENCH_READ_CHUNK)
+	{
+		flash_ReadMemory(&bench_flash, at, &read[at], BENCH_READ_CHUNK);
+	}
+	printf("flash_ReadMemory 1MB by 32KB, %-12s : %7.1f ms\n", name, sim_ms(start));
+	BENCH_EXPECT(0 == memcmp(read, sim_mem, BENCH_READ_SIZE), "%s : data", name);
+}
+
+static void bench_reads(void)
+{
+	static w25qxx_cache_t cache;
+	static w25qxx_cache_line_t line[16];
+	unsigned long long start;
+	uint32_t address;
+
+	bench_start();
+	bench_random(sim_mem, SIM_W25Q16);
+	bench_read("single line", 1, W25Q_READ_SINGLE);
+	bench_read("dual output", 2, W25Q_READ_DUAL_OUT);
+	bench_read("quad output", 4, W25Q_READ_QUAD_OUT);
+	bench_read("quad I/O", 4, W25Q_READ_QUAD_IO);
+
+	bench_start();
+	bench_random(sim_mem, SIM_W25Q16);
+	for (uint8_t pass = 0; pass < 2; pass++)
+	{
+		if (pass == 1)
+		{
+			w25qxx_Cache_Init(&bench_flash, &cache, line, 16);
+		}
+		srand(4);
+		start = sim_ns;
+		for (uint32_t n = 0; n < BENCH_HOT_READS; n++)
+		{
+			address = ((rand() % BENCH_HOT_PAGES) * W25Q_SECTOR_SIZE) + (rand() % W25Q_PAGE_SIZE);
+			if (w25qxx_Read_Byte(&bench_flash, address) != sim_mem[address])
+			{
+				BENCH_EXPECT(false, "Read_Byte %x", address);
+				break;
+			}
+		}
+		printf("%-42s : %7.1f ms\n", pass ? "100k Read_Byte over 12 hot pages, cached" : "100k Read_Byte over 12 hot pages", sim_ms(start));
+	}
+}
+
+/* a chip that never drops BUSY : blocking calls and jobs give up at the maximum time, a job refuses to start */
+static void bench_stuck(void)
+{
+	static uint8_t page[W25Q_PAGE_SIZE];
+	unsigned long long start;
+	w25qxx_job_t job;
+	w25qxx_job_status_e status;
+
+	bench_start();
+	memset(page, 0x5A, sizeof(page));
+	sim_stuck = true;
+	start = sim_ns;
+	BENCH_EXPECT(false == w25qxx_Erase_Sector(&bench_flash, 4), "stuck : sector erase returned true");
+	printf("%-42s : %7.1f ms\n", "stuck chip, sector erase fails after", sim_ms(start));
+	start = sim_ns;
+	BENCH_EXPECT(false == flash_WriteMemory(&bench_flash, 0x2000, page, 16), "stuck : page program returned true");
+	printf("%-42s : %7.1f ms\n", "stuck chip, page program fails after", sim_ms(start));
+
+	for (uint8_t pass = 0; pass < 2; pass++)
+	{
+		sim_if.get_us = pass ? sim_get_us : NULL;
+		sim_stuck = false;
+		BENCH_EXPECT(true == w25qxx_Erase_Start(&bench_flash, &job, 0, 1, NULL), "stuck : erase job refused");
+		sim_stuck = true;
+		start = sim_ns;
+		while (W25Q_JOB_BUSY == (status = w25qxx_poll(&bench_flash)))
+		{
+			sim_delay_us(W25Q_POLL_MIN_US);
+		}
+		printf("%-42s : %7.1f ms, status %u\n", pass ? "stuck chip, erase job ends after, get_us" : "stuck chip, erase job ends after", sim_ms(start), status);
+		BENCH_EXPECT(W25Q_JOB_ERROR == status, "stuck : erase job status %u", status);
+		BENCH_EXPECT(false == w25qxx_Program_Start(&bench_flash, &job, 0x2000, page, sizeof(page), NULL), "stuck : job started on a busy chip");
+		sim_stuck = false;
+		BENCH_EXPECT(true == w25qxx_Program_Start(&bench_flash, &job, 0x2000, page, sizeof(page), NULL), "stuck : job refused once free");
+		while (W25Q_JOB_BUSY == (status = w25qxx_poll(&bench_flash)))
+		{
+			sim_delay_us(W25Q_POLL_MIN_US);
+		}
+		BENCH_EXPECT((W25Q_JOB_DONE == status) && (0 == memcmp(&sim_mem[0x2000], page, sizeof(page))), "stuck : program job after");
+		flash_EraseRange(&bench_flash, 0, W25Q_SECTOR_SIZE * 3 - 1, NULL, NULL);
+	}
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+	srand(1);
+	bench_writes();
+	bench_erase();
+	bench_reads();
+	bench_stuck();
+	printf("%lu failed\n", bench_fail);
+	return (bench_fail > 255U) ? 255 : (int)bench_fail;
+}
@@ -0,0 +1,149 @@
+/*
+ * host smoke test of the w25qxx page read cache over the flash model (w25qxx_sim.h) of a 2MB W25Q16,
+ * run from FLASH/w25qxx/ :
+ *   gcc -O1 -g -fsanitize=address,undefined test/w25qxx_cache_smoke.c -o cache && ./cache
+ * random reads through every cached path mixed with every program / erase path (blocking, job, writer),
+ * each read compared byte for byte with the model memory : no stale line. exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../w25qxx.c"
+#include "w25qxx_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define CACHE_LINES				16
+#define CACHE_OPS				200000UL
+#define CACHE_HOT_SECTORS		12
+
+#define CACHE_EXPECT(cond, ...)	do{ if(!(cond)){ if(cache_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long cache_fail = 0;
+static w25qxx_handle_t cache_flash;
+static w25qxx_cache_t cache;
+static w25qxx_cache_line_t cache_line[CACHE_LINES];
+static uint8_t cache_scratch[W25Q_SECTOR_SIZE];
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static void cache_check(unsigned long n, uint32_t address, const uint8_t *data, uint32_t len, const char *what)
+{
+	CACHE_EXPECT(0 == memcmp(data, &sim_mem[address], len), "op %lu : %s at %x, %u bytes stale", n, what, address, len);
+}
+
+static void cache_random(uint8_t *data, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++)
+	{
+		data[i] = (uint8_t)rand();
+	}
+}
+
+/* mostly a few hot sectors, so lines get hit and then written under */
+static uint32_t cache_address(void)
+{
+	if (rand() % 4)
+	{
+		return ((rand() % CACHE_HOT_SECTORS) * W25Q_SECTOR_SIZE) + (rand() % W25Q_PAGE_SIZE);
+	}
+	return rand() % (SIM_W25Q16 - 4096);
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+	static uint8_t data[600];
+	w25qxx_job_t job;
+	w25qxx_writer_t writer;
+	uint32_t address;
+	uint32_t len;
+	uint8_t byte;
+
+	srand(4);
+	sim_init(SIM_W25Q16, 1, false);
+	cache_random(sim_mem, SIM_W25Q16);
+	w25qxx_init(&cache_flash, &sim_if);
+	w25qxx_Set_Scratch(&cache_flash, cache_scratch);
+	w25qxx_Cache_Init(&cache_flash, &cache, cache_line, CACHE_LINES);
+
+	for (unsigned long n = 0; n < CACHE_OPS; n++)
+	{
+		int op = rand() % 1000;
+		address = cache_address();
+		if (op < 500)
+		{
+			byte = w25qxx_Read_Byte(&cache_flash, address);
+			cache_check(n, address, &byte, 1, "Read_Byte");
+		}
+		else if (op < 800)
+		{
+			len = 1 + rand() % (W25Q_PAGE_SIZE - (address % W25Q_PAGE_SIZE));
+			flash_ReadMemory(&cache_flash, address, data, len);
+			cache_check(n, address, data, len, "flash_ReadMemory");
+		}
+		else if (op < 850)
+		{
+			len = 1 + rand() % sizeof(data);
+			flash_ReadMemory(&cache_flash, address, data, len);
+			cache_check(n, address, data, len, "flash_ReadMemory across pages");
+		}
+		else if (op < 900)
+		{
+			w25qxx_Read(&cache_flash, address / W25Q_PAGE_SIZE, address % W25Q_PAGE_SIZE, 4, data);
+			cache_check(n, address, data, 4, "w25qxx_Read");
+		}
+		else if (op < 960)
+		{
+			len = 1 + rand() % 300;
+			cache_random(data, len);
+			CACHE_EXPECT(true == w25qxx_Write(&cache_flash, address / W25Q_PAGE_SIZE, address % W25Q_PAGE_SIZE, len, data), "op %lu : w25qxx_Write", n);
+			cache_check(n, address, data, len, "w25qxx_Write");
+		}
+		else if (op < 980)
+		{
+			w25qxx_Write_Byte(&cache_flash, address, (uint8_t)rand());
+		}
+		else if (op < 990)
+		{
+			len = 1 + rand() % 300;
+			cache_random(data, len);
+			CACHE_EXPECT(true == w25qxx_Write_Clean(&cache_flash, address / W25Q_PAGE_SIZE, address % W25Q_PAGE_SIZE, len, data), "op %lu : Write_Clean", n);
+			cache_check(n, address, data, len, "Write_Clean");
+		}
+		else if (op < 995)
+		{
+			len = rand() % 70000;				// inside the part : the chip wraps past its end, the cache does not
+			flash_EraseRange(&cache_flash, address, (address + len < SIM_W25Q16) ? (address + len) : (SIM_W25Q16 - 1), NULL, NULL);
+		}
+		else if (op < 998)
+		{
+			len = 1 + rand() % 300;
+			memset(data, 0, len);
+			CACHE_EXPECT(true == w25qxx_Program_Start(&cache_flash, &job, address, data, len, NULL), "op %lu : Program_Start", n);
+			while (W25Q_JOB_BUSY == w25qxx_poll(&cache_flash))
+			{
+				sim_delay_us(W25Q_POLL_MIN_US);
+			}
+		}
+		else
+		{
+			/* writer : erases the sector it enters, the part after address must be erased already */
+			address &= ~(W25Q_SECTOR_SIZE - 1UL);
+			CACHE_EXPECT(true == w25qxx_Erase_Sector(&cache_flash, (uint16_t)(address / W25Q_SECTOR_SIZE)), "op %lu : erase", n);
+			w25qxx_Writer_Init(&writer, &cache_flash, address, address + 2 * W25Q_SECTOR_SIZE);
+			len = 1 + rand() % sizeof(data);
+			cache_random(data, len);
+			CACHE_EXPECT((true == w25qxx_Writer_Append(&writer, data, len)) && (true == w25qxx_Writer_Flush(&writer)), "op %lu : writer", n);
+		}
+	}
+	printf("%lu ops : %u hits, %u misses, %lu failed\n", CACHE_OPS, cache.hits, cache.misses, cache_fail);
+	return (cache_fail > 255U) ? 255 : (int)cache_fail;
+}
@@ -0,0 +1,138 @@
+/*
+ * host smoke test of w25qxx_ckpt through w25qxx_kv, over the flash model (w25qxx_sim.h) of a 2MB W25Q16,
+ * run from FLASH/w25qxx/ :
+ *   gcc -O1 -g -fsanitize=address,undefined test/w25qxx_ckpt_smoke.c -o ckpt && ./ckpt
+ * mount with and without the checkpoint must find the same keys (model time of both printed),
+ * a corrupted snapshot falls back, a format does not let an old snapshot back. exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../w25qxx.c"
+#include "../w25qxx_ckpt.c"
+#include "../w25qxx_kv.c"
+#include "w25qxx_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define CKPT_KV_SECTOR			100
+#define CKPT_KV_SECTORS			128
+#define CKPT_SECTOR				300
+#define CKPT_COPY_SECTORS		2
+#define CKPT_KEYS				200
+#define CKPT_OPS				300000UL
+#define CKPT_REMOUNT			7919UL
+
+#define CKPT_EXPECT(cond, ...)	do{ if(!(cond)){ if(ckpt_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long ckpt_fail = 0;
+static w25qxx_handle_t ckpt_flash;
+static w25qxx_kv_t ckpt_kv;
+static w25qxx_ckpt_t ckpt;
+static uint8_t ckpt_ref[CKPT_KEYS][W25Q_KV_VALUE_MAX];
+static int16_t ckpt_ref_len[CKPT_KEYS];					// -1 : absent
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static void ckpt_verify(const char *when)
+{
+	uint8_t value[W25Q_KV_VALUE_MAX];
+	uint8_t len;
+
+	for (uint16_t key = 0; key < CKPT_KEYS; key++)
+	{
+		len = sizeof(value);
+		bool is_found = w25qxx_kv_get(&ckpt_kv, key, value, &len);
+		if (ckpt_ref_len[key] < 0)
+		{
+			CKPT_EXPECT(false == is_found, "%s : key %u should be absent", when, key);
+		}
+		else
+		{
+			CKPT_EXPECT((true == is_found) && (len == ckpt_ref_len[key]) && (0 == memcmp(value, ckpt_ref[key], len)), "%s : key %u", when, key);
+		}
+	}
+}
+
+/* ms of model time the mount took */
+static double ckpt_mount(w25qxx_ckpt_t *with)
+{
+	unsigned long long start = sim_ns;
+
+	w25qxx_kv_set_checkpoint(&ckpt_kv, with);
+	CKPT_EXPECT(true == w25qxx_kv_mount(&ckpt_kv), "mount failed");
+	w25qxx_kv_set_checkpoint(&ckpt_kv, &ckpt);
+	return sim_ms(start);
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+	double full = 0;
+	double fast = 0;
+	unsigned long mounts = 0;
+
+	srand(12);
+	sim_init(SIM_W25Q16, 1, false);
+	w25qxx_init(&ckpt_flash, &sim_if);
+	w25qxx_ckpt_init(&ckpt, &ckpt_flash, CKPT_SECTOR, CKPT_COPY_SECTORS);
+	if ((false == w25qxx_kv_init(&ckpt_kv, &ckpt_flash, CKPT_KV_SECTOR, CKPT_KV_SECTORS, CKPT_KEYS)))
+	{
+		printf("kv init failed\n");
+		return 1;
+	}
+	w25qxx_kv_set_checkpoint(&ckpt_kv, &ckpt);
+	CKPT_EXPECT(true == w25qxx_kv_format(&ckpt_kv), "format failed");
+	memset(ckpt_ref_len, 0xFF, sizeof(ckpt_ref_len));
+
+	for (unsigned long n = 1; n <= CKPT_OPS; n++)
+	{
+		uint16_t key = (uint16_t)(rand() % CKPT_KEYS);
+		if ((rand() % 20) == 0)
+		{
+			CKPT_EXPECT(true == w25qxx_kv_delete(&ckpt_kv, key), "op %lu : delete %u failed", n, key);
+			ckpt_ref_len[key] = -1;
+		}
+		else
+		{
+			ckpt_ref_len[key] = (int16_t)(rand() % (W25Q_KV_VALUE_MAX + 1));
+			for (int16_t i = 0; i < ckpt_ref_len[key]; i++)
+			{
+				ckpt_ref[key][i] = (uint8_t)rand();
+			}
+			CKPT_EXPECT(true == w25qxx_kv_set(&ckpt_kv, key, ckpt_ref[key], (uint8_t)ckpt_ref_len[key]), "op %lu : set %u failed", n, key);
+		}
+		if ((n % CKPT_REMOUNT) == 0)
+		{
+			full += ckpt_mount(NULL);
+			ckpt_verify("full replay");
+			fast += ckpt_mount(&ckpt);
+			ckpt_verify("checkpoint");
+			mounts++;
+		}
+	}
+	printf("%u keys on %u sectors, %lu mounts : %.1f ms full replay, %.1f ms from the checkpoint, generation %u\n",
+		   CKPT_KEYS, CKPT_KV_SECTORS, mounts, full / mounts, fast / mounts, ckpt.generation);
+
+	/* newest snapshot data corrupted : its CRC fails, mount takes the older one or replays */
+	sim_mem[((CKPT_SECTOR + (ckpt._copy * CKPT_COPY_SECTORS)) * W25Q_SECTOR_SIZE) + 40] ^= 0x01;
+	ckpt_mount(&ckpt);
+	ckpt_verify("corrupted snapshot");
+
+	/* format writes a fresh snapshot, the old one must not name the new head */
+	CKPT_EXPECT(true == w25qxx_kv_format(&ckpt_kv), "format failed");
+	memset(ckpt_ref_len, 0xFF, sizeof(ckpt_ref_len));
+	ckpt_mount(&ckpt);
+	ckpt_verify("format");
+
+	free(ckpt_kv._index);
+	printf("ckpt smoke : %lu failed\n", ckpt_fail);
+	return (ckpt_fail > 255U) ? 255 : (int)ckpt_fail;
+}
@@ -0,0 +1,134 @@
+/*
+ * host power loss test of w25qxx_ftl over the flash model (w25qxx_sim.h) of a 2MB W25Q16, single line SPI, no SFDP,
+ * run from FLASH/w25qxx/ :
+ *   gcc -O1 -g -fsanitize=address,undefined test/w25qxx_ftl_power.c -o power && ./power
+ * power is cut after a random number of program / erase commands, the one running is left torn.
+ * after each cut : remount, every page reads its last written data (the page being written : old or new),
+ * then writes go on. exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../w25qxx.c"
+#include "../w25qxx_ftl.c"
+#include "w25qxx_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define POWER_SECTORS			24
+#define POWER_RESERVE			3
+#define POWER_CUTS				3000UL
+#define POWER_HOT_PAGES			8			// most writes hit these, the rest stays cold
+#define POWER_GC_STEPS			8			// w25qxx_ftl_gc calls per idle time
+
+#define POWER_EXPECT(cond, ...)	do{ if(!(cond)){ if(power_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long power_fail = 0;
+static w25qxx_handle_t power_flash;
+static w25qxx_ftl_t power_ftl;
+static uint8_t power_ref[POWER_SECTORS * W25Q_FTL_SLOTS][W25Q_FTL_PAGE_SIZE];
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+/* power back on : the driver and the FTL start over from flash */
+static void power_on(void)
+{
+	sim_power_on();
+	w25qxx_init(&power_flash, &sim_if);
+	w25qxx_ftl_mount(&power_ftl);
+}
+
+/* every page holds power_ref, except pending which may also hold data (the write the cut interrupted) */
+static void power_verify(unsigned long cut, uint16_t pending, const uint8_t *data)
+{
+	uint8_t page[W25Q_FTL_PAGE_SIZE];
+
+	for (uint16_t p = 0; p < w25qxx_ftl_pages(&power_ftl); p++)
+	{
+		w25qxx_ftl_read(&power_ftl, p, page);
+		if ((p == pending) && (0 == memcmp(page, data, sizeof(page))))
+		{
+			memcpy(power_ref[p], data, sizeof(page));
+			continue;
+		}
+		POWER_EXPECT(0 == memcmp(page, power_ref[p], sizeof(page)), "cut %lu : page %u lost", cut, p);
+	}
+}
+
+/* writes and idle collection until the power goes */
+static uint16_t power_run(unsigned long cut, uint8_t *data)
+{
+	uint16_t pages = w25qxx_ftl_pages(&power_ftl);
+
+	for (uint32_t n = 0; ; n++)
+	{
+		uint16_t p = (rand() % 4) ? (uint16_t)(rand() % POWER_HOT_PAGES) : (uint16_t)(rand() % pages);
+		for (uint16_t i = 0; i < W25Q_FTL_PAGE_SIZE; i++)
+		{
+			data[i] = (uint8_t)rand();
+		}
+		bool is_written = w25qxx_ftl_write(&power_ftl, p, data);
+		if (true == sim_off)
+		{
+			return p;
+		}
+		POWER_EXPECT(true == is_written, "cut %lu : write %u of page %u failed, %u free", cut, n, p, power_ftl._free_count);
+		if (false == is_written)
+		{
+			return W25Q_FTL_NONE;				// stuck, the flash would never see the cut
+		}
+		memcpy(power_ref[p], data, W25Q_FTL_PAGE_SIZE);
+
+		/* the main loop is not always idle : some cuts find no sector free */
+		if ((n % 16) == 0)
+		{
+			for (uint8_t step = 0; step < POWER_GC_STEPS; step++)
+			{
+				if (false == w25qxx_ftl_gc(&power_ftl)) break;
+			}
+		}
+		if (true == sim_off)
+		{
+			return W25Q_FTL_NONE;
+		}
+	}
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+	static uint8_t data[W25Q_FTL_PAGE_SIZE];
+	uint16_t pending;
+
+	srand(1);
+	sim_init(SIM_W25Q16, 1, false);
+	memset(power_ref, 0xFF, sizeof(power_ref));
+	w25qxx_init(&power_flash, &sim_if);
+	if (false == w25qxx_ftl_init(&power_ftl, &power_flash, 0, POWER_SECTORS, POWER_RESERVE))
+	{
+		printf("ftl init failed\n");
+		return 1;
+	}
+	w25qxx_ftl_mount(&power_ftl);
+
+	for (unsigned long cut = 0; cut < POWER_CUTS; cut++)
+	{
+		sim_budget = 1 + rand() % 400;
+		pending = power_run(cut, data);
+		power_on();
+		power_verify(cut, pending, data);
+		if (power_fail > 10U)
+		{
+			break;
+		}
+	}
+	printf("ftl power loss, %lu cuts, %u pages : %lu failed\n", POWER_CUTS, w25qxx_ftl_pages(&power_ftl), power_fail);
+	return (power_fail > 255U) ? 255 : (int)power_fail;
+}
@@ -0,0 +1,112 @@
+/*
+ * host smoke test of the geometry w25qxx_init detects, over the flash model (w25qxx_sim.h), run from FLASH/w25qxx/ :
+ *   gcc -O1 -g -fsanitize=address,undefined test/w25qxx_geometry_smoke.c -o geometry && ./geometry
+ * a 2MB W25Q16 with and without SFDP, a 32MB part (4-byte addressing) on one and four lines, two stacked 32MB dies :
+ * erase / program / read at the start, across the middle (the die boundary when stacked) and at the end,
+ * chip erase, then a reset. exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../w25qxx.c"
+#include "w25qxx_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define GEOMETRY_SPAN			(2 * W25Q_SECTOR_SIZE)
+
+#define GEOMETRY_EXPECT(cond, ...)	do{ if(!(cond)){ if(geometry_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long geometry_fail = 0;
+static w25qxx_handle_t geometry_flash;
+static uint8_t geometry_scratch[W25Q_SECTOR_SIZE];
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+/* erase, program, read back through every read path, then one byte that needs the sector merge */
+static void geometry_span(const char *name, uint32_t address)
+{
+	static uint8_t data[GEOMETRY_SPAN];
+	static uint8_t read[GEOMETRY_SPAN];
+
+	for (uint32_t i = 0; i < sizeof(data); i++)
+	{
+		data[i] = (uint8_t)rand();
+	}
+	GEOMETRY_EXPECT(true == flash_SectorErase(&geometry_flash, address, address + sizeof(data) - 1), "%s @%x : erase", name, address);
+	GEOMETRY_EXPECT(true == flash_WriteMemory(&geometry_flash, address, data, sizeof(data)), "%s @%x : write", name, address);
+	GEOMETRY_EXPECT(0 == memcmp(&sim_mem[address], data, sizeof(data)), "%s @%x : programmed", name, address);
+	memset(read, 0, sizeof(read));
+	flash_ReadMemory(&geometry_flash, address, read, sizeof(read));
+	GEOMETRY_EXPECT(0 == memcmp(read, data, sizeof(data)), "%s @%x : flash_ReadMemory", name, address);
+	memset(read, 0, sizeof(read));
+	w25qxx_Read(&geometry_flash, address / W25Q_PAGE_SIZE, 0, sizeof(read), read);
+	GEOMETRY_EXPECT(0 == memcmp(read, data, sizeof(data)), "%s @%x : w25qxx_Read", name, address);
+	GEOMETRY_EXPECT(w25qxx_Read_Byte(&geometry_flash, address + 5) == data[5], "%s @%x : w25qxx_Read_Byte", name, address);
+	data[7] = (uint8_t)~data[7];
+	GEOMETRY_EXPECT(true == w25qxx_Write(&geometry_flash, address / W25Q_PAGE_SIZE, 7, 1, &data[7]), "%s @%x : w25qxx_Write", name, address);
+	GEOMETRY_EXPECT(0 == memcmp(&sim_mem[address], data, sizeof(data)), "%s @%x : merged", name, address);
+}
+
+static void geometry_run(const char *name, uint32_t die_size, uint8_t dies, bool has_sfdp, uint8_t lines)
+{
+	w25qxx_geometry_t *geometry = &geometry_flash.geometry;
+	uint8_t page[W25Q_PAGE_SIZE];
+	uint8_t read[W25Q_PAGE_SIZE];
+	unsigned long long start;
+	double erase_ms;
+	uint32_t size = die_size * dies;
+	uint32_t i;
+
+	sim_init(die_size, dies, has_sfdp);
+	sim_lines(lines);
+	w25qxx_init(&geometry_flash, &sim_if);
+	w25qxx_Set_Scratch(&geometry_flash, geometry_scratch);
+	GEOMETRY_EXPECT((geometry->size == size) && (geometry->die_size == die_size) && (geometry->dies == dies), "%s : size %u die %u x %u",
+					name, geometry->size, geometry->die_size, geometry->dies);
+	GEOMETRY_EXPECT(geometry->address_bytes == ((die_size > 0x1000000UL) ? 4 : 3), "%s : %u address bytes", name, geometry->address_bytes);
+	GEOMETRY_EXPECT((geometry->erase[0].size == W25Q_SECTOR_SIZE) && (geometry->erase[0].cmd == W25Q_SECTOR_ERASE), "%s : sector erase", name);
+	GEOMETRY_EXPECT(geometry_flash._read_mode == ((lines == 4) ? W25Q_READ_QUAD_IO : W25Q_READ_SINGLE), "%s : read mode %u", name, geometry_flash._read_mode);
+
+	geometry_span(name, W25Q_SECTOR_SIZE);
+	geometry_span(name, (size / 2) - W25Q_SECTOR_SIZE);
+	geometry_span(name, size - GEOMETRY_SPAN);
+
+	start = sim_ns;
+	GEOMETRY_EXPECT(true == w25qxx_Chip_Erase(&geometry_flash), "%s : chip erase", name);
+	erase_ms = sim_ms(start);
+	for (i = 0; (i < size) && (sim_mem[i] == 0xFF); i++)
+	{
+	}
+	GEOMETRY_EXPECT(i == size, "%s : chip erase left %x", name, i);
+
+	/* the reset drops 4-byte mode and the die : the driver sets them again */
+	memset(page, 0x3C, sizeof(page));
+	GEOMETRY_EXPECT(true == flash_WriteMemory(&geometry_flash, size - W25Q_PAGE_SIZE, page, sizeof(page)), "%s : last page", name);
+	w25qxx_Reset(&geometry_flash);
+	flash_ReadMemory(&geometry_flash, size - W25Q_PAGE_SIZE, read, sizeof(read));
+	GEOMETRY_EXPECT(0 == memcmp(read, page, sizeof(page)), "%s : last page after reset", name);
+	printf("%-22s : %u x %uMB, %u address bytes, chip erase %.0f ms\n", name, geometry->dies, geometry->die_size >> 20,
+		   geometry->address_bytes, erase_ms);
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+	srand(1);
+	geometry_run("W25Q16, no SFDP", SIM_W25Q16, 1, false, 1);
+	geometry_run("W25Q16", SIM_W25Q16, 1, true, 1);
+	geometry_run("W25Q256", SIM_W25Q256, 1, true, 1);
+	geometry_run("W25Q256, quad", SIM_W25Q256, 1, true, 4);
+	geometry_run("W25M512 stacked", SIM_W25Q256, 2, true, 1);
+	geometry_run("W25M512 stacked, quad", SIM_W25Q256, 2, true, 4);
+	printf("geometry smoke : %lu failed\n", geometry_fail);
+	return (geometry_fail > 255U) ? 255 : (int)geometry_fail;
+}
@@ -0,0 +1,173 @@
+/*
+ * host smoke test of w25qxx_kv over the flash model (w25qxx_sim.h) of a 2MB W25Q16, run from FLASH/w25qxx/ :
+ *   gcc -O1 -g -fsanitize=address,undefined test/w25qxx_kv_smoke.c -o kv && ./kv
+ * random sets / deletes checked against a RAM copy with a remount every 10k, a torn record,
+ * a new key on a full index, set / delete churn over many more keys than the index holds.
+ * exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../w25qxx.c"
+#include "../w25qxx_ckpt.c"
+#include "../w25qxx_kv.c"
+#include "w25qxx_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define KV_START_SECTOR			100
+#define KV_SECTORS				4
+#define KV_KEYS					100
+#define KV_OPS					100000UL
+#define KV_REMOUNT				10000UL
+#define KV_CHURN				20000U
+
+#define KV_EXPECT(cond, ...)	do{ if(!(cond)){ if(kv_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long kv_fail = 0;
+static w25qxx_handle_t kv_flash;
+static w25qxx_kv_t kv;
+static uint8_t kv_ref[KV_KEYS][W25Q_KV_VALUE_MAX];
+static int16_t kv_ref_len[KV_KEYS];						// -1 : absent
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static void kv_verify(const char *when)
+{
+	uint8_t value[W25Q_KV_VALUE_MAX];
+	uint8_t len;
+
+	for (uint16_t key = 0; key < KV_KEYS; key++)
+	{
+		len = sizeof(value);
+		bool is_found = w25qxx_kv_get(&kv, key, value, &len);
+		if (kv_ref_len[key] < 0)
+		{
+			KV_EXPECT(false == is_found, "%s : key %u should be absent", when, key);
+		}
+		else
+		{
+			KV_EXPECT((true == is_found) && (len == kv_ref_len[key]) && (0 == memcmp(value, kv_ref[key], len)), "%s : key %u", when, key);
+		}
+	}
+}
+
+/* flash address of the record the index holds for key */
+static uint32_t kv_record(w25qxx_kv_t *me, uint16_t key)
+{
+	for (uint16_t i = 0; i < me->index_size; i++)
+	{
+		if ((me->_index[i].key == key) && (0 == me->_index[i].is_deleted))
+		{
+			return me->_index[i].address;
+		}
+	}
+	return 0;
+}
+
+static void kv_random(void)
+{
+	unsigned long programs = sim_programs;
+	unsigned long erases = sim_erases[0];
+
+	memset(kv_ref_len, 0xFF, sizeof(kv_ref_len));
+	for (unsigned long n = 1; n <= KV_OPS; n++)
+	{
+		uint16_t key = (uint16_t)(rand() % KV_KEYS);
+		if ((rand() % 10) == 0)
+		{
+			KV_EXPECT(true == w25qxx_kv_delete(&kv, key), "op %lu : delete %u failed", n, key);
+			kv_ref_len[key] = -1;
+		}
+		else
+		{
+			kv_ref_len[key] = (int16_t)(rand() % (W25Q_KV_VALUE_MAX + 1));
+			for (int16_t i = 0; i < kv_ref_len[key]; i++)
+			{
+				kv_ref[key][i] = (uint8_t)rand();
+			}
+			KV_EXPECT(true == w25qxx_kv_set(&kv, key, kv_ref[key], (uint8_t)kv_ref_len[key]), "op %lu : set %u failed", n, key);
+		}
+		if ((n % KV_REMOUNT) == 0)
+		{
+			KV_EXPECT(true == w25qxx_kv_mount(&kv), "op %lu : mount failed", n);
+			kv_verify("remount");
+		}
+	}
+	printf("%lu ops on %u sectors : %.3f programs / op, %.4f erases / op\n", KV_OPS, KV_SECTORS,
+		   (double)(sim_programs - programs) / KV_OPS, (double)(sim_erases[0] - erases) / KV_OPS);
+}
+
+/* a record whose CRC fails is dropped at mount, the previous value comes back */
+static void kv_torn(void)
+{
+	uint8_t old[4] = {1, 2, 3, 4};
+	uint8_t value[4] = {5, 6, 7, 8};
+
+	memcpy(kv_ref[7], old, sizeof(old));
+	kv_ref_len[7] = sizeof(old);
+	KV_EXPECT(true == w25qxx_kv_set(&kv, 7, old, sizeof(old)), "torn : first set");
+	KV_EXPECT(true == w25qxx_kv_set(&kv, 7, value, sizeof(value)), "torn : second set");
+	sim_mem[kv_record(&kv, 7) + W25Q_KV_RECORD_HEADER_SIZE] ^= 0x01;
+	KV_EXPECT(true == w25qxx_kv_mount(&kv), "torn : mount failed");
+	kv_verify("torn");
+}
+
+/* a new key on a full index : refused with nothing written. deleted keys free their slot */
+static void kv_full(void)
+{
+	static w25qxx_kv_t small;
+	uint8_t value[4] = {0};
+	uint8_t len = sizeof(value);
+	unsigned long programs;
+	unsigned long erases;
+
+	KV_EXPECT(true == w25qxx_kv_init(&small, &kv_flash, KV_START_SECTOR + KV_SECTORS, KV_SECTORS, 2), "full : init");
+	KV_EXPECT(true == w25qxx_kv_format(&small), "full : format");
+	for (uint16_t key = 0; key < small.index_size; key++)
+	{
+		KV_EXPECT(true == w25qxx_kv_set(&small, key, value, sizeof(value)), "full : set %u", key);
+	}
+	programs = sim_programs;
+	erases = sim_erases[0];
+	KV_EXPECT(false == w25qxx_kv_set(&small, small.index_size, value, sizeof(value)), "full : new key accepted");
+	KV_EXPECT((sim_programs == programs) && (sim_erases[0] == erases), "full : refused set wrote %lu pages, %lu erases",
+			  sim_programs - programs, sim_erases[0] - erases);
+
+	for (uint16_t n = 0; n < KV_CHURN; n++)
+	{
+		value[0] = (uint8_t)n;
+		KV_EXPECT(true == w25qxx_kv_delete(&small, (n == 0) ? 0 : (uint16_t)(1000 + n - 1)), "churn %u : delete", n);
+		KV_EXPECT(true == w25qxx_kv_set(&small, (uint16_t)(1000 + n), value, sizeof(value)), "churn %u : set", n);
+	}
+	KV_EXPECT(true == w25qxx_kv_mount(&small), "churn : mount");
+	KV_EXPECT((true == w25qxx_kv_get(&small, 1000 + KV_CHURN - 1, value, &len)) && (value[0] == (uint8_t)(KV_CHURN - 1)), "churn : last key");
+	KV_EXPECT(false == w25qxx_kv_get(&small, 1000 + KV_CHURN - 2, value, &len), "churn : deleted key found");
+	free(small._index);
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+	srand(1);
+	sim_init(SIM_W25Q16, 1, false);
+	w25qxx_init(&kv_flash, &sim_if);
+	if ((false == w25qxx_kv_init(&kv, &kv_flash, KV_START_SECTOR, KV_SECTORS, KV_KEYS)) || (false == w25qxx_kv_format(&kv)))
+	{
+		printf("kv init failed\n");
+		return 1;
+	}
+	kv_random();
+	kv_torn();
+	kv_full();
+	free(kv._index);
+	printf("kv smoke : %lu failed\n", kv_fail);
+	return (kv_fail > 255U) ? 255 : (int)kv_fail;
+}
@@ -0,0 +1,406 @@
+#ifndef W25QXX_SIM_H
+#define W25QXX_SIM_H
+
+/*
+ * host RAM model of a W25Q SPI NOR flash, used by the programs in this folder (include it after ../w25qxx.c).
+ * sim_init picks the part : size of a die, 1 or 2 stacked dies (W25M), SFDP table or not. sim_lines(2 / 4)
+ * wires spi_read_multi for dual / quad reads.
+ * time : sim_ns moves with the SPI clock (SIM_SPI_BYTE_NS per byte on one line), delay_us / delay_ms,
+ * and a program / erase keeps SR1 BUSY for its SIM_*_NS. a busy chip ignores every command but the SR reads,
+ * sim_stuck keeps it busy for good.
+ * power : after sim_budget program / erase commands the next one is torn (a random part of the bits it would
+ * clear / set) and the chip is off, commands ignored and reads 0xFF, until sim_power_on.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define SIM_MEM_MAX				(64UL * 1024 * 1024)	// 2 x 32MB stacked at most
+#define SIM_CMD_SIZE			(5 + W25Q_PAGE_SIZE)
+
+#define SIM_SPI_BYTE_NS			400ULL					// 20 MHz single line
+#define SIM_PROGRAM_NS			700000ULL
+#define SIM_ERASE_4K_NS			45000000ULL				// erases at the W25Q16JV typical
+#define SIM_ERASE_32K_NS		120000000ULL
+#define SIM_ERASE_64K_NS		150000000ULL
+#define SIM_ERASE_DIE_NS		5000000000ULL
+#define SIM_STATUS_WRITE_NS		10000000ULL
+
+#define SIM_W25Q16				(2UL * 1024 * 1024)
+#define SIM_W25Q256				(32UL * 1024 * 1024)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static uint8_t sim_mem[SIM_MEM_MAX];
+static uint32_t sim_size;						// whole part
+static uint8_t sim_dies;
+static bool sim_has_sfdp;
+static uint8_t sim_sfdp[256];
+
+static uint8_t sim_cmd[SIM_CMD_SIZE];
+static uint16_t sim_len;
+static uint32_t sim_read;						// bytes read so far by the running read command
+static bool sim_wel;
+static uint8_t sim_sr2;
+static uint8_t sim_die;
+static bool sim_4b[2];							// 4-byte address mode, per die
+static bool sim_no31;							// part without the 0x31 SR2 write : QE goes through 0x01
+
+static unsigned long long sim_ns;
+static unsigned long long sim_busy_until;
+static bool sim_stuck;
+static bool sim_off;							// power is down : commands ignored, the bus reads 0xFF
+static long sim_budget = -1;					// program / erase commands left before the cut, -1 : never
+
+static unsigned long sim_programs;
+static unsigned long sim_erases[W25Q_ERASE_TYPES];	// 4KB, 32KB, 64KB, die
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static uint32_t sim_die_size(void)
+{
+	return sim_size / sim_dies;
+}
+
+static bool sim_is_busy(void)
+{
+	return (true == sim_stuck) || (sim_ns < sim_busy_until);
+}
+
+static void sim_put32(uint8_t *at, uint32_t value)
+{
+	at[0] = (uint8_t)value;
+	at[1] = (uint8_t)(value >> 8);
+	at[2] = (uint8_t)(value >> 16);
+	at[3] = (uint8_t)(value >> 24);
+}
+
+/* JESD216 header and basic table : 4KB / 32KB / 64KB erase, typical times and max multiplier, 3 or 4 byte address */
+static void sim_sfdp_build(void)
+{
+	uint8_t *table = &sim_sfdp[0x80];
+
+	memset(sim_sfdp, 0xFF, sizeof(sim_sfdp));
+	sim_put32(&sim_sfdp[0], W25Q_SFDP_SIGNATURE);
+	sim_sfdp[4]  = 6;							// JESD216B, one parameter header
+	sim_sfdp[5]  = 1;
+	sim_sfdp[6]  = 0;
+	sim_sfdp[8]  = 0;							// basic table, 16 dwords at 0x80
+	sim_sfdp[9]  = 6;
+	sim_sfdp[10] = 1;
+	sim_sfdp[11] = 16;
+	sim_put32(&sim_sfdp[12], 0xFF000080UL);
+	sim_put32(&table[0], (0xFFF120E5UL & ~(3UL << 17)) | ((sim_die_size() > 0x1000000UL) ? (1UL << 17) : 0));
+	sim_put32(&table[4], (sim_die_size() * 8UL) - 1UL);
+	table[28] = 12;								// erase types : size as a power of 2, opcode
+	table[29] = W25Q_SECTOR_ERASE;
+	table[30] = 15;
+	table[31] = W25Q_32KB_BLOCK_ERASE;
+	table[32] = 16;
+	table[33] = W25Q_64KB_BLOCK_ERASE;
+	table[34] = 0;
+	table[35] = 0;
+	sim_put32(&table[36], 4UL | (0x22UL << 4) | (0x27UL << 11) | (0x29UL << 18));
+	sim_put32(&table[40], 2UL | (0x33UL << 24));
+}
+
+/* what a reset or a power up leaves : idle, 3-byte addressing, die 0 */
+static void sim_reset(void)
+{
+	sim_wel        = false;
+	sim_die        = 0;
+	sim_4b[0]      = false;
+	sim_4b[1]      = false;
+	sim_busy_until = 0;
+}
+
+/* power back after a cut */
+static inline void sim_power_on(void)
+{
+	sim_off    = false;
+	sim_budget = -1;
+	sim_reset();
+}
+
+/* fresh part, erased, power on */
+static inline void sim_init(uint32_t die_size, uint8_t dies, bool has_sfdp)
+{
+	sim_size     = die_size * dies;
+	sim_dies     = dies;
+	sim_has_sfdp = has_sfdp;
+	memset(sim_mem, 0xFF, sim_size);
+	sim_sfdp_build();
+	sim_len      = 0;
+	sim_sr2      = 0;
+	sim_no31     = false;
+	sim_stuck    = false;
+	sim_programs = 0;
+	sim_power_on();
+	memset(sim_erases, 0, sizeof(sim_erases));
+}
+
+/* false : the cut happens on this command, it only gets done for a random part of its bits */
+static bool sim_power(void)
+{
+	if (sim_budget < 0)
+	{
+		return true;
+	}
+	if (sim_budget-- > 0)
+	{
+		return true;
+	}
+	sim_off = true;
+	return false;
+}
+
+static uint8_t sim_address_bytes(void)
+{
+	return sim_4b[sim_die] ? 4 : 3;
+}
+
+/* address sent after the instruction, plus offset, wrapped inside the selected die */
+static uint32_t sim_address(uint32_t offset)
+{
+	uint32_t address = 0;
+	for (uint8_t i = 1; i <= sim_address_bytes(); i++)
+	{
+		address = (address << 8) | sim_cmd[i];
+	}
+	return (sim_die * sim_die_size()) + ((address + offset) % sim_die_size());
+}
+
+static void sim_erase(uint32_t address, uint32_t size, uint8_t type, unsigned long long busy_ns)
+{
+	bool is_torn = (false == sim_power());
+
+	address &= ~(size - 1UL);
+	for (uint32_t i = 0; i < size; i++)
+	{
+		sim_mem[address + i] |= is_torn ? (uint8_t)rand() : 0xFF;
+	}
+	sim_erases[type]++;
+	sim_busy_until = sim_ns + busy_ns;
+}
+
+static void sim_program(uint32_t address)
+{
+	uint8_t header = 1 + sim_address_bytes();
+	bool is_torn = (false == sim_power());
+
+	for (uint16_t i = 0; i < sim_len - header; i++)
+	{
+		uint32_t at = (address & ~(W25Q_PAGE_SIZE - 1UL)) | ((address + i) & (W25Q_PAGE_SIZE - 1UL));
+		sim_mem[at] &= is_torn ? (uint8_t)(sim_cmd[header + i] | rand()) : sim_cmd[header + i];
+	}
+	sim_programs++;
+	sim_busy_until = sim_ns + SIM_PROGRAM_NS;
+}
+
+static void sim_csLOW(void)
+{
+	sim_len  = 0;
+	sim_read = 0;
+}
+
+/* commands run when cs goes high, those with an address only once it was all sent */
+static void sim_csHIGH(void)
+{
+	bool has_address = (sim_len > sim_address_bytes());
+	uint8_t instruction = sim_cmd[0];
+
+	if ((true == sim_off) || (sim_len == 0) || (true == sim_is_busy()))
+	{
+		return;
+	}
+	switch (instruction)
+	{
+		case W25Q_WRITE_ENABLE:
+			sim_wel = true;
+			return;
+		case W25Q_WRITE_DISABLE:
+			break;
+		case W25Q_ENTER_4B_MODE:
+			sim_4b[sim_die] = true;
+			return;
+		case W25Q_DIE_SELECT:
+			sim_die = (sim_len > 1) ? (sim_cmd[1] % sim_dies) : sim_die;
+			return;
+		case W25Q_RESET:
+			sim_reset();
+			return;
+		case W25Q_PAGE_PROGRAM:
+			if ((false == sim_wel) || (sim_len <= 1 + sim_address_bytes())) return;
+			sim_program(sim_address(0));
+			break;
+		case W25Q_SECTOR_ERASE:
+			if ((false == sim_wel) || (false == has_address)) return;
+			sim_erase(sim_address(0), W25Q_SECTOR_SIZE, 0, SIM_ERASE_4K_NS);
+			break;
+		case W25Q_32KB_BLOCK_ERASE:
+			if ((false == sim_wel) || (false == has_address)) return;
+			sim_erase(sim_address(0), W25Q_BLOCK32_SIZE, 1, SIM_ERASE_32K_NS);
+			break;
+		case W25Q_64KB_BLOCK_ERASE:
+			if ((false == sim_wel) || (false == has_address)) return;
+			sim_erase(sim_address(0), W25Q_BLOCK_SIZE, 2, SIM_ERASE_64K_NS);
+			break;
+		case W25Q_CHIP_ERASE:
+			if (false == sim_wel) return;
+			sim_erase(sim_die * sim_die_size(), sim_die_size(), 3, SIM_ERASE_DIE_NS);
+			break;
+		case W25Q_WRITE_SR2:
+			if ((false == sim_wel) || (sim_len < 2) || (true == sim_no31)) return;
+			sim_sr2 = sim_cmd[1];
+			sim_busy_until = sim_ns + SIM_STATUS_WRITE_NS;
+			break;
+		case W25Q_WRITE_SR1:
+			if ((false == sim_wel) || (sim_len < 3)) return;
+			sim_sr2 = sim_cmd[2];
+			sim_busy_until = sim_ns + SIM_STATUS_WRITE_NS;
+			break;
+		default:
+			return;
+	}
+	sim_wel = false;
+}
+
+static void sim_spi_write(uint8_t *pdata, uint16_t len)
+{
+	sim_ns += len * SIM_SPI_BYTE_NS;
+	for (uint16_t i = 0; (i < len) && (sim_len < SIM_CMD_SIZE); i++)
+	{
+		sim_cmd[sim_len++] = pdata[i];
+	}
+}
+
+static void sim_spi_read(uint8_t *pdata, uint16_t len)
+{
+	uint8_t id[3] = {0xEF, (sim_dies > 1) ? 0x71 : 0x40, 0};
+
+	while ((1UL << id[2]) < sim_die_size())
+	{
+		id[2]++;
+	}
+	for (uint16_t i = 0; i < len; i++, sim_read++)
+	{
+		sim_ns += SIM_SPI_BYTE_NS;
+		if (true == sim_off)
+		{
+			pdata[i] = 0xFF;					// SR1 busy for good, the driver times out
+			continue;
+		}
+		switch (sim_cmd[0])
+		{
+			case W25Q_READ_SR1:
+				pdata[i] = (sim_is_busy() ? 0x01 : 0x00) | (sim_wel ? 0x02 : 0x00);
+				continue;
+			case W25Q_READ_SR2:
+				pdata[i] = sim_sr2;
+				continue;
+			case W25Q_READ_SR3:
+				pdata[i] = 0;
+				continue;
+			default:
+				break;
+		}
+		if (true == sim_is_busy())
+		{
+			pdata[i] = 0xFF;
+			continue;
+		}
+		switch (sim_cmd[0])
+		{
+			case W25Q_JEDEC_ID:
+				pdata[i] = (sim_read < 3) ? id[sim_read] : 0;
+				break;
+			case W25Q_READ_SFDP:
+				pdata[i] = sim_has_sfdp ? sim_sfdp[((((uint32_t)sim_cmd[2] << 8) | sim_cmd[3]) + sim_read) & 0xFF] : 0xFF;
+				break;
+			case W25Q_FAST_READ:
+			case W25Q_READ_DATA:
+				pdata[i] = sim_mem[sim_address(sim_read)];
+				break;
+			default:
+				pdata[i] = 0;
+				break;
+		}
+	}
+}
+
+/* whole read in one call, clocked by lines. a command the chip would not take reads 0xA5 */
+static void sim_spi_read_multi(const w25qxx_multi_cmd_t *cmd, uint8_t *pdata, uint32_t len)
+{
+	bool is_quad_io = (cmd->instruction == W25Q_FAST_READ_QUAD_IO);
+	bool is_valid = (false == sim_off) && (false == sim_is_busy()) && (cmd->address_bytes == sim_address_bytes());
+	uint32_t base = sim_die * sim_die_size();
+
+	sim_ns += (SIM_SPI_BYTE_NS / 8) * (8 + ((cmd->address_bytes + cmd->alternate_bytes) * 8UL / cmd->address_lines) +
+								   cmd->dummy_cycles + (len * 8ULL / cmd->data_lines));
+	if ((cmd->data_lines == 4) && (0 == (sim_sr2 & 0x02)))
+	{
+		is_valid = false;						// QE clear : IO2 / IO3 are WP# / HOLD#
+	}
+	if (true == is_quad_io)
+	{
+		is_valid = is_valid && (cmd->address_lines == 4) && (cmd->alternate_bytes == 1) && (cmd->dummy_cycles == 4) && ((cmd->alternate & 0x30) != 0x20);
+	}
+	else
+	{
+		is_valid = is_valid && (cmd->address_lines == 1) && (cmd->dummy_cycles == 8);
+	}
+	for (uint32_t i = 0; i < len; i++)
+	{
+		pdata[i] = is_valid ? sim_mem[base + ((cmd->address + i) % sim_die_size())] : 0xA5;
+	}
+}
+
+static void sim_delay_us(uint32_t us)
+{
+	sim_ns += us * 1000ULL;
+}
+
+static void sim_delay_ms(uint32_t ms)
+{
+	sim_ns += ms * 1000000ULL;
+}
+
+static inline uint32_t sim_get_us(void)
+{
+	return (uint32_t)(sim_ns / 1000U);
+}
+
+static void sim_debug_print(const char *const fmt, ...)
+{
+	(void)fmt;
+}
+
+static w25qxxIF_t sim_if = {
+	.csHIGH      = sim_csHIGH,
+	.csLOW       = sim_csLOW,
+	.spi_read    = sim_spi_read,
+	.spi_write   = sim_spi_write,
+	.delay_us    = sim_delay_us,
+	.delay_ms    = sim_delay_ms,
+	.debug_print = sim_debug_print,
+};
+
+/* 1 : single line only, 2 / 4 : spi_read_multi wired with that many data lines */
+static inline void sim_lines(uint8_t lines)
+{
+	sim_if.spi_read_multi = (lines > 1) ? sim_spi_read_multi : NULL;
+	sim_if.data_lines     = (lines > 1) ? lines : 0;
+}
+
+/* ms of model time since start */
+static inline double sim_ms(unsigned long long start)
+{
+	return (double)(sim_ns - start) / 1e6;
+}
+
+#endif /* W25QXX_SIM_H */
@@ -15,7 +15,10 @@
 /*==================================================================================================
                                        DEFINES AND MACROS
 ==================================================================================================*/
-#define numBLOCK 32  // number of total blocks for 16Mb flash, 32x16x16 pages and 32x16x16x256 Bytes
+#ifndef W25Q_DEFAULT_SIZE
+#define W25Q_DEFAULT_SIZE        0x200000   // chip answering neither JEDEC ID nor SFDP : W25Q16
+#endif
+#define W25Q_POLL_MIN_US         10   // shortest gap between two SR1 reads
 
 /********************** command ****************************/
 #define W25Q_WRITE_ENABLE        0x06
@@ -44,22 +47,68 @@
 #define W25Q_ENABLE_RST          0x66
 #define W25Q_RESET               0x99
 
-#define W25Q_SECTOR_ERASE_4B     0x21
-#define W25Q_READ_DATA_4B        0x13
-#define W25Q_FAST_READ_4B        0x0C
-#define W25Q_PAGE_PROGRAM_4B     0x12
-#define W25Q_64KB_BLOCK_ERASE_4B 0xDC
+#define W25Q_READ_SFDP           0x5A
+#define W25Q_ENTER_4B_MODE       0xB7
+#define W25Q_DIE_SELECT          0xC2
+
+#define W25Q_FAST_READ_DUAL_OUT     0x3B
+#define W25Q_FAST_READ_QUAD_OUT     0x6B
+#define W25Q_FAST_READ_QUAD_IO      0xEB
+
+#define W25Q_SFDP_SIGNATURE      0x50444653UL   // "SFDP"
+#define W25Q_STACKED_DIE_TYPE    0x71           // JEDEC memory type of the W25M stacked parts
 /*==================================================================================================
 *                                              ENUMS
 ==================================================================================================*/
+typedef enum{
+	W25Q_OP_PAGE_PROGRAM,
+	W25Q_OP_SECTOR_ERASE,
+	W25Q_OP_BLOCK32_ERASE,
+	W25Q_OP_BLOCK64_ERASE,
+	W25Q_OP_CHIP_ERASE,
+	W25Q_OP_STATUS_WRITE,
+	W25Q_OP_NUMBER
+}w25qxx_op_e;
 
 /*==================================================================================================
 *                                  STRUCTURES AND OTHER TYPEDEFS
 ==================================================================================================*/
+typedef struct{
+	uint32_t typ_us;
+	uint32_t max_us;
+}w25qxx_busy_time_t;
+
+typedef struct{
+	uint8_t cmd;
+	uint8_t address_lines;
+	uint8_t alternate_bytes;
+	uint8_t dummy_cycles;
+	uint8_t data_lines;
+}w25qxx_read_cmd_t;
 
 /*==================================================================================================
 *                                  LOCAL VARIABLE DECLARATIONS
 ==================================================================================================*/
+/* busy time per operation, datasheet typical / maximum (W25Q16JV), erases go by me->geometry */
+static const w25qxx_busy_time_t w25qxx_busy_time[W25Q_OP_NUMBER] = {
+	[W25Q_OP_PAGE_PROGRAM]  = {400,     3000},
+	[W25Q_OP_STATUS_WRITE]  = {10000,   15000},
+};
+
+/* erase types of a chip without SFDP, indexed from W25Q_OP_SECTOR_ERASE, chip erase maximum covers the larger parts */
+static const w25qxx_erase_type_t w25qxx_erase_default[W25Q_ERASE_TYPES] = {
+	{W25Q_SECTOR_SIZE,  W25Q_SECTOR_ERASE,     45000,   400000},
+	{W25Q_BLOCK32_SIZE, W25Q_32KB_BLOCK_ERASE, 120000,  1600000},
+	{W25Q_BLOCK_SIZE,   W25Q_64KB_BLOCK_ERASE, 150000,  2000000},
+	{0,                 W25Q_CHIP_ERASE,       5000000, 100000000},
+};
+
+/* multi-line reads, dummy cycles as counted by the chip after the address (and mode byte) */
+static const w25qxx_read_cmd_t w25qxx_read_cmd[] = {
+	[W25Q_READ_DUAL_OUT] = {W25Q_FAST_READ_DUAL_OUT, 1, 0, 8, 2},
+	[W25Q_READ_QUAD_OUT] = {W25Q_FAST_READ_QUAD_OUT, 1, 0, 8, 4},
+	[W25Q_READ_QUAD_IO]  = {W25Q_FAST_READ_QUAD_IO,  4, 1, 4, 4},
+};
 
 /*==================================================================================================
 *                                  GLOBAL VARIABLE DECLARATIONS
@@ -68,6 +117,7 @@
 /*==================================================================================================
 *                                       FUNCTION PROTOTYPES
 ==================================================================================================*/
+static void w25qxx_cache_invalidate(w25qxx_handle_t *me, uint32_t memAddr, uint32_t len);
 
 /*==================================================================================================
 *                                         LOCAL FUNCTIONS
@@ -142,18 +192,47 @@ static void w25qxx_write_SR3(w25qxx_handle_t *me, uint8_t reg)
 	tmpIF->csHIGH();
 }
 
-static void w25qxx_Waitforwrite(w25qxx_handle_t *me)
+/*
+ * SR1 polled every typ/16 until the typical time is reached, then the gap doubles up to typ/4.
+ * false : still busy after the maximum time.
+ */
+static bool w25qxx_Waitforwrite(w25qxx_handle_t *me, uint8_t op)
 {
     w25qxxIF_t *tmpIF = me->meIF;
 	uint8_t tData = W25Q_READ_SR1;
+	w25qxx_busy_time_t busy = w25qxx_busy_time[op];
+	uint32_t interval;
+	uint32_t elapsed = 0;
+	bool retVal = true;
+
+	if ((op >= W25Q_OP_SECTOR_ERASE) && (op <= W25Q_OP_CHIP_ERASE))
+	{
+		busy.typ_us = me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].typ_us;
+		busy.max_us = me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].max_us;
+	}
+	interval = busy.typ_us/16;
+	if (interval < W25Q_POLL_MIN_US) interval = W25Q_POLL_MIN_US;
+
 	tmpIF->csLOW();
 	tmpIF->spi_write(&tData, 1);
-	do
+	tmpIF->spi_read(&tData, 1);
+	while (tData & 0x01)  // until the bit to reset
 	{
+		if (elapsed >= busy.max_us)
+		{
+			retVal = false;
+			break;
+		}
+		tmpIF->delay_us(interval);
+		elapsed += interval;
+		if ((elapsed >= busy.typ_us) && (interval < busy.typ_us/4))
+		{
+			interval *= 2;
+		}
 		tmpIF->spi_read(&tData, 1);  //keep reading status register
-        tmpIF->delay_ms(5);
-	} while (tData & 0x01);  // until the bit to reset
+	}
 	tmpIF->csHIGH();
+	return retVal;
 }
 
 static void write_enable (w25qxx_handle_t *me)
@@ -176,6 +255,63 @@ static void write_disable(w25qxx_handle_t *me)
 	tmpIF->delay_us(1);  // 5ms delay
 }
 
+/* stacked dies : selects the die holding memAddr, returns the address inside it */
+static uint32_t w25qxx_die_address(w25qxx_handle_t *me, uint32_t memAddr)
+{
+	uint8_t tData[2];
+
+	if (me->geometry.dies <= 1)
+	{
+		return memAddr;
+	}
+	tData[0] = W25Q_DIE_SELECT;
+	tData[1] = memAddr / me->geometry.die_size;
+	if (tData[1] != me->_die)
+	{
+		me->meIF->csLOW();
+		me->meIF->spi_write(tData, 2);
+		me->meIF->csHIGH();
+		me->_die = tData[1];
+	}
+	return memAddr % me->geometry.die_size;
+}
+
+/* bytes of [memAddr, memAddr+size) before the end of its die, one command never crosses it */
+static uint32_t w25qxx_die_span(w25qxx_handle_t *me, uint32_t memAddr, uint32_t size)
+{
+	uint32_t left;
+
+	if (me->geometry.dies <= 1)
+	{
+		return size;
+	}
+	left = me->geometry.die_size - (memAddr % me->geometry.die_size);
+	return (size < left) ? size : left;
+}
+
+/* command builders picked by w25qxx_init : opcode and address into tData, returns the bytes used */
+static uint8_t w25qxx_command_3b(w25qxx_handle_t *me, uint8_t *tData, uint8_t cmd, uint32_t memAddr)
+{
+	memAddr = w25qxx_die_address(me, memAddr);
+	tData[0] = cmd;
+	tData[1] = (memAddr>>16)&0xFF;  // MSB of the memory Address
+	tData[2] = (memAddr>>8)&0xFF;
+	tData[3] = (memAddr)&0xFF; // LSB of the memory Address
+	return 4;
+}
+
+/* chips > 16MB, in 4-byte address mode : same opcodes, 32bit address */
+static uint8_t w25qxx_command_4b(w25qxx_handle_t *me, uint8_t *tData, uint8_t cmd, uint32_t memAddr)
+{
+	memAddr = w25qxx_die_address(me, memAddr);
+	tData[0] = cmd;
+	tData[1] = (memAddr>>24)&0xFF;  // MSB of the memory Address
+	tData[2] = (memAddr>>16)&0xFF;
+	tData[3] = (memAddr>>8)&0xFF;
+	tData[4] = (memAddr)&0xFF; // LSB of the memory Address
+	return 5;
+}
+
 static uint32_t bytestowrite (uint32_t size, uint16_t offset)
 {
 	if ((size+offset)<256) return size;
@@ -188,6 +324,536 @@ static uint32_t bytestomodify (uint32_t size, uint16_t offset)
 	else return 4096-offset;
 }
 
+/* one page program straight from data, len must not cross the page end, returns with the chip busy */
+static void w25qxx_page_program_start(w25qxx_handle_t *me, uint32_t memAddr, uint8_t *data, uint32_t len)
+{
+    w25qxxIF_t *tmpIF = me->meIF;
+    uint8_t tData[5];
+    uint8_t indx;
+
+	w25qxx_cache_invalidate(me, memAddr, len);
+	indx = me->_command(me, tData, W25Q_PAGE_PROGRAM, memAddr);  // selects the die first
+	write_enable(me);
+
+	tmpIF->csLOW();
+	tmpIF->spi_write(tData, indx);
+	tmpIF->spi_write(data, len);
+	tmpIF->csHIGH();
+}
+
+static bool w25qxx_page_program(w25qxx_handle_t *me, uint32_t memAddr, uint8_t *data, uint32_t len)
+{
+	bool retVal;
+	w25qxx_page_program_start(me, memAddr, data, len);
+	retVal = w25qxx_Waitforwrite(me, W25Q_OP_PAGE_PROGRAM);
+	write_disable(me);
+	return retVal;
+}
+
+/* returns with the chip busy */
+/* largest erase starting at memAddr that stays inside size bytes */
+static uint8_t w25qxx_erase_op(w25qxx_handle_t *me, uint32_t memAddr, uint32_t size)
+{
+	uint8_t op;
+	for (op = W25Q_OP_BLOCK64_ERASE; op > W25Q_OP_SECTOR_ERASE; op--)
+	{
+		uint32_t eraseSize = me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].size;
+		if ((eraseSize != 0) && ((memAddr % eraseSize) == 0) && (size >= eraseSize))
+		{
+			break;
+		}
+	}
+	return op;
+}
+
+/* returns with the chip busy, op : W25Q_OP_SECTOR_ERASE / W25Q_OP_BLOCK32_ERASE / W25Q_OP_BLOCK64_ERASE */
+static void w25qxx_erase_start(w25qxx_handle_t *me, uint32_t memAddr, uint8_t op)
+{
+    w25qxxIF_t *tmpIF = me->meIF;
+    const w25qxx_erase_type_t *erase = &me->geometry.erase[op - W25Q_OP_SECTOR_ERASE];
+    uint8_t tData[5];
+    uint8_t indx;
+
+	w25qxx_cache_invalidate(me, memAddr, erase->size);
+	indx = me->_command(me, tData, erase->cmd, memAddr);
+	write_enable(me);
+
+	tmpIF->csLOW();
+	tmpIF->spi_write(tData, indx);
+	tmpIF->csHIGH();
+}
+
+/* whole die holding memAddr, returns with the chip busy */
+static void w25qxx_chip_erase_start(w25qxx_handle_t *me, uint32_t memAddr)
+{
+    w25qxxIF_t *tmpIF = me->meIF;
+    uint8_t tData = W25Q_CHIP_ERASE;
+
+	w25qxx_cache_invalidate(me, 0, W25Q_CACHE_EMPTY);
+	w25qxx_die_address(me, memAddr);
+	write_enable(me);
+
+	tmpIF->csLOW();
+	tmpIF->spi_write(&tData, 1);
+	tmpIF->csHIGH();
+}
+
+/* next step of the running job, the chip is not busy */
+static void w25qxx_job_step(w25qxx_handle_t *me, w25qxx_job_t *job)
+{
+	uint32_t len;
+	uint8_t op;
+	switch (job->type)
+	{
+		case W25Q_JOB_PROGRAM:
+			len = bytestowrite(job->size, job->address%256);
+			job->_step_max_us = w25qxx_busy_time[W25Q_OP_PAGE_PROGRAM].max_us;
+			w25qxx_page_program_start(me, job->address, job->data, len);
+			job->address += len;
+			job->data    += len;
+			job->size    -= len;
+			break;
+		case W25Q_JOB_ERASE:
+			op = w25qxx_erase_op(me, job->address, job->size*W25Q_SECTOR_SIZE);
+			job->_step_max_us = me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].max_us;
+			w25qxx_erase_start(me, job->address, op);
+			job->address += me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].size;
+			job->size    -= me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].size/W25Q_SECTOR_SIZE;
+			break;
+		case W25Q_JOB_CHIP_ERASE:
+			job->_step_max_us = me->geometry.erase[W25Q_OP_CHIP_ERASE - W25Q_OP_SECTOR_ERASE].max_us;
+			w25qxx_chip_erase_start(me, job->address);
+			job->address += me->geometry.die_size;
+			job->size--;
+			break;
+		default:
+			job->size = 0;
+			break;
+	}
+	job->_step_start   = (me->meIF->get_us != NULL) ? me->meIF->get_us() : 0;
+	job->_step_elapsed = 0;
+}
+
+/* us since the running step was started, w25qxx_poll calls count W25Q_POLL_MIN_US each without get_us */
+static uint32_t w25qxx_job_elapsed(w25qxx_handle_t *me, w25qxx_job_t *job)
+{
+	if (me->meIF->get_us != NULL)
+	{
+		return me->meIF->get_us() - job->_step_start;
+	}
+	job->_step_elapsed += W25Q_POLL_MIN_US;
+	return job->_step_elapsed;
+}
+
+/* job over, DONE or ERROR : the handle is free for the next one before done is called (after ERROR the chip may still be busy) */
+static w25qxx_job_status_e w25qxx_job_finish(w25qxx_handle_t *me, w25qxx_job_t *job, w25qxx_job_status_e status)
+{
+	me->_job = NULL;
+	job->status = status;
+	if (job->done != NULL)
+	{
+		job->done(job);
+	}
+	return status;
+}
+
+/* false when there is nothing to do or the chip is still busy, e.g. with a step a W25Q_JOB_ERROR gave up on */
+static bool w25qxx_job_start(w25qxx_handle_t *me, w25qxx_job_t *job)
+{
+	if (job->size == 0)
+	{
+		return false;
+	}
+	me->SR1.byte = w25qxx_read_SR1(me);
+	if (me->SR1.bits.BUSY)
+	{
+		return false;
+	}
+	job->status = W25Q_JOB_BUSY;
+	me->_job = job;
+	w25qxx_job_step(me, job);
+	return true;
+}
+
+/* program only the bytes of [memAddr, memAddr+size) that differ from old, page by page */
+static bool w25qxx_program_changed(w25qxx_handle_t *me, uint32_t memAddr, uint8_t *old, uint8_t *data, uint32_t size)
+{
+	uint32_t pos = 0;
+	while (pos < size)
+	{
+		uint32_t chunk = bytestowrite(size-pos, (memAddr+pos)%256);
+		uint32_t first = 0;
+		uint32_t last  = chunk;
+		while ((first < chunk) && (old[pos+first] == data[pos+first])) first++;
+		while ((last > first) && (old[pos+last-1] == data[pos+last-1])) last--;
+		if ((first < last) && (false == w25qxx_page_program(me, memAddr+pos+first, &data[pos+first], last-first)))
+		{
+			return false;
+		}
+		pos += chunk;
+	}
+	return true;
+}
+
+/* true : data can be programmed over old without an erase (bits only go 1 -> 0) */
+static bool w25qxx_is_programmable(const uint8_t *old, const uint8_t *data, uint32_t size)
+{
+	for (uint32_t i=0; i<size; i++)
+	{
+		if ((old[i] & data[i]) != data[i]) return false;
+	}
+	return true;
+}
+
+/* true : [memAddr, memAddr+size) takes data without an erase, read back a page at a time */
+static bool w25qxx_range_programmable(w25qxx_handle_t *me, uint32_t memAddr, const uint8_t *data, uint32_t size)
+{
+	uint8_t old[256];
+	uint32_t done = 0;
+
+	while (done < size)
+	{
+		uint32_t chunk = bytestowrite(size-done, (memAddr+done)%256);
+		w25qxx_FastRead(me, (memAddr+done)/256, (memAddr+done)%256, chunk, old);
+		if (!w25qxx_is_programmable(old, &data[done], chunk)) return false;
+		done += chunk;
+	}
+	return true;
+}
+
+/*
+ * erase the sector and program it back with [offset, offset+len) replaced by data.
+ * the sector is held in the scratch buffer, false before anything is erased when there is none.
+ */
+static bool w25qxx_merge_sector(w25qxx_handle_t *me, uint32_t sectorAddr, uint32_t offset, uint8_t *data, uint32_t len)
+{
+	uint8_t *buf = me->_scratch;
+	bool retVal;
+
+	if (buf == NULL)
+	{
+		return false;
+	}
+	/* rest of the sector around the new data */
+	w25qxx_FastRead(me, sectorAddr/256, 0, offset, buf);
+	w25qxx_FastRead(me, (sectorAddr+offset+len)/256, (offset+len)%256, 4096-(offset+len), &buf[offset+len]);
+	memcpy(&buf[offset], data, len);
+
+	retVal = w25qxx_Erase_Sector(me, sectorAddr/4096);
+	for (uint32_t p=0; (p<4096) && retVal; p+=256)
+	{
+		/* an erased page is already all 0xFF */
+		uint32_t first = 0;
+		uint32_t last  = 256;
+		while ((first < 256) && (buf[p+first] == 0xFF)) first++;
+		while ((last > first) && (buf[p+last-1] == 0xFF)) last--;
+		if (first < last)
+		{
+			retVal = w25qxx_page_program(me, sectorAddr+p+first, &buf[p+first], last-first);
+		}
+	}
+
+	return retVal;
+}
+
+static bool w25qxx_writer_program(w25qxx_writer_t *me, uint8_t *data, uint32_t len)
+{
+	while (me->erased < (me->address + len))
+	{
+		if (false == w25qxx_Erase_Sector(me->flash, me->erased/W25Q_SECTOR_SIZE)) return false;
+		me->erased += W25Q_SECTOR_SIZE;
+	}
+	if (false == w25qxx_page_program(me->flash, me->address, data, len)) return false;
+	me->address += len;
+	return true;
+}
+
+/* QE set in SR2 (non-volatile), true when it reads back set : parts without 0x31 take SR1 and SR2 through 0x01 */
+static bool w25qxx_enable_quad(w25qxx_handle_t *me)
+{
+	me->SR2.byte = w25qxx_read_SR2(me);
+	if (me->SR2.bits.QE)
+	{
+		return true;
+	}
+	me->SR2.bits.QE = 1;
+	write_enable(me);
+	w25qxx_write_SR2(me, me->SR2.byte);
+	w25qxx_Waitforwrite(me, W25Q_OP_STATUS_WRITE);
+	me->SR2.byte = w25qxx_read_SR2(me);
+	if (!me->SR2.bits.QE)
+	{
+		uint8_t tData[3];
+		tData[0] = W25Q_WRITE_SR1;
+		tData[1] = w25qxx_read_SR1(me);
+		tData[2] = me->SR2.byte | 0x02;
+		write_enable(me);
+		me->meIF->csLOW();
+		me->meIF->spi_write(tData, 3);
+		me->meIF->csHIGH();
+		w25qxx_Waitforwrite(me, W25Q_OP_STATUS_WRITE);
+		me->SR2.byte = w25qxx_read_SR2(me);
+	}
+	write_disable(me);
+	return me->SR2.bits.QE;
+}
+
+static void w25qxx_multi_read(w25qxx_handle_t *me, uint32_t memAddr, uint32_t size, uint8_t *rData)
+{
+	const w25qxx_read_cmd_t *rc = &w25qxx_read_cmd[me->_read_mode];
+	w25qxx_multi_cmd_t cmd;
+
+	cmd.instruction     = rc->cmd;
+	cmd.address_lines   = rc->address_lines;
+	cmd.address_bytes   = me->geometry.address_bytes;
+	cmd.address         = w25qxx_die_address(me, memAddr);
+	cmd.alternate_bytes = rc->alternate_bytes;
+	cmd.alternate       = 0xFF;   // M5-4 != 10 : no continuous read mode
+	cmd.dummy_cycles    = rc->dummy_cycles;
+	cmd.data_lines      = rc->data_lines;
+	me->meIF->spi_read_multi(&cmd, rData, size);
+}
+
+static void w25qxx_fast_read(w25qxx_handle_t *me, uint32_t memAddr, uint32_t size, uint8_t *rData)
+{
+    w25qxxIF_t *tmpIF = me->meIF;
+    uint8_t tData[6];
+    uint8_t indx;
+    uint32_t len = w25qxx_die_span(me, memAddr, size);
+
+	if (len < size)
+	{
+		w25qxx_fast_read(me, memAddr, len, rData);
+		w25qxx_fast_read(me, memAddr + len, size - len, rData + len);
+		return;
+	}
+
+	if (me->_read_mode != W25Q_READ_SINGLE)
+	{
+		w25qxx_multi_read(me, memAddr, size, rData);
+		return;
+	}
+
+	indx = me->_command(me, tData, W25Q_FAST_READ, memAddr);
+	tData[indx++] = 0;  // Dummy clock
+
+	tmpIF->csLOW();  // pull the CS Low
+	tmpIF->spi_write(tData, indx);  // send read instruction along with the memory address
+
+	tmpIF->spi_read(rData, size);  // Read the data
+	tmpIF->csHIGH();  // pull the CS High
+}
+
+/* drop the cached pages overlapping [memAddr, memAddr+len), called before every program / erase command */
+static void w25qxx_cache_invalidate(w25qxx_handle_t *me, uint32_t memAddr, uint32_t len)
+{
+	w25qxx_cache_t *cache = me->_cache;
+	if (cache == NULL)
+	{
+		return;
+	}
+	for (uint16_t i = 0; i < cache->lines; i++)
+	{
+		uint32_t page = cache->line[i].page;
+		if ((page != W25Q_CACHE_EMPTY) && ((page*W25Q_PAGE_SIZE) < (memAddr + len)) && (((page+1)*W25Q_PAGE_SIZE) > memAddr))
+		{
+			cache->line[i].page = W25Q_CACHE_EMPTY;
+		}
+	}
+}
+
+/* reads inside one page go through the cache, least recently used line refilled on a miss. false : not cached */
+static bool w25qxx_cache_read(w25qxx_handle_t *me, uint32_t memAddr, uint32_t size, uint8_t *rData)
+{
+	w25qxx_cache_t *cache = me->_cache;
+	w25qxx_cache_line_t *line = NULL;
+	uint32_t page = memAddr/W25Q_PAGE_SIZE;
+
+	if ((cache == NULL) || (cache->lines == 0) || (size == 0) || (((memAddr % W25Q_PAGE_SIZE) + size) > W25Q_PAGE_SIZE))
+	{
+		return false;
+	}
+	for (uint16_t i = 0; i < cache->lines; i++)
+	{
+		if (cache->line[i].page == page)
+		{
+			line = &cache->line[i];
+			break;
+		}
+		if ((line == NULL) || (cache->line[i].used < line->used))
+		{
+			line = &cache->line[i];
+		}
+	}
+	if (line->page == page)
+	{
+		cache->hits++;
+	}
+	else
+	{
+		cache->misses++;
+		w25qxx_fast_read(me, page*W25Q_PAGE_SIZE, W25Q_PAGE_SIZE, line->data);
+		line->page = page;
+	}
+	line->used = ++cache->_clock;
+	memcpy(rData, &line->data[memAddr % W25Q_PAGE_SIZE], size);
+	return true;
+}
+
+static void w25qxx_read_sfdp(w25qxx_handle_t *me, uint32_t memAddr, uint8_t *rData, uint32_t size)
+{
+    w25qxxIF_t *tmpIF = me->meIF;
+    uint8_t tData[5];
+
+	tData[0] = W25Q_READ_SFDP;
+	tData[1] = (memAddr>>16)&0xFF;
+	tData[2] = (memAddr>>8)&0xFF;
+	tData[3] = (memAddr)&0xFF;
+	tData[4] = 0;  // Dummy clock
+	tmpIF->csLOW();
+	tmpIF->spi_write(tData, 5);
+	tmpIF->spi_read(rData, size);
+	tmpIF->csHIGH();
+}
+
+/* SFDP time field : count in bits [4:0], unit in bits [6:5] out of unit_us[] */
+static uint32_t w25qxx_sfdp_time(uint32_t field, const uint32_t *unit_us)
+{
+	return ((field & 0x1F) + 1) * unit_us[(field >> 5) & 0x03];
+}
+
+/*
+ * basic flash parameter table : die density, erase types (dwords 8 / 9) and their times (dwords 10 / 11).
+ * false : no SFDP, the JEDEC / default geometry stays.
+ */
+static bool w25qxx_detect_sfdp(w25qxx_handle_t *me)
+{
+	static const uint32_t erase_unit_us[4] = {1000, 16000, 128000, 1000000};
+	static const uint32_t chip_unit_us[4]  = {16000, 256000, 4000000, 64000000};
+	w25qxx_geometry_t *geo = &me->geometry;
+	uint8_t header[16];
+	uint8_t raw[16*4];
+	uint32_t dword[16];
+	uint32_t dwords;
+	uint32_t i;
+
+	w25qxx_read_sfdp(me, 0, header, sizeof(header));
+	if ((((uint32_t)header[3]<<24)|((uint32_t)header[2]<<16)|((uint32_t)header[1]<<8)|header[0]) != W25Q_SFDP_SIGNATURE)
+	{
+		return false;
+	}
+	/* the first parameter header is the basic table, id 0xFF00 */
+	if ((header[8] != 0x00) || (header[15] != 0xFF) || (header[11] < 9))
+	{
+		return false;
+	}
+	dwords = (header[11] < 16) ? header[11] : 16;
+	w25qxx_read_sfdp(me, ((uint32_t)header[14]<<16)|((uint32_t)header[13]<<8)|header[12], raw, dwords*4);
+	for (i = 0; i < dwords; i++)
+	{
+		dword[i] = ((uint32_t)raw[4*i+3]<<24)|((uint32_t)raw[4*i+2]<<16)|((uint32_t)raw[4*i+1]<<8)|raw[4*i];
+	}
+
+	if (dword[1] & 0x80000000UL)
+	{
+		if ((dword[1] & 0x7FFFFFFFUL) > 34) return false;  // > 2GB
+		geo->die_size = (uint32_t)(1ULL << (dword[1] & 0x7FFFFFFFUL)) / 8;
+	}
+	else
+	{
+		geo->die_size = (dword[1] / 8) + 1;
+	}
+
+	/* erase types, any order : kept by size, a 4KB sector erase is always there */
+	for (i = 1; i < (W25Q_ERASE_TYPES - 1); i++)
+	{
+		geo->erase[i].size = 0;
+	}
+	for (i = 0; i < 4; i++)
+	{
+		uint8_t exponent = dword[7 + i/2] >> (16*(i%2));
+		uint8_t cmd      = dword[7 + i/2] >> (16*(i%2) + 8);
+		uint8_t type;
+
+		for (type = 0; type < (W25Q_ERASE_TYPES - 1); type++)
+		{
+			if ((exponent != 0) && (w25qxx_erase_default[type].size == (1UL << exponent))) break;
+		}
+		if (type == (W25Q_ERASE_TYPES - 1))
+		{
+			continue;
+		}
+		geo->erase[type].size = 1UL << exponent;
+		geo->erase[type].cmd  = cmd;
+		/* typical time per erase type, maximum = 2 * (multiplier + 1) * typical */
+		if ((dwords >= 11) && (dword[9] != 0) && (dword[9] != 0xFFFFFFFFUL))
+		{
+			geo->erase[type].typ_us = w25qxx_sfdp_time(dword[9] >> (4 + 7*i), erase_unit_us);
+			geo->erase[type].max_us = 2 * ((dword[9] & 0x0F) + 1) * geo->erase[type].typ_us;
+		}
+	}
+	if ((dwords >= 11) && (dword[10] != 0) && (dword[10] != 0xFFFFFFFFUL))
+	{
+		geo->erase[W25Q_ERASE_TYPES - 1].typ_us = w25qxx_sfdp_time(dword[10] >> 24, chip_unit_us);
+		/* the multiplier is the erase one of DWORD 10, DWORD 11 bits 3:0 is for page program */
+		geo->erase[W25Q_ERASE_TYPES - 1].max_us = 2 * ((dword[9] & 0x0F) + 1) * geo->erase[W25Q_ERASE_TYPES - 1].typ_us;
+	}
+	return true;
+}
+
+/* every die in 4-byte address mode, again after a reset */
+static void w25qxx_enter_4byte(w25qxx_handle_t *me)
+{
+    w25qxxIF_t *tmpIF = me->meIF;
+    uint8_t tData = W25Q_ENTER_4B_MODE;
+
+	if (me->geometry.address_bytes != 4)
+	{
+		return;
+	}
+	for (uint8_t die = 0; die < me->geometry.dies; die++)
+	{
+		w25qxx_die_address(me, die * me->geometry.die_size);
+		tmpIF->csLOW();
+		tmpIF->spi_write(&tData, 1);
+		tmpIF->csHIGH();
+	}
+}
+
+/* size from the JEDEC capacity byte, then SFDP when the chip has it; the address width and builder follow the die size */
+static void w25qxx_detect(w25qxx_handle_t *me)
+{
+	w25qxx_geometry_t *geo = &me->geometry;
+	uint8_t capacity;
+
+	memcpy(geo->erase, w25qxx_erase_default, sizeof(geo->erase));
+	geo->jedec_id = w25qxx_ReadID(me);
+	geo->dies     = 1;
+	geo->die_size = W25Q_DEFAULT_SIZE;
+	capacity = geo->jedec_id & 0xFF;
+	if ((capacity >= 0x10) && (capacity <= 0x19))
+	{
+		geo->die_size = 1UL << capacity;
+	}
+	else if ((capacity >= 0x20) && (capacity <= 0x22))  // 512Mb and up continue after 0x19
+	{
+		geo->die_size = 1UL << (capacity - 6);
+	}
+	if ((geo->jedec_id != 0xFFFFFF) && (((geo->jedec_id >> 8) & 0xFF) == W25Q_STACKED_DIE_TYPE))
+	{
+		geo->dies = 2;  // W25M : ID and SFDP of one die
+	}
+	me->_die = 0xFF;
+	w25qxx_die_address(me, 0);
+	w25qxx_detect_sfdp(me);
+
+	geo->size = geo->die_size * geo->dies;
+	geo->erase[W25Q_ERASE_TYPES - 1].size = geo->die_size;
+	geo->address_bytes = (geo->die_size > 0x1000000) ? 4 : 3;
+	me->_command = (geo->address_bytes == 4) ? w25qxx_command_4b : w25qxx_command_3b;
+	w25qxx_enter_4byte(me);
+}
+
 static void float2Bytes(uint8_t * ftoa_bytes_temp,float float_variable)
 {
     union {
@@ -228,6 +894,81 @@ void w25qxx_init(w25qxx_handle_t *me, w25qxxIF_t *meIF)
     me->SR1.byte = w25qxx_read_SR1(me);
     me->SR2.byte = w25qxx_read_SR2(me);
     me->SR3.byte = w25qxx_read_SR3(me);
+    me->_job = NULL;
+    me->_cache = NULL;
+    w25qxx_Set_Scratch(me, NULL);
+    me->_read_mode = W25Q_READ_SINGLE;
+    w25qxx_detect(me);
+    if ((meIF->spi_read_multi != NULL) && (meIF->data_lines >= 4) && (true == w25qxx_Set_ReadMode(me, W25Q_READ_QUAD_IO)))
+    {
+        return;
+    }
+    if ((meIF->spi_read_multi != NULL) && (meIF->data_lines >= 2))
+    {
+        w25qxx_Set_ReadMode(me, W25Q_READ_DUAL_OUT);
+    }
+}
+
+/* read mode for w25qxx_FastRead / flash_ReadMemory, false : not supported by the port or QE could not be set */
+bool w25qxx_Set_ReadMode(w25qxx_handle_t *me, w25qxx_read_mode_e mode)
+{
+	if (mode != W25Q_READ_SINGLE)
+	{
+		if ((me->meIF->spi_read_multi == NULL) || (me->meIF->data_lines < w25qxx_read_cmd[mode].data_lines))
+		{
+			return false;
+		}
+		for (uint8_t die = 0; (w25qxx_read_cmd[mode].data_lines == 4) && (die < me->geometry.dies); die++)
+		{
+			w25qxx_die_address(me, die * me->geometry.die_size);
+			if (false == w25qxx_enable_quad(me))
+			{
+				return false;
+			}
+		}
+	}
+	me->_read_mode = mode;
+	return true;
+}
+
+/*
+ * optional read cache of lines pages, for small reads hitting the same pages (settings, lookups).
+ * reads inside one page are served from RAM, bigger ones go to the chip. call after w25qxx_init.
+ */
+void w25qxx_Cache_Init(w25qxx_handle_t *me, w25qxx_cache_t *cache, w25qxx_cache_line_t *line, uint16_t lines)
+{
+	cache->line   = line;
+	cache->lines  = lines;
+	cache->_clock = 0;
+	cache->hits   = 0;
+	cache->misses = 0;
+	for (uint16_t i = 0; i < lines; i++)
+	{
+		line[i].page = W25Q_CACHE_EMPTY;
+		line[i].used = 0;
+	}
+	me->_cache = cache;
+}
+
+/* after the chip was written behind the driver's back */
+void w25qxx_Cache_Invalidate(w25qxx_handle_t *me)
+{
+	w25qxx_cache_invalidate(me, 0, W25Q_CACHE_EMPTY);
+}
+
+/*
+ * 4KB buffer for the sector merge of w25qxx_Write, can be shared by handles that are never written at the same time.
+ * NULL : the handle's own buffer with W25Q_EMBED_SCRATCH, else no merge (see w25qxx_Write).
+ */
+void w25qxx_Set_Scratch(w25qxx_handle_t *me, uint8_t *sector)
+{
+#if (W25Q_EMBED_SCRATCH == 1)
+	if (sector == NULL)
+	{
+		sector = me->_scratch_sector;
+	}
+#endif
+	me->_scratch = sector;
 }
 
 uint32_t w25qxx_ReadID(w25qxx_handle_t *me)
@@ -252,168 +993,106 @@ void w25qxx_Reset(w25qxx_handle_t *me)
 	tmpIF->spi_write(tData, 2);
 	tmpIF->csHIGH();
     tmpIF->delay_ms(100);
+    me->_die = 0xFF;
+    w25qxx_enter_4byte(me);
 }
-void w25qxx_Chip_Erase(w25qxx_handle_t *me)
+bool w25qxx_Chip_Erase(w25qxx_handle_t *me)
 {
+	bool retVal = true;
     w25qxxIF_t *tmpIF = me->meIF;
     uint8_t tData = W25Q_CHIP_ERASE;
 	uint8_t unlock_code = 0x98;
 
-	write_enable(me);
+	w25qxx_cache_invalidate(me, 0, W25Q_CACHE_EMPTY);
 
 //	tmpIF->csLOW();
 //	tmpIF->spi_write(&unlock_code, 1);
 //	tmpIF->csHIGH();
 //	w25qxx_Waitforwrite(me);
 
-	tmpIF->csLOW();
-	tmpIF->spi_write(&tData, 1);
-	tmpIF->csHIGH();
-
-	w25qxx_Waitforwrite(me);
-
-	write_disable(me);
-}
-void w25qxx_Erase_Sector(w25qxx_handle_t *me, uint16_t numsector)
-{
-    w25qxxIF_t *tmpIF = me->meIF;
-    uint8_t tData[6];
-	uint32_t memAddr = numsector*16*256;   // Each sector contains 16 pages * 256 bytes
-
-	write_enable(me);
-
-	if (numBLOCK<512)   // Chip Size<256Mb
+	/* one die at a time */
+	for (uint8_t die = 0; die < me->geometry.dies; die++)
 	{
-		tData[0] = W25Q_SECTOR_ERASE;  // Erase sector
-		tData[1] = (memAddr>>16)&0xFF;  // MSB of the memory Address
-		tData[2] = (memAddr>>8)&0xFF;
-		tData[3] = (memAddr)&0xFF; // LSB of the memory Address
+		w25qxx_die_address(me, die * me->geometry.die_size);
+		write_enable(me);
 
 		tmpIF->csLOW();
-		tmpIF->spi_write(tData, 4);
+		tmpIF->spi_write(&tData, 1);
 		tmpIF->csHIGH();
-	}
-	else  // we use 32bit memory address for chips >= 256Mb
-	{
-		tData[0] = W25Q_SECTOR_ERASE_4B;  // ERASE Sector with 32bit address
-		tData[1] = (memAddr>>24)&0xFF;
-		tData[2] = (memAddr>>16)&0xFF;
-		tData[3] = (memAddr>>8)&0xFF;
-		tData[4] = memAddr&0xFF;
 
-		tmpIF->csLOW();  // pull the CS LOW
-		tmpIF->spi_write(tData, 5);
-		tmpIF->csHIGH();  // pull the HIGH
+		retVal = w25qxx_Waitforwrite(me, W25Q_OP_CHIP_ERASE);
+
+		write_disable(me);
+		if (false == retVal) break;
 	}
+	return retVal;
+}
+bool w25qxx_Erase_Sector(w25qxx_handle_t *me, uint16_t numsector)
+{
+	bool retVal;
+	uint32_t memAddr = numsector*16*256;   // Each sector contains 16 pages * 256 bytes
 
-	w25qxx_Waitforwrite(me);
+	w25qxx_erase_start(me, memAddr, W25Q_OP_SECTOR_ERASE);
+
+	retVal = w25qxx_Waitforwrite(me, W25Q_OP_SECTOR_ERASE);
 
 	write_disable(me);
+	return retVal;
 }
 
 void w25qxx_Read(w25qxx_handle_t *me, uint32_t startPage, uint8_t offset, uint32_t size, uint8_t *rData)
 {
     w25qxxIF_t *tmpIF = me->meIF;
     uint8_t tData[5];
+    uint8_t indx;
 	uint32_t memAddr = (startPage*256) + offset;
+	uint32_t len;
 
-	if (numBLOCK<512)   // Chip Size<256Mb
+	if (true == w25qxx_cache_read(me, memAddr, size, rData))
 	{
-		tData[0] = W25Q_READ_DATA;  // enable Read
-		tData[1] = (memAddr>>16)&0xFF;  // MSB of the memory Address
-		tData[2] = (memAddr>>8)&0xFF;
-		tData[3] = (memAddr)&0xFF; // LSB of the memory Address
-	}
-	else  // we use 32bit memory address for chips >= 256Mb
-	{
-		tData[0] = W25Q_READ_DATA_4B;  // Read Data with 4-Byte Address
-		tData[1] = (memAddr>>24)&0xFF;  // MSB of the memory Address
-		tData[2] = (memAddr>>16)&0xFF;
-		tData[3] = (memAddr>>8)&0xFF;
-		tData[4] = (memAddr)&0xFF; // LSB of the memory Address
+		return;
 	}
 
-	tmpIF->csLOW();  // pull the CS Low
-	if (numBLOCK<512)
-	{
-		tmpIF->spi_write(tData, 4);  // send read instruction along with the 24 bit memory address
-	}
-	else
+	while (size > 0)
 	{
-		tmpIF->spi_write(tData, 5);  // send read instruction along with the 32 bit memory address
-	}
+		len = w25qxx_die_span(me, memAddr, size);
+		indx = me->_command(me, tData, W25Q_READ_DATA, memAddr);
 
-	tmpIF->spi_read(rData, size);  // Read the data
-	tmpIF->csHIGH();  // pull the CS High
+		tmpIF->csLOW();  // pull the CS Low
+		tmpIF->spi_write(tData, indx);  // send read instruction along with the memory address
+		tmpIF->spi_read(rData, len);  // Read the data
+		tmpIF->csHIGH();  // pull the CS High
+
+		memAddr += len;
+		rData   += len;
+		size    -= len;
+	}
 }
 void w25qxx_FastRead(w25qxx_handle_t *me, uint32_t startPage, uint8_t offset, uint32_t size, uint8_t *rData)
 {
-    w25qxxIF_t *tmpIF = me->meIF;
-    uint8_t tData[6];
 	uint32_t memAddr = (startPage*256) + offset;
 
-	if (numBLOCK<512)   // Chip Size<256Mb
-	{
-		tData[0] = W25Q_FAST_READ;  // enable Fast Read
-		tData[1] = (memAddr>>16)&0xFF;  // MSB of the memory Address
-		tData[2] = (memAddr>>8)&0xFF;
-		tData[3] = (memAddr)&0xFF; // LSB of the memory Address
-		tData[4] = 0;  // Dummy clock
-	}
-	else  // we use 32bit memory address for chips >= 256Mb
-	{
-		tData[0] = W25Q_FAST_READ_4B;  // Fast Read with 4-Byte Address
-		tData[1] = (memAddr>>24)&0xFF;  // MSB of the memory Address
-		tData[2] = (memAddr>>16)&0xFF;
-		tData[3] = (memAddr>>8)&0xFF;
-		tData[4] = (memAddr)&0xFF; // LSB of the memory Address
-		tData[5] = 0;  // Dummy clock
-	}
-
-	tmpIF->csLOW();  // pull the CS Low
-	if (numBLOCK<512)
-	{
-		tmpIF->spi_write(tData, 5);  // send read instruction along with the 24 bit memory address
-	}
-	else
+	if (false == w25qxx_cache_read(me, memAddr, size, rData))
 	{
-		tmpIF->spi_write(tData, 6);  // send read instruction along with the 32 bit memory address
+		w25qxx_fast_read(me, memAddr, size, rData);
 	}
-
-	tmpIF->spi_read(rData, size);  // Read the data
-	tmpIF->csHIGH();  // pull the CS High
 }
 uint8_t w25qxx_Read_Byte (w25qxx_handle_t *me, uint32_t Addr)
 {
     w25qxxIF_t *tmpIF = me->meIF;
     uint8_t tData[5];
+    uint8_t indx;
 	uint8_t rData;
 
-	if (numBLOCK<512)   // Chip Size<256Mb
+	if (true == w25qxx_cache_read(me, Addr, 1, &rData))
 	{
-		tData[0] = W25Q_READ_DATA;  // enable Read
-		tData[1] = (Addr>>16)&0xFF;  // MSB of the memory Address
-		tData[2] = (Addr>>8)&0xFF;
-		tData[3] = (Addr)&0xFF; // LSB of the memory Address
-	}
-	else  // we use 32bit memory address for chips >= 256Mb
-	{
-		tData[0] = W25Q_READ_DATA_4B;  // Read Data with 4-Byte Address
-		tData[1] = (Addr>>24)&0xFF;  // MSB of the memory Address
-		tData[2] = (Addr>>16)&0xFF;
-		tData[3] = (Addr>>8)&0xFF;
-		tData[4] = (Addr)&0xFF; // LSB of the memory Address
+		return rData;
 	}
 
+	indx = me->_command(me, tData, W25Q_READ_DATA, Addr);
+
 	tmpIF->csLOW();  // pull the CS Low
-	if (numBLOCK<512)
-	{
-		tmpIF->spi_write(tData, 4);  // send read instruction along with the 24 bit memory address
-	}
-	else
-	{
-		tmpIF->spi_write(tData, 5);  // send read instruction along with the 32 bit memory address
-	}
+	tmpIF->spi_write(tData, indx);  // send read instruction along with the memory address
 
 	tmpIF->spi_read(&rData, 1);  // Read the data
 	tmpIF->csHIGH();  // pull the CS High
@@ -439,7 +1118,7 @@ void w25qxx_Read_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint3
 	}
 }
 
-void w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data)
+bool w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data)
 {
     w25qxxIF_t *tmpIF = me->meIF;
     uint8_t tData[266];
@@ -452,7 +1131,7 @@ void w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uin
 	uint16_t numSectors = endSector-startSector+1;
 	for (uint16_t i=0; i<numSectors; i++)
 	{
-		w25qxx_Erase_Sector(me, startSector++);
+		if (false == w25qxx_Erase_Sector(me, startSector++)) return false;
 	}
 
 	uint32_t dataPosition = 0;
@@ -464,29 +1143,10 @@ void w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uin
 		uint16_t bytesremaining  = bytestowrite(size, offset);
 		uint32_t indx = 0;
 
+		w25qxx_cache_invalidate(me, memAddr, bytesremaining);
+		indx = me->_command(me, tData, W25Q_PAGE_PROGRAM, memAddr);
 		write_enable(me);
 
-		if (numBLOCK<512)   // Chip Size<256Mb
-		{
-			tData[0] = W25Q_PAGE_PROGRAM;  // page program
-			tData[1] = (memAddr>>16)&0xFF;  // MSB of the memory Address
-			tData[2] = (memAddr>>8)&0xFF;
-			tData[3] = (memAddr)&0xFF; // LSB of the memory Address
-
-			indx = 4;
-		}
-
-		else // we use 32bit memory address for chips >= 256Mb
-		{
-			tData[0] = W25Q_PAGE_PROGRAM_4B;  // page program with 4-Byte Address
-			tData[1] = (memAddr>>24)&0xFF;  // MSB of the memory Address
-			tData[2] = (memAddr>>16)&0xFF;
-			tData[3] = (memAddr>>8)&0xFF;
-			tData[4] = (memAddr)&0xFF; // LSB of the memory Address
-
-			indx = 5;
-		}
-
 		uint16_t bytestosend  = bytesremaining + indx;
 
 		for (uint16_t i=0; i<bytesremaining; i++)
@@ -516,14 +1176,23 @@ void w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uin
 		size = size-bytesremaining;
 		dataPosition = dataPosition+bytesremaining;
 
-		w25qxx_Waitforwrite(me);
+		if (false == w25qxx_Waitforwrite(me, W25Q_OP_PAGE_PROGRAM))
+		{
+			write_disable(me);
+			return false;
+		}
 		write_disable(me);
 
 	}
+	return true;
 }
-void w25qxx_Write (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data)
+/*
+ * smart write : the touched range is read back a page at a time.
+ * bits that only go 1 -> 0 are programmed in place, changed bytes only;
+ * the sector is erased and merged only when a bit has to go back to 1, through the scratch buffer (see w25qxx.h).
+ */
+bool w25qxx_Write (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data)
 {
-    w25qxxIF_t *tmpIF = me->meIF;
     uint16_t startSector  = page/16;
 	uint16_t endSector  = (page + ((size+offset-1)/256))/16;
 	uint16_t numSectors = endSector-startSector+1;
@@ -531,69 +1200,82 @@ void w25qxx_Write (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t
 	uint32_t sectorOffset = ((page%16)*256)+offset;
 	uint32_t dataindx = 0;
 
-	for (uint16_t i=0; i<numSectors; i++)
+	/* no merge possible : refuse before the first page is touched */
+	if ((me->_scratch == NULL) && (false == w25qxx_range_programmable(me, (page*256)+offset, data, size)))
 	{
-		uint32_t startPage = startSector*16;
-		w25qxx_FastRead(me, startPage, 0, 4096, me->tempData);
+		if (me->meIF->debug_print != NULL)
+		{
+			me->meIF->debug_print("w25qxx_Write : range needs an erase, no scratch sector (w25qxx_Set_Scratch)\r\n");
+		}
+		return false;
+	}
 
+	for (uint16_t i=0; i<numSectors; i++)
+	{
+		uint32_t sectorAddr = startSector*4096;
 		uint16_t bytesRemaining = bytestomodify(size, sectorOffset);
-		for (uint16_t i=0; i<bytesRemaining; i++)
+		uint16_t done = 0;
+
+		/* page by page in place while the bits only go 1 -> 0 */
+		while (done < bytesRemaining)
 		{
-			me->tempData[i+sectorOffset] = data[i+dataindx];
+			uint8_t old[256];
+			uint32_t memAddr = sectorAddr+sectorOffset+done;
+			uint16_t chunk = bytestowrite(bytesRemaining-done, memAddr%256);
+
+			w25qxx_FastRead(me, memAddr/256, memAddr%256, chunk, old);
+			if (!w25qxx_is_programmable(old, &data[dataindx+done], chunk))
+			{
+				break;
+			}
+			if (false == w25qxx_program_changed(me, memAddr, old, &data[dataindx+done], chunk)) return false;
+			done += chunk;
 		}
 
-		w25qxx_Write_Clean(me, startPage, 0, 4096, me->tempData);
+		/* a bit has to go back to 1 : the rest of the range goes through an erase */
+		if ((done < bytesRemaining) && (false == w25qxx_merge_sector(me, sectorAddr, sectorOffset+done, &data[dataindx+done], bytesRemaining-done)))
+		{
+			return false;
+		}
 
 		startSector++;
 		sectorOffset = 0;
 		dataindx = dataindx+bytesRemaining;
 		size = size-bytesRemaining;
 	}
+	return true;
 }
-void w25qxx_Write_Byte (w25qxx_handle_t *me, uint32_t Addr, uint8_t data)
+/* false : timeout, or the byte is not erased */
+bool w25qxx_Write_Byte (w25qxx_handle_t *me, uint32_t Addr, uint8_t data)
 {
     w25qxxIF_t *tmpIF = me->meIF;
 	uint8_t tData[6];
 	uint8_t indx;
+	bool retVal = false;
 
-	if (numBLOCK<512)   // Chip Size<256Mb
-	{
-		tData[0] = W25Q_PAGE_PROGRAM;  // page program
-		tData[1] = (Addr>>16)&0xFF;  // MSB of the memory Address
-		tData[2] = (Addr>>8)&0xFF;
-		tData[3] = (Addr)&0xFF; // LSB of the memory Address
-		tData[4] = data;
-		indx = 5;
-	}
-	else  // we use 32bit memory address for chips >= 256Mb
-	{
-		tData[0] = W25Q_PAGE_PROGRAM_4B;  // Write Data with 4-Byte Address
-		tData[1] = (Addr>>24)&0xFF;  // MSB of the memory Address
-		tData[2] = (Addr>>16)&0xFF;
-		tData[3] = (Addr>>8)&0xFF;
-		tData[4] = (Addr)&0xFF; // LSB of the memory Address
-		tData[5] = data;
-		indx = 6;
-	}
+	indx = me->_command(me, tData, W25Q_PAGE_PROGRAM, Addr);
+	tData[indx++] = data;
 
 
 	if (w25qxx_Read_Byte(me, Addr) == 0xFF)
 	{
+		w25qxx_cache_invalidate(me, Addr, 1);
 		write_enable(me);
 		tmpIF->csLOW();
 		tmpIF->spi_write(tData, indx);
 		tmpIF->csHIGH();
 
-		w25qxx_Waitforwrite(me);
+		retVal = w25qxx_Waitforwrite(me, W25Q_OP_PAGE_PROGRAM);
 		write_disable(me);
 	}
+	return retVal;
 }
-void w25qxx_Write_NUM (w25qxx_handle_t *me, uint32_t page, uint16_t offset, float data)
+bool w25qxx_Write_NUM (w25qxx_handle_t *me, uint32_t page, uint16_t offset, float data)
 {
     float2Bytes(me->tempBytes, data);
-    w25qxx_Write(me, page, offset, 4, me->tempBytes);
+    return w25qxx_Write(me, page, offset, 4, me->tempBytes);
 }
-void w25qxx_Write_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint32_t *data)
+bool w25qxx_Write_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint32_t *data)
 {
     uint8_t data8[size*4];
 	uint32_t indx = 0;
@@ -606,7 +1288,7 @@ void w25qxx_Write_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint
 		data8[indx++] = (data[i]>>24)&0xFF;
 	}
 
-	w25qxx_Write(me, page, offset, indx, data8);
+	return w25qxx_Write(me, page, offset, indx, data8);
 }
 
 void w25qxx_PowerDown(w25qxx_handle_t *me) {
@@ -626,83 +1308,174 @@ void w25qxx_ReleasePowerDown(w25qxx_handle_t *me) {
 	tmpIF->delay_us(3); // as datasheet
 }
 
-void flash_WriteMemory(w25qxx_handle_t *me, uint32_t address, uint8_t* buffer, uint32_t buffer_size)
+/*
+ * non-blocking program / erase : the call only starts the job, w25qxx_poll() drives it.
+ * one job at a time per chip, no blocking call may be made on the chip until it is done.
+ * false, nothing started, while the chip is busy : after W25Q_JOB_ERROR retry once SR1 BUSY clears.
+ * job and data are the caller's and must stay valid until then.
+ */
+bool w25qxx_Program_Start(w25qxx_handle_t *me, w25qxx_job_t *job, uint32_t address, uint8_t *data, uint32_t size, void (*done)(w25qxx_job_t *job))
 {
-    w25qxxIF_t *tmpIF = me->meIF;
-    uint32_t page = address/256;
-	uint16_t offset = address%256;
-	uint32_t size = buffer_size;
-	uint8_t tData[266];
-	uint32_t startPage = page;
-	uint32_t endPage  = startPage + ((size+offset-1)/256);
-	uint32_t numPages = endPage-startPage+1;
-
-	uint32_t dataPosition = 0;
+	if (me->_job != NULL)
+	{
+		return false;
+	}
+	job->type    = W25Q_JOB_PROGRAM;
+	job->address = address;
+	job->data    = data;
+	job->size    = size;
+	job->done    = done;
+	return w25qxx_job_start(me, job);
+}
 
-	// write the data
-	for (uint32_t i=0; i<numPages; i++)
+bool w25qxx_Erase_Start(w25qxx_handle_t *me, w25qxx_job_t *job, uint16_t startSector, uint16_t numSectors, void (*done)(w25qxx_job_t *job))
+{
+	if (me->_job != NULL)
 	{
-		uint32_t memAddr = (startPage*256)+offset;
-		uint16_t bytesremaining  = bytestowrite(size, offset);
-		uint32_t indx = 0;
+		return false;
+	}
+	job->type    = W25Q_JOB_ERASE;
+	job->address = startSector*W25Q_SECTOR_SIZE;
+	job->data    = NULL;
+	job->size    = numSectors;
+	job->done    = done;
+	return w25qxx_job_start(me, job);
+}
 
-		write_enable(me);
+bool w25qxx_Chip_Erase_Start(w25qxx_handle_t *me, w25qxx_job_t *job, void (*done)(w25qxx_job_t *job))
+{
+	if (me->_job != NULL)
+	{
+		return false;
+	}
+	job->type    = W25Q_JOB_CHIP_ERASE;
+	job->address = 0;
+	job->data    = NULL;
+	job->size    = me->geometry.dies;
+	job->done    = done;
+	return w25qxx_job_start(me, job);
+}
 
-		if (numBLOCK<512)   // Chip Size<256Mb
+/*
+ * call from the main loop or a timer : one SR1 read while the chip is busy, the next command once it is not.
+ * a step still busy past its maximum time (me->geometry for erases) ends the job with W25Q_JOB_ERROR;
+ * without meIF->get_us each call counts W25Q_POLL_MIN_US, so poll no faster than that.
+ */
+w25qxx_job_status_e w25qxx_poll(w25qxx_handle_t *me)
+{
+	w25qxx_job_t *job = me->_job;
+	if (job == NULL)
+	{
+		return W25Q_JOB_IDLE;
+	}
+	me->SR1.byte = w25qxx_read_SR1(me);
+	if (me->SR1.bits.BUSY)
+	{
+		if (w25qxx_job_elapsed(me, job) > job->_step_max_us)
 		{
-			tData[0] = W25Q_PAGE_PROGRAM;  // page program
-			tData[1] = (memAddr>>16)&0xFF;  // MSB of the memory Address
-			tData[2] = (memAddr>>8)&0xFF;
-			tData[3] = (memAddr)&0xFF; // LSB of the memory Address
-
-			indx = 4;
+			return w25qxx_job_finish(me, job, W25Q_JOB_ERROR);
 		}
+		return W25Q_JOB_BUSY;
+	}
+	if (job->size > 0)
+	{
+		w25qxx_job_step(me, job);
+		return W25Q_JOB_BUSY;
+	}
+	return w25qxx_job_finish(me, job, W25Q_JOB_DONE);
+}
 
-		else // we use 32bit memory address for chips >= 256Mb
-		{
-			tData[0] = W25Q_PAGE_PROGRAM_4B;  // page program with 4-Byte Address
-			tData[1] = (memAddr>>24)&0xFF;  // MSB of the memory Address
-			tData[2] = (memAddr>>16)&0xFF;
-			tData[3] = (memAddr>>8)&0xFF;
-			tData[4] = (memAddr)&0xFF; // LSB of the memory Address
-
-			indx = 5;
-		}
+bool w25qxx_is_busy(w25qxx_handle_t *me)
+{
+	return (me->_job != NULL);
+}
 
-		uint16_t bytestosend  = bytesremaining + indx;
+/* no erase : the range must already be erased, each page is programmed straight from buffer */
+bool flash_WriteMemory(w25qxx_handle_t *me, uint32_t address, uint8_t* buffer, uint32_t buffer_size)
+{
+	uint32_t dataPosition = 0;
 
-		for (uint16_t i=0; i<bytesremaining; i++)
+	while (dataPosition < buffer_size)
+	{
+		uint32_t bytesremaining = bytestowrite(buffer_size-dataPosition, (address+dataPosition)%256);
+		if (false == w25qxx_page_program(me, address+dataPosition, &buffer[dataPosition], bytesremaining))
 		{
-			tData[indx++] = buffer[i+dataPosition];
+			return false;
 		}
+		dataPosition = dataPosition+bytesremaining;
+	}
+	return true;
+}
 
-		if (bytestosend > 250)
-		{
-			tmpIF->csLOW();
-			tmpIF->spi_write(tData, 100);
-			tmpIF->spi_write(tData+100, bytestosend-100);
-			tmpIF->csHIGH();
+/*
+ * streaming writer over [address, end) : appends of any size, whole pages go out straight from the caller's data,
+ * only a tail shorter than a page is held until it fills or w25qxx_Writer_Flush.
+ * sectors are erased as the write pointer enters them; from address to the end of its sector must already be erased.
+ */
+void w25qxx_Writer_Init(w25qxx_writer_t *me, w25qxx_handle_t *flash, uint32_t address, uint32_t end)
+{
+	me->flash   = flash;
+	me->address = address;
+	me->end     = end;
+	me->erased  = (address + W25Q_SECTOR_SIZE - 1) & ~(uint32_t)(W25Q_SECTOR_SIZE - 1);
+	me->fill    = 0;
+}
 
+bool w25qxx_Writer_Append(w25qxx_writer_t *me, uint8_t *data, uint32_t len)
+{
+	if ((me->address + me->fill + len) > me->end)
+	{
+		return false;
+	}
+	while (len > 0)
+	{
+		uint32_t room = W25Q_PAGE_SIZE - ((me->address + me->fill) % W25Q_PAGE_SIZE);
+		if ((me->fill == 0) && (len >= room))
+		{
+			/* up to the page end straight from data */
+			if (false == w25qxx_writer_program(me, data, room)) return false;
+			data += room;
+			len  -= room;
 		}
-
 		else
 		{
-			tmpIF->csLOW();
-			tmpIF->spi_write(tData, bytestosend);
-			tmpIF->csHIGH();
+			uint32_t n = (len < room) ? len : room;
+			memcpy(&me->page[me->fill], data, n);
+			me->fill += n;
+			data += n;
+			len  -= n;
+			if (n == room)
+			{
+				if (false == w25qxx_Writer_Flush(me)) return false;
+			}
 		}
+	}
+	return true;
+}
 
-
-		startPage++;
-		offset = 0;
-		size = size-bytesremaining;
-		dataPosition = dataPosition+bytesremaining;
-
-		w25qxx_Waitforwrite(me);
-		write_disable(me);
-
+/* program the held tail, later appends continue on the same page */
+bool w25qxx_Writer_Flush(w25qxx_writer_t *me)
+{
+	if (me->fill > 0)
+	{
+		if (false == w25qxx_writer_program(me, me->page, me->fill)) return false;
+		me->fill = 0;
 	}
+	return true;
+}
 
+/* CRC16-CCITT (0x1021, start 0xFFFF) over the records and snapshots kept by the layers above */
+uint16_t w25qxx_crc16(uint16_t crc, const uint8_t *pdata, uint32_t len)
+{
+	while (len--)
+	{
+		crc ^= (uint16_t)(*pdata++) << 8;
+		for (uint8_t i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
 }
 
 void flash_ReadMemory (w25qxx_handle_t *me, uint32_t Addr, uint8_t* buffer, uint32_t Size)
@@ -713,20 +1486,49 @@ void flash_ReadMemory (w25qxx_handle_t *me, uint32_t Addr, uint8_t* buffer, uint
 	w25qxx_FastRead(me, page, offset, Size, buffer);
 }
 
-void flash_SectorErase(w25qxx_handle_t *me, uint32_t EraseStartAddress, uint32_t EraseEndAddress)
+/*
+ * every sector touched by [EraseStartAddress, EraseEndAddress] with the fewest commands :
+ * 4KB sectors at the unaligned edges, 64KB / 32KB blocks in between.
+ * progress : optional, called after each command with the bytes erased so far out of total.
+ */
+bool flash_EraseRange(w25qxx_handle_t *me, uint32_t EraseStartAddress, uint32_t EraseEndAddress, void *ctx, void (*progress)(void *ctx, uint32_t erased, uint32_t total))
 {
-    uint16_t startSector  = EraseStartAddress/4096;
-	uint16_t endSector  = EraseEndAddress/4096;
-	uint16_t numSectors = endSector-startSector+1;
-	for (uint16_t i=0; i<numSectors; i++)
+	uint32_t address = EraseStartAddress - (EraseStartAddress % W25Q_SECTOR_SIZE);
+	uint32_t total;
+	uint32_t erased = 0;
+	bool retVal;
+
+	if (EraseEndAddress < EraseStartAddress)
 	{
-		w25qxx_Erase_Sector(me, startSector++);
+		return false;
 	}
+	total = (W25Q_SECTOR_INDEX(EraseEndAddress) + 1)*W25Q_SECTOR_SIZE - address;
+	while (erased < total)
+	{
+		uint8_t op = w25qxx_erase_op(me, address + erased, total - erased);
+
+		w25qxx_erase_start(me, address + erased, op);
+		retVal = w25qxx_Waitforwrite(me, op);
+		write_disable(me);
+		if (false == retVal) return false;
+
+		erased += me->geometry.erase[op - W25Q_OP_SECTOR_ERASE].size;
+		if (progress != NULL)
+		{
+			progress(ctx, erased, total);
+		}
+	}
+	return true;
+}
+
+bool flash_SectorErase(w25qxx_handle_t *me, uint32_t EraseStartAddress, uint32_t EraseEndAddress)
+{
+	return flash_EraseRange(me, EraseStartAddress, EraseEndAddress, NULL, NULL);
 }
 
-void flash_ChipErase (w25qxx_handle_t *me)
+bool flash_ChipErase (w25qxx_handle_t *me)
 {
-    w25qxx_Chip_Erase(me);
+    return w25qxx_Chip_Erase(me);
 }
 
 void flash_Reset (w25qxx_handle_t *me)
@@ -8,6 +8,7 @@
 * 3) internal and external interfaces from this unit
 ==================================================================================================*/
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -19,8 +20,10 @@ extern "C"{
                                        DEFINES AND MACROS
 ==================================================================================================*/
 #define W25Q_BLOCK_SIZE          0x10000   /* blocks of 64KBytes */
+#define W25Q_BLOCK32_SIZE        0x8000    /* half blocks of 32KBytes */
 #define W25Q_SECTOR_SIZE         0x1000    /* 4kBytes */
 #define W25Q_PAGE_SIZE           0x100     /* 256 bytes */
+#define W25Q_CACHE_EMPTY         0xFFFFFFFF
 #define W25Q_FIRST_PAGE_ADDR     0x000000
 
 #define W25Q_PAGE_ADDRESS(page_index)  (W25Q_PAGE_SIZE * (page_index))
@@ -30,7 +33,15 @@ extern "C"{
 #define W25Q_BLOCK_INDEX(address)     ((address) / W25Q_BLOCK_SIZE)
 #define W25Q_PAGE_INDEX(address)      ((address) / W25Q_PAGE_SIZE)
 
+#define W25Q_ERASE_TYPES         4         /* 4KB sector, 32KB block, 64KB block, whole die */
+
+/* 1 : the handle holds its own 4KB sector merge buffer (see w25qxx_Write), 0 : one is given with w25qxx_Set_Scratch */
+#ifndef W25Q_EMBED_SCRATCH
+#define W25Q_EMBED_SCRATCH       0
+#endif
+
 /***************************** W25Q16 ***************************************/
+/* fixed map of the W25Q16 for applications, the driver itself goes by me->geometry */
 #define W25Q16_FLASH_SIZE        0x200000  /* 16Mbit =>2Mbyte */
 #define W25Q16_TOTAL_PAGES       8192
 #define W25Q16_MEMORY_SIZE       (W25Q16_TOTAL_PAGES * W25Q_PAGE_SIZE)      // Dung lượng bộ nhớ của W25Q16 (2 MB = 16 Mbit) 2MB = 2 * 1024 * 1024 bytes
@@ -57,6 +68,25 @@ extern "C"{
 /*==================================================================================================
 *                                              ENUMS
 ==================================================================================================*/
+typedef enum{
+	W25Q_JOB_IDLE,
+	W25Q_JOB_BUSY,
+	W25Q_JOB_DONE,
+	W25Q_JOB_ERROR,				// chip still busy past the maximum time of a step, job dropped, *_Start refuse until it is not
+}w25qxx_job_status_e;
+
+typedef enum{
+	W25Q_JOB_PROGRAM,
+	W25Q_JOB_ERASE,
+	W25Q_JOB_CHIP_ERASE,
+}w25qxx_job_type_e;
+
+typedef enum{
+	W25Q_READ_SINGLE,			// 0x0B fast read through spi_read
+	W25Q_READ_DUAL_OUT,			// 0x3B, data on 2 lines
+	W25Q_READ_QUAD_OUT,			// 0x6B, data on 4 lines, needs QE
+	W25Q_READ_QUAD_IO,			// 0xEB, address and data on 4 lines, needs QE
+}w25qxx_read_mode_e;
 
 /*==================================================================================================
 *                                  STRUCTURES AND OTHER TYPEDEFS
@@ -103,6 +133,18 @@ typedef union {
     } bits;
 }w25qxx_SR3_u;
 
+/* one multi-line read : instruction on 1 line, address and alternate on address_lines, dummy clocks, data on data_lines */
+typedef struct{
+	uint8_t		instruction;
+	uint8_t		address_lines;
+	uint8_t		address_bytes;						// 3 / 4
+	uint32_t	address;
+	uint8_t		alternate_bytes;					// 0 / 1 (mode byte of quad I/O)
+	uint8_t		alternate;
+	uint8_t		dummy_cycles;
+	uint8_t		data_lines;							// 2 / 4
+}w25qxx_multi_cmd_t;
+
 typedef struct{
 	void (*csHIGH)(void);
 	void (*csLOW)(void);
@@ -111,16 +153,84 @@ typedef struct{
 	void (*delay_us)(uint32_t us);
 	void (*delay_ms)(uint32_t ms);                                                                  /**< point to a delay_ms function address */
 	void (*debug_print)(const char *const fmt, ...);                                                /**< point to a debug_print function address */
+	void (*spi_read_multi)(const w25qxx_multi_cmd_t *cmd, uint8_t *pdata, uint32_t len);            /**< optional (NULL : single line) : whole read, cs included */
+	uint8_t data_lines;                                                                             /**< with spi_read_multi : 2 dual, 4 quad (IO2/IO3 wired) */
+	uint32_t (*get_us)(void);                                                                       /**< optional (NULL : each w25qxx_poll counts W25Q_POLL_MIN_US) : free running us, job timeout */
 }w25qxxIF_t;
 
+typedef struct w25qxx_job w25qxx_job_t;
+struct w25qxx_job{
+	uint8_t				type;								// w25qxx_job_type_e
+	volatile uint8_t	status;								// w25qxx_job_status_e
+	uint32_t			address;							// next byte to program / sector / die to erase
+	uint8_t				*data;
+	uint32_t			size;								// bytes / sectors / dies left to start
+	void				(*done)(w25qxx_job_t *job);			// optional, called from w25qxx_poll
+	void				*ctx;								// free for the caller
+	uint32_t			_step_start;						// get_us when the running step was started
+	uint32_t			_step_elapsed;						// us counted by w25qxx_poll without get_us
+	uint32_t			_step_max_us;						// busy maximum of the running step
+};
+
+typedef struct{
+	uint32_t		page;									// page index, W25Q_CACHE_EMPTY : free line
+	uint32_t		used;									// last access, least recent refilled first
+	uint8_t			data[W25Q_PAGE_SIZE];
+}w25qxx_cache_line_t;
+
 typedef struct{
+	w25qxx_cache_line_t	*line;
+	uint16_t		lines;
+	uint32_t		_clock;
+	uint32_t		hits;
+	uint32_t		misses;
+}w25qxx_cache_t;
+
+/* one erase command, timings in us from SFDP or the W25Q16JV datasheet */
+typedef struct{
+	uint32_t		size;									// bytes, 0 : not supported
+	uint8_t			cmd;
+	uint32_t		typ_us;
+	uint32_t		max_us;
+}w25qxx_erase_type_t;
+
+/* read from the chip by w25qxx_init : JEDEC ID, then SFDP when the chip has it */
+typedef struct{
+	uint32_t		jedec_id;
+	uint32_t		size;									// bytes, all dies
+	uint32_t		die_size;
+	uint8_t			dies;									// > 1 : stacked dies (W25M), switched with 0xC2
+	uint8_t			address_bytes;							// 4 : 4-byte address mode entered at init
+	w25qxx_erase_type_t	erase[W25Q_ERASE_TYPES];
+}w25qxx_geometry_t;
+
+typedef struct w25qxx_handle w25qxx_handle_t;
+struct w25qxx_handle{
 	w25qxxIF_t   *meIF;
 	w25qxx_SR1_u  SR1;
 	w25qxx_SR2_u  SR2;
 	w25qxx_SR3_u  SR3;
 	uint8_t       tempBytes[4];
-    uint8_t       tempData[4096];
-}w25qxx_handle_t;
+    uint8_t       *_scratch;                              // sector merge buffer, NULL : w25qxx_Write can't merge
+    w25qxx_job_t  *_job;                                  // running non-blocking job, NULL when idle
+    uint8_t       _read_mode;                             // w25qxx_read_mode_e
+    w25qxx_cache_t *_cache;                               // NULL : no read cache
+    w25qxx_geometry_t geometry;
+    uint8_t       _die;                                   // selected die, 0xFF : unknown
+    uint8_t       (*_command)(w25qxx_handle_t *me, uint8_t *tData, uint8_t cmd, uint32_t memAddr);  // opcode + address, picked at init
+#if (W25Q_EMBED_SCRATCH == 1)
+    uint8_t       _scratch_sector[W25Q_SECTOR_SIZE];
+#endif
+};
+
+typedef struct{
+	w25qxx_handle_t	*flash;
+	uint32_t		address;								// next byte programmed
+	uint32_t		end;									// end of the area, excluded
+	uint32_t		erased;									// first sector not erased yet
+	uint16_t		fill;									// tail held in page
+	uint8_t			page[W25Q_PAGE_SIZE];
+}w25qxx_writer_t;
 /*==================================================================================================
 *                                  GLOBAL VARIABLE DECLARATIONS
 ==================================================================================================*/
@@ -129,11 +239,15 @@ typedef struct{
 *                                       FUNCTION PROTOTYPES
 ==================================================================================================*/
 void w25qxx_init(w25qxx_handle_t *me, w25qxxIF_t *meIF);
+bool w25qxx_Set_ReadMode(w25qxx_handle_t *me, w25qxx_read_mode_e mode);
+void w25qxx_Cache_Init(w25qxx_handle_t *me, w25qxx_cache_t *cache, w25qxx_cache_line_t *line, uint16_t lines);
+void w25qxx_Cache_Invalidate(w25qxx_handle_t *me);
+void w25qxx_Set_Scratch(w25qxx_handle_t *me, uint8_t *sector);
 uint32_t w25qxx_ReadID(w25qxx_handle_t *me);
 
 void w25qxx_Reset(w25qxx_handle_t *me);
-void w25qxx_Erase_Sector (w25qxx_handle_t *me, uint16_t numsector);
-void w25qxx_Chip_Erase(w25qxx_handle_t *me);
+bool w25qxx_Erase_Sector (w25qxx_handle_t *me, uint16_t numsector);
+bool w25qxx_Chip_Erase(w25qxx_handle_t *me);
 
 void w25qxx_Read(w25qxx_handle_t *me, uint32_t startPage, uint8_t offset, uint32_t size, uint8_t *rData);
 void w25qxx_FastRead(w25qxx_handle_t *me, uint32_t startPage, uint8_t offset, uint32_t size, uint8_t *rData);
@@ -141,19 +255,36 @@ uint8_t w25qxx_Read_Byte (w25qxx_handle_t *me, uint32_t Addr);
 float w25qxx_Read_NUM (w25qxx_handle_t *me, uint32_t page, uint16_t offset);
 void w25qxx_Read_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint32_t *data);
 
-void w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data);
-void w25qxx_Write (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data);
-void w25qxx_Write_Byte (w25qxx_handle_t *me, uint32_t Addr, uint8_t data);
-void w25qxx_Write_NUM (w25qxx_handle_t *me, uint32_t page, uint16_t offset, float data);
-void w25qxx_Write_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint32_t *data);
+bool w25qxx_Write_Clean(w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data);
+/*
+ * a range whose bits have to go back to 1 is merged through a 4KB buffer : w25qxx_Set_Scratch first,
+ * or build with W25Q_EMBED_SCRATCH = 1. without one such a write returns false before anything is programmed
+ * (the whole range is read back first) and says so through debug_print. writes to erased flash (1 -> 0 only) never need it.
+ */
+bool w25qxx_Write (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint8_t *data);
+bool w25qxx_Write_Byte (w25qxx_handle_t *me, uint32_t Addr, uint8_t data);
+bool w25qxx_Write_NUM (w25qxx_handle_t *me, uint32_t page, uint16_t offset, float data);
+bool w25qxx_Write_32B (w25qxx_handle_t *me, uint32_t page, uint16_t offset, uint32_t size, uint32_t *data);
 
 void w25qxx_PowerDown(w25qxx_handle_t *me);
 void w25qxx_ReleasePowerDown(w25qxx_handle_t *me);
 
-void flash_WriteMemory(w25qxx_handle_t *me, uint32_t address, uint8_t* buffer, uint32_t buffer_size);
+bool w25qxx_Program_Start(w25qxx_handle_t *me, w25qxx_job_t *job, uint32_t address, uint8_t *data, uint32_t size, void (*done)(w25qxx_job_t *job));
+bool w25qxx_Erase_Start(w25qxx_handle_t *me, w25qxx_job_t *job, uint16_t startSector, uint16_t numSectors, void (*done)(w25qxx_job_t *job));
+bool w25qxx_Chip_Erase_Start(w25qxx_handle_t *me, w25qxx_job_t *job, void (*done)(w25qxx_job_t *job));
+w25qxx_job_status_e w25qxx_poll(w25qxx_handle_t *me);
+bool w25qxx_is_busy(w25qxx_handle_t *me);
+
+void w25qxx_Writer_Init(w25qxx_writer_t *me, w25qxx_handle_t *flash, uint32_t address, uint32_t end);
+bool w25qxx_Writer_Append(w25qxx_writer_t *me, uint8_t *data, uint32_t len);
+bool w25qxx_Writer_Flush(w25qxx_writer_t *me);
+uint16_t w25qxx_crc16(uint16_t crc, const uint8_t *pdata, uint32_t len);
+
+bool flash_WriteMemory(w25qxx_handle_t *me, uint32_t address, uint8_t* buffer, uint32_t buffer_size);
 void flash_ReadMemory (w25qxx_handle_t *me, uint32_t Addr, uint8_t* buffer, uint32_t Size);
-void flash_SectorErase(w25qxx_handle_t *me, uint32_t EraseStartAddress, uint32_t EraseEndAddress);
-void flash_ChipErase (w25qxx_handle_t *me);
+bool flash_SectorErase(w25qxx_handle_t *me, uint32_t EraseStartAddress, uint32_t EraseEndAddress);
+bool flash_EraseRange(w25qxx_handle_t *me, uint32_t EraseStartAddress, uint32_t EraseEndAddress, void *ctx, void (*progress)(void *ctx, uint32_t erased, uint32_t total));
+bool flash_ChipErase (w25qxx_handle_t *me);
 void flash_Reset (w25qxx_handle_t *me);
 
 #endif /* USER_DRIVERS_W25QXX_H_ */
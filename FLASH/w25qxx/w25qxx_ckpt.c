@@ -0,0 +1,132 @@
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <string.h>
+
+#include "w25qxx_ckpt.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define W25Q_CKPT_MAGIC						0x504B4357UL	// "WCKP"
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static uint32_t w25qxx_ckpt_base(w25qxx_ckpt_t *me, uint8_t copy)
+{
+	return (uint32_t)(me->start_sector + copy * me->copy_sectors) * W25Q_SECTOR_SIZE;
+}
+
+/* generation of a copy whose header and data check, 0 otherwise */
+static uint32_t w25qxx_ckpt_check(w25qxx_ckpt_t *me, uint8_t copy, uint32_t *size)
+{
+	uint32_t header[4];
+	uint8_t buf[W25Q_PAGE_SIZE];
+	uint32_t address = w25qxx_ckpt_base(me, copy) + W25Q_CKPT_HEADER_SIZE;
+	uint32_t left;
+	uint16_t crc = 0xFFFF;
+
+	flash_ReadMemory(me->flash, w25qxx_ckpt_base(me, copy), (uint8_t*)header, sizeof(header));
+	if ((header[0] != W25Q_CKPT_MAGIC) || (header[1] == 0) ||
+		(header[2] > ((uint32_t)me->copy_sectors * W25Q_SECTOR_SIZE - W25Q_CKPT_HEADER_SIZE)))
+	{
+		return 0;
+	}
+	for (left = header[2]; left > 0; )
+	{
+		uint32_t n = (left < sizeof(buf)) ? left : sizeof(buf);
+		flash_ReadMemory(me->flash, address, buf, n);
+		crc = w25qxx_crc16(crc, buf, n);
+		address += n;
+		left    -= n;
+	}
+	if (crc != (uint16_t)header[3])
+	{
+		return 0;
+	}
+	*size = header[2];
+	return header[1];
+}
+
+/*==================================================================================================
+*                                        GLOBAL FUNCTIONS
+==================================================================================================*/
+void w25qxx_ckpt_init(w25qxx_ckpt_t *me, w25qxx_handle_t *flash, uint16_t start_sector, uint16_t copy_sectors)
+{
+	me->flash        = flash;
+	me->start_sector = start_sector;
+	me->copy_sectors = copy_sectors;
+	me->generation   = 0;
+	me->size         = 0;
+	me->_copy        = 1;
+}
+
+/* newest good copy, false : none (generation stays 0) */
+bool w25qxx_ckpt_open(w25qxx_ckpt_t *me)
+{
+	uint32_t size[2] = {0, 0};
+	uint32_t gen[2];
+
+	gen[0] = w25qxx_ckpt_check(me, 0, &size[0]);
+	gen[1] = w25qxx_ckpt_check(me, 1, &size[1]);
+	me->_copy      = (gen[1] > gen[0]) ? 1 : 0;
+	me->generation = gen[me->_copy];
+	me->size       = size[me->_copy];
+	return (me->generation != 0);
+}
+
+bool w25qxx_ckpt_read(w25qxx_ckpt_t *me, uint32_t offset, void *data, uint32_t len)
+{
+	if ((me->generation == 0) || ((offset + len) > me->size))
+	{
+		return false;
+	}
+	flash_ReadMemory(me->flash, w25qxx_ckpt_base(me, me->_copy) + W25Q_CKPT_HEADER_SIZE + offset, (uint8_t*)data, len);
+	return true;
+}
+
+/* start a snapshot in the other copy, data streamed with w25qxx_ckpt_append */
+bool w25qxx_ckpt_begin(w25qxx_ckpt_t *me)
+{
+	uint32_t base;
+
+	/* the generation has to follow the newest one on flash */
+	if (me->generation == 0)
+	{
+		w25qxx_ckpt_open(me);
+	}
+	base = w25qxx_ckpt_base(me, me->_copy ^ 1);
+	if (false == w25qxx_Erase_Sector(me->flash, me->start_sector + (me->_copy ^ 1) * me->copy_sectors)) return false;
+	w25qxx_Writer_Init(&me->_writer, me->flash, base + W25Q_CKPT_HEADER_SIZE, base + (uint32_t)me->copy_sectors * W25Q_SECTOR_SIZE);
+	me->_crc = 0xFFFF;
+	return true;
+}
+
+bool w25qxx_ckpt_append(w25qxx_ckpt_t *me, const void *data, uint32_t len)
+{
+	me->_crc = w25qxx_crc16(me->_crc, (const uint8_t*)data, len);
+	return w25qxx_Writer_Append(&me->_writer, (uint8_t*)data, len);
+}
+
+/* header last, the new snapshot replaces the previous one only once it is complete */
+bool w25qxx_ckpt_commit(w25qxx_ckpt_t *me)
+{
+	uint32_t header[4];
+	uint8_t copy = me->_copy ^ 1;
+	uint32_t base = w25qxx_ckpt_base(me, copy);
+
+	if (false == w25qxx_Writer_Flush(&me->_writer)) return false;
+	header[0] = W25Q_CKPT_MAGIC;
+	header[1] = me->generation + 1;
+	header[2] = me->_writer.address - (base + W25Q_CKPT_HEADER_SIZE);
+	header[3] = me->_crc;
+	if (false == flash_WriteMemory(me->flash, base, (uint8_t*)header, sizeof(header))) return false;
+	me->generation = header[1];
+	me->size       = header[2];
+	me->_copy      = copy;
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef W25QXX_CKPT_H
+#define W25QXX_CKPT_H
+
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define W25Q_CKPT_HEADER_SIZE				16		// magic, generation, size, crc : data follows
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+/*
+ * two copies of copy_sectors sectors from start_sector, a save always goes to the one not holding
+ * the newest snapshot and its header is programmed last : a save cut by power loss leaves the previous one.
+ */
+typedef struct{
+	w25qxx_handle_t			*flash;
+	uint16_t				start_sector;
+	uint16_t				copy_sectors;
+	uint32_t				generation;				// newest snapshot, 0 : none
+	uint32_t				size;					// its data size
+	uint8_t					_copy;					// copy holding it
+	uint16_t				_crc;					// save in progress
+	w25qxx_writer_t			_writer;
+}w25qxx_ckpt_t;
+
+/*==================================================================================================
+*                                       FUNCTION PROTOTYPES
+==================================================================================================*/
+void w25qxx_ckpt_init(w25qxx_ckpt_t *me, w25qxx_handle_t *flash, uint16_t start_sector, uint16_t copy_sectors);
+
+bool w25qxx_ckpt_open(w25qxx_ckpt_t *me);
+bool w25qxx_ckpt_read(w25qxx_ckpt_t *me, uint32_t offset, void *data, uint32_t len);
+
+bool w25qxx_ckpt_begin(w25qxx_ckpt_t *me);
+bool w25qxx_ckpt_append(w25qxx_ckpt_t *me, const void *data, uint32_t len);
+bool w25qxx_ckpt_commit(w25qxx_ckpt_t *me);
+
+#endif /* W25QXX_CKPT_H */
@@ -0,0 +1,506 @@
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "w25qxx_ftl.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define W25Q_FTL_MAGIC						0x4C544657UL	// "WFTL"
+#define W25Q_FTL_SEQ_NONE					0xFFFFFFFFUL	// seq of a free sector, programmed when it is allocated
+
+#define W25Q_FTL_MAGIC_OFFSET				0
+#define W25Q_FTL_ERASE_COUNT_OFFSET			4
+#define W25Q_FTL_SEQ_OFFSET					8
+#define W25Q_FTL_LPN_OFFSET					16				// per slot : uint16_t page then its complement, all 0xFF : slot not written
+#define W25Q_FTL_LPN_SIZE					4
+#define W25Q_FTL_LPN_WORDS					(W25Q_FTL_LPN_SIZE / 2 * W25Q_FTL_SLOTS)
+#define W25Q_FTL_HEADER_SIZE				(W25Q_FTL_LPN_OFFSET + W25Q_FTL_LPN_SIZE * W25Q_FTL_SLOTS)
+
+#define W25Q_FTL_SLOT_PER_SECTOR			(W25Q_FTL_SLOTS + 1)
+#define W25Q_FTL_PHYS(sector, slot)			((uint16_t)((sector) * W25Q_FTL_SLOT_PER_SECTOR + (slot)))
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static uint32_t w25qxx_ftl_addr(w25qxx_ftl_t *me, uint16_t sector, uint8_t slot)
+{
+	return ((uint32_t)(me->start_sector + sector) * W25Q_SECTOR_SIZE) + ((uint32_t)slot * W25Q_PAGE_SIZE);
+}
+
+/* erase and write a header carrying the erase count, the sector joins the free pool */
+static bool w25qxx_ftl_erase(w25qxx_ftl_t *me, uint16_t sector)
+{
+	uint32_t magic = W25Q_FTL_MAGIC;
+	w25qxx_ftl_sector_t *sec = &me->_sector[sector];
+
+	if (false == w25qxx_Erase_Sector(me->flash, me->start_sector + sector)) return false;
+	sec->erase_count++;
+	/* count before magic : a header cut short by power loss never carries a torn count */
+	if (false == flash_WriteMemory(me->flash, w25qxx_ftl_addr(me, sector, 0) + W25Q_FTL_ERASE_COUNT_OFFSET, (uint8_t*)&sec->erase_count, sizeof(sec->erase_count))) return false;
+	if (false == flash_WriteMemory(me->flash, w25qxx_ftl_addr(me, sector, 0) + W25Q_FTL_MAGIC_OFFSET, (uint8_t*)&magic, sizeof(magic))) return false;
+	sec->seq   = W25Q_FTL_SEQ_NONE;
+	sec->state = W25Q_FTL_SECTOR_FREE;
+	sec->valid = 0;
+	me->_free_count++;
+	return true;
+}
+
+/* least worn free sector becomes the active one */
+static bool w25qxx_ftl_open(w25qxx_ftl_t *me)
+{
+	uint16_t best = W25Q_FTL_NONE;
+	uint32_t seq;
+
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		if ((me->_sector[s].state == W25Q_FTL_SECTOR_FREE) &&
+			((best == W25Q_FTL_NONE) || (me->_sector[s].erase_count < me->_sector[best].erase_count)))
+		{
+			best = s;
+		}
+	}
+	if (best == W25Q_FTL_NONE)
+	{
+		return false;
+	}
+	seq = me->_seq + 1;
+	if (false == flash_WriteMemory(me->flash, w25qxx_ftl_addr(me, best, 0) + W25Q_FTL_SEQ_OFFSET, (uint8_t*)&seq, sizeof(seq))) return false;
+	me->_seq = seq;
+	me->_sector[best].seq   = seq;
+	me->_sector[best].state = W25Q_FTL_SECTOR_USED;
+	me->_free_count--;
+	me->_active = best;
+	me->_slot   = 1;
+	return true;
+}
+
+/*
+ * logical page of slot from the entries of a header, W25Q_FTL_NONE : not written, or cut short by power loss.
+ * a torn program only leaves bits set, page and complement can't both look right unless complete.
+ */
+static uint16_t w25qxx_ftl_lpn(const uint16_t *entry, uint8_t slot)
+{
+	uint16_t page = entry[2 * (slot - 1)];
+	if ((uint16_t)(page ^ entry[2 * (slot - 1) + 1]) != 0xFFFF)
+	{
+		return W25Q_FTL_NONE;
+	}
+	return page;
+}
+
+/* data page first, then its logical number : a page is only seen on mount once complete */
+static bool w25qxx_ftl_append(w25qxx_ftl_t *me, uint16_t page, uint8_t *data)
+{
+	uint16_t sector;
+	uint8_t slot;
+	uint16_t old;
+	uint16_t entry[2] = {page, (uint16_t)~page};
+
+	if (me->_active == W25Q_FTL_NONE)
+	{
+		if (false == w25qxx_ftl_open(me)) return false;
+	}
+	sector = me->_active;
+	slot = me->_slot++;			// a failed program leaves the slot unused, never written twice
+	if (false == flash_WriteMemory(me->flash, w25qxx_ftl_addr(me, sector, slot), data, W25Q_FTL_PAGE_SIZE)) return false;
+	if (false == flash_WriteMemory(me->flash, w25qxx_ftl_addr(me, sector, 0) + W25Q_FTL_LPN_OFFSET + W25Q_FTL_LPN_SIZE * (slot - 1), (uint8_t*)entry, sizeof(entry))) return false;
+
+	old = me->_map[page];
+	if (old != W25Q_FTL_NONE)
+	{
+		me->_sector[old / W25Q_FTL_SLOT_PER_SECTOR].valid--;
+	}
+	me->_map[page] = W25Q_FTL_PHYS(sector, slot);
+	me->_sector[sector].valid++;
+	if (me->_slot > W25Q_FTL_SLOTS)
+	{
+		me->_active = W25Q_FTL_NONE;	// full, a collection candidate from now on
+	}
+	return true;
+}
+
+/* the pages still mapped to sector go to the active one, sector is left dirty */
+static bool w25qxx_ftl_relocate(w25qxx_ftl_t *me, uint16_t sector)
+{
+	uint16_t lpn[W25Q_FTL_LPN_WORDS];
+	uint8_t data[W25Q_FTL_PAGE_SIZE];
+
+	flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, sector, 0) + W25Q_FTL_LPN_OFFSET, (uint8_t*)lpn, sizeof(lpn));
+	for (uint8_t slot = 1; slot <= W25Q_FTL_SLOTS; slot++)
+	{
+		uint16_t page = w25qxx_ftl_lpn(lpn, slot);
+		if ((page < me->pages) && (me->_map[page] == W25Q_FTL_PHYS(sector, slot)))
+		{
+			flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, sector, slot), data, sizeof(data));
+			if (false == w25qxx_ftl_append(me, page, data)) return false;
+		}
+	}
+	me->_sector[sector].state = W25Q_FTL_SECTOR_DIRTY;
+	return true;
+}
+
+/* full sector matching the condition best, W25Q_FTL_NONE if there is none */
+static uint16_t w25qxx_ftl_victim(w25qxx_ftl_t *me, bool by_wear)
+{
+	uint16_t best = W25Q_FTL_NONE;
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		w25qxx_ftl_sector_t *sec = &me->_sector[s];
+		if ((sec->state != W25Q_FTL_SECTOR_USED) || (s == me->_active))
+		{
+			continue;
+		}
+		if ((best == W25Q_FTL_NONE) ||
+			(by_wear ? (sec->erase_count < me->_sector[best].erase_count) : (sec->valid < me->_sector[best].valid)))
+		{
+			best = s;
+		}
+	}
+	return best;
+}
+
+/* first dirty sector, W25Q_FTL_NONE if there is none */
+static uint16_t w25qxx_ftl_dirty(w25qxx_ftl_t *me)
+{
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		if (me->_sector[s].state == W25Q_FTL_SECTOR_DIRTY)
+		{
+			return s;
+		}
+	}
+	return W25Q_FTL_NONE;
+}
+
+/*
+ * full sector with the fewest mapped pages if it holds at most max_valid, W25Q_FTL_NONE otherwise.
+ * without a free sector its pages have to fit the room left in the active one.
+ */
+static uint16_t w25qxx_ftl_collectable(w25qxx_ftl_t *me, uint8_t max_valid)
+{
+	uint16_t victim = w25qxx_ftl_victim(me, false);
+	uint8_t room = 0;
+
+	if ((victim == W25Q_FTL_NONE) || (me->_sector[victim].valid > max_valid))
+	{
+		return W25Q_FTL_NONE;
+	}
+	if (me->_active != W25Q_FTL_NONE)
+	{
+		room = W25Q_FTL_SLOT_PER_SECTOR - me->_slot;
+	}
+	if ((me->_free_count == 0) && (me->_sector[victim].valid > room))
+	{
+		return W25Q_FTL_NONE;
+	}
+	return victim;
+}
+
+/* one step towards a free sector : erase a dirty one, else empty a collectable one */
+static bool w25qxx_ftl_reclaim(w25qxx_ftl_t *me, uint8_t max_valid)
+{
+	uint16_t victim = w25qxx_ftl_dirty(me);
+	if (victim != W25Q_FTL_NONE)
+	{
+		return w25qxx_ftl_erase(me, victim);
+	}
+	victim = w25qxx_ftl_collectable(me, max_valid);
+	if (victim == W25Q_FTL_NONE)
+	{
+		return false;
+	}
+	return w25qxx_ftl_relocate(me, victim);
+}
+
+/* first slot after the last one programmed, a page or entry cut short by power loss counts as programmed */
+static uint8_t w25qxx_ftl_tail(w25qxx_ftl_t *me, uint16_t sector)
+{
+	uint16_t lpn[W25Q_FTL_LPN_WORDS];
+	uint8_t data[W25Q_FTL_PAGE_SIZE];
+	uint8_t slot;
+	uint16_t i;
+
+	flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, sector, 0) + W25Q_FTL_LPN_OFFSET, (uint8_t*)lpn, sizeof(lpn));
+	for (slot = W25Q_FTL_SLOTS; slot > 0; slot--)
+	{
+		if ((lpn[2 * (slot - 1)] != 0xFFFF) || (lpn[2 * (slot - 1) + 1] != 0xFFFF))
+		{
+			break;
+		}
+		flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, sector, slot), data, sizeof(data));
+		i = 0;
+		while ((i < sizeof(data)) && (data[i] == 0xFF))
+		{
+			i++;
+		}
+		if (i < sizeof(data))
+		{
+			break;
+		}
+	}
+	return slot + 1;
+}
+
+/* every page mapped to sector has the same data in an older copy : a relocation cut short, nothing lost if it is erased */
+static bool w25qxx_ftl_copies_only(w25qxx_ftl_t *me, uint16_t sector)
+{
+	uint16_t lpn[W25Q_FTL_LPN_WORDS];
+	uint16_t other[W25Q_FTL_LPN_WORDS];
+	uint8_t data[W25Q_FTL_PAGE_SIZE];
+	uint8_t copy[W25Q_FTL_PAGE_SIZE];
+
+	flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, sector, 0) + W25Q_FTL_LPN_OFFSET, (uint8_t*)lpn, sizeof(lpn));
+	for (uint8_t slot = 1; slot <= W25Q_FTL_SLOTS; slot++)
+	{
+		uint16_t page = w25qxx_ftl_lpn(lpn, slot);
+		uint16_t older = W25Q_FTL_NONE;
+		if ((page >= me->pages) || (me->_map[page] != W25Q_FTL_PHYS(sector, slot)))
+		{
+			continue;
+		}
+		/* newest copy left once sector is gone */
+		for (uint16_t s = 0; s < me->sectors; s++)
+		{
+			if ((s == sector) || (me->_sector[s].state != W25Q_FTL_SECTOR_USED) ||
+				((older != W25Q_FTL_NONE) && (me->_sector[s].seq < me->_sector[older / W25Q_FTL_SLOT_PER_SECTOR].seq)))
+			{
+				continue;
+			}
+			flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, s, 0) + W25Q_FTL_LPN_OFFSET, (uint8_t*)other, sizeof(other));
+			for (uint8_t i = 1; i <= W25Q_FTL_SLOTS; i++)
+			{
+				if (w25qxx_ftl_lpn(other, i) == page)
+				{
+					older = W25Q_FTL_PHYS(s, i);
+				}
+			}
+		}
+		if (older == W25Q_FTL_NONE)
+		{
+			return false;
+		}
+		flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, sector, slot), data, sizeof(data));
+		flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, older / W25Q_FTL_SLOT_PER_SECTOR, older % W25Q_FTL_SLOT_PER_SECTOR), copy, sizeof(copy));
+		if (0 != memcmp(data, copy, sizeof(data)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*==================================================================================================
+*                                        GLOBAL FUNCTIONS
+==================================================================================================*/
+bool w25qxx_ftl_init(w25qxx_ftl_t *me, w25qxx_handle_t *flash, uint16_t start_sector, uint16_t sectors, uint16_t reserve)
+{
+	if ((reserve < 2) || (sectors <= reserve + 1) || (((uint32_t)sectors * W25Q_FTL_SLOT_PER_SECTOR) >= W25Q_FTL_NONE))
+	{
+		return false;
+	}
+	me->flash          = flash;
+	me->start_sector   = start_sector;
+	me->sectors        = sectors;
+	me->reserve        = reserve;
+	me->pages          = (sectors - reserve - 1) * W25Q_FTL_SLOTS;
+	me->wear_threshold = W25Q_FTL_WEAR_THRESHOLD;
+	me->_map    = (uint16_t*)malloc(me->pages * sizeof(uint16_t));
+	me->_sector = (w25qxx_ftl_sector_t*)malloc(sectors * sizeof(w25qxx_ftl_sector_t));
+	if ((me->_map == NULL) || (me->_sector == NULL))
+	{
+		free(me->_map);
+		free(me->_sector);
+		me->_map    = NULL;
+		me->_sector = NULL;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * rebuild the map from the sector headers, any content is accepted : sectors without a header are dirty
+ * and erased by w25qxx_ftl_gc (or by the first write needing them).
+ * the sector being written at power loss (highest seq) is reopened after its last programmed slot,
+ * or dropped when nothing else can be collected and it only holds copies.
+ */
+bool w25qxx_ftl_mount(w25qxx_ftl_t *me)
+{
+	uint8_t header[W25Q_FTL_HEADER_SIZE];
+	uint16_t lpn[W25Q_FTL_LPN_WORDS];
+	uint16_t newest = W25Q_FTL_NONE;
+
+	memset(me->_map, 0xFF, me->pages * sizeof(uint16_t));
+	me->_active     = W25Q_FTL_NONE;
+	me->_slot       = 1;
+	me->_free_count = 0;
+	me->_seq        = 0;
+
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		w25qxx_ftl_sector_t *sec = &me->_sector[s];
+		uint32_t magic;
+
+		flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, s, 0), header, sizeof(header));
+		memcpy(&magic, &header[W25Q_FTL_MAGIC_OFFSET], sizeof(magic));
+		memcpy(&sec->erase_count, &header[W25Q_FTL_ERASE_COUNT_OFFSET], sizeof(sec->erase_count));
+		memcpy(&sec->seq, &header[W25Q_FTL_SEQ_OFFSET], sizeof(sec->seq));
+		sec->valid = 0;
+		if (magic != W25Q_FTL_MAGIC)
+		{
+			sec->erase_count = 0;
+			sec->state = W25Q_FTL_SECTOR_DIRTY;
+			continue;
+		}
+		if (sec->seq == W25Q_FTL_SEQ_NONE)
+		{
+			sec->state = W25Q_FTL_SECTOR_FREE;
+			me->_free_count++;
+			continue;
+		}
+		sec->state = W25Q_FTL_SECTOR_USED;
+		memcpy(lpn, &header[W25Q_FTL_LPN_OFFSET], sizeof(lpn));
+		/* newest copy wins : later sector, or later slot of the same sector */
+		for (uint8_t slot = 1; slot <= W25Q_FTL_SLOTS; slot++)
+		{
+			uint16_t page = w25qxx_ftl_lpn(lpn, slot);
+			uint16_t cur;
+			if (page >= me->pages)
+			{
+				continue;
+			}
+			cur = me->_map[page];
+			if ((cur == W25Q_FTL_NONE) || (me->_sector[cur / W25Q_FTL_SLOT_PER_SECTOR].seq <= sec->seq))
+			{
+				me->_map[page] = W25Q_FTL_PHYS(s, slot);
+			}
+		}
+	}
+
+	for (uint16_t page = 0; page < me->pages; page++)
+	{
+		if (me->_map[page] != W25Q_FTL_NONE)
+		{
+			me->_sector[me->_map[page] / W25Q_FTL_SLOT_PER_SECTOR].valid++;
+		}
+	}
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		if ((me->_sector[s].state == W25Q_FTL_SECTOR_USED) && (me->_sector[s].valid == 0))
+		{
+			me->_sector[s].state = W25Q_FTL_SECTOR_DIRTY;
+		}
+		else if ((me->_sector[s].state == W25Q_FTL_SECTOR_USED) &&
+				 ((newest == W25Q_FTL_NONE) || (me->_sector[s].seq > me->_sector[newest].seq)))
+		{
+			newest = s;
+		}
+	}
+	/*
+	 * with every sector used and none free, only its room lets the collector move pages.
+	 * a seq cut short by power loss is only found on a sector left dirty, it must not set the next one.
+	 */
+	if (newest != W25Q_FTL_NONE)
+	{
+		me->_seq  = me->_sector[newest].seq;
+		me->_slot = w25qxx_ftl_tail(me, newest);
+		if (me->_slot <= W25Q_FTL_SLOTS)
+		{
+			me->_active = newest;
+		}
+	}
+	/*
+	 * nothing free, nothing dirty and no victim fitting the active sector : power was lost (again) while
+	 * relocating into the last free sector. the originals are all still there, drop the copies and start over.
+	 */
+	if ((me->_free_count == 0) && (newest != W25Q_FTL_NONE) && (w25qxx_ftl_dirty(me) == W25Q_FTL_NONE) &&
+		(w25qxx_ftl_collectable(me, W25Q_FTL_SLOTS - 1) == W25Q_FTL_NONE) && (true == w25qxx_ftl_copies_only(me, newest)))
+	{
+		uint32_t magic = 0;		// cleared first : an erase cut short must not leave the copies winning over the originals
+		if (false == flash_WriteMemory(me->flash, w25qxx_ftl_addr(me, newest, 0) + W25Q_FTL_MAGIC_OFFSET, (uint8_t*)&magic, sizeof(magic))) return false;
+		if (false == w25qxx_ftl_erase(me, newest)) return false;
+		return w25qxx_ftl_mount(me);
+	}
+	return true;
+}
+
+/* never written page reads as erased */
+bool w25qxx_ftl_read(w25qxx_ftl_t *me, uint16_t page, uint8_t *data)
+{
+	uint16_t phys;
+	if (page >= me->pages)
+	{
+		return false;
+	}
+	phys = me->_map[page];
+	if (phys == W25Q_FTL_NONE)
+	{
+		memset(data, 0xFF, W25Q_FTL_PAGE_SIZE);
+		return true;
+	}
+	flash_ReadMemory(me->flash, w25qxx_ftl_addr(me, phys / W25Q_FTL_SLOT_PER_SECTOR, phys % W25Q_FTL_SLOT_PER_SECTOR), data, W25Q_FTL_PAGE_SIZE);
+	return true;
+}
+
+/*
+ * W25Q_FTL_PAGE_SIZE bytes, two page programs and no erase while the active sector has room.
+ * opening a new sector leaves one free for the collector, reclaiming in the foreground
+ * only when w25qxx_ftl_gc has not kept up.
+ */
+bool w25qxx_ftl_write(w25qxx_ftl_t *me, uint16_t page, uint8_t *data)
+{
+	if (page >= me->pages)
+	{
+		return false;
+	}
+	while (me->_free_count < ((me->_active == W25Q_FTL_NONE) ? 2 : 1))
+	{
+		if (false == w25qxx_ftl_reclaim(me, W25Q_FTL_SLOTS - 1)) return false;
+	}
+	return w25qxx_ftl_append(me, page, data);
+}
+
+/*
+ * background step, call from the main loop while idle : erases a dirty sector or collects one
+ * until reserve sectors are free, then moves the coldest data when erase counts spread over wear_threshold.
+ * false : nothing left to do.
+ */
+bool w25qxx_ftl_gc(w25qxx_ftl_t *me)
+{
+	uint16_t cold;
+	uint32_t hot = 0;
+
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		if (me->_sector[s].state == W25Q_FTL_SECTOR_DIRTY)
+		{
+			return w25qxx_ftl_erase(me, s);
+		}
+		if (me->_sector[s].erase_count > hot)
+		{
+			hot = me->_sector[s].erase_count;
+		}
+	}
+	if (me->_free_count < me->reserve)
+	{
+		return w25qxx_ftl_reclaim(me, W25Q_FTL_SLOTS - 2);	// a sector gaining a single slot is not worth an erase
+	}
+	/* static wear leveling : free the least worn sector for the hot data */
+	cold = w25qxx_ftl_victim(me, true);
+	if ((cold != W25Q_FTL_NONE) && ((hot - me->_sector[cold].erase_count) > me->wear_threshold))
+	{
+		return w25qxx_ftl_relocate(me, cold);
+	}
+	return false;
+}
+
+uint16_t w25qxx_ftl_pages(w25qxx_ftl_t *me)
+{
+	return me->pages;
+}
@@ -0,0 +1,77 @@
+#ifndef W25QXX_FTL_H
+#define W25QXX_FTL_H
+
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#ifndef W25Q_FTL_WEAR_THRESHOLD
+#define W25Q_FTL_WEAR_THRESHOLD				64		// erase count spread above which cold data is moved
+#endif
+
+#define W25Q_FTL_PAGE_SIZE					W25Q_PAGE_SIZE
+#define W25Q_FTL_SLOTS						((W25Q_SECTOR_SIZE / W25Q_PAGE_SIZE) - 1)	// data pages per sector, page 0 is the header
+#define W25Q_FTL_NONE						0xFFFF
+
+/*==================================================================================================
+*                                              ENUMS
+==================================================================================================*/
+typedef enum{
+	W25Q_FTL_SECTOR_FREE,			// erased, header written, not allocated yet
+	W25Q_FTL_SECTOR_USED,			// allocated : active or full
+	W25Q_FTL_SECTOR_DIRTY,			// nothing mapped left (or no header), to be erased
+}w25qxx_ftl_sector_state_e;
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+typedef struct{
+	uint32_t				erase_count;
+	uint32_t				seq;					// allocation order, newest copy of a page wins on mount
+	uint8_t					state;					// w25qxx_ftl_sector_state_e
+	uint8_t					valid;					// pages still mapped to this sector
+}w25qxx_ftl_sector_t;
+
+/*
+ * logical pages of W25Q_FTL_PAGE_SIZE over sectors [start_sector, start_sector + sectors) :
+ * every write is appended to the active sector, the old copy is only unmapped.
+ * on flash, page 0 of each sector : magic, erase count, seq, then the logical page of each slot and its complement.
+ */
+typedef struct{
+	w25qxx_handle_t			*flash;
+	uint16_t				start_sector;
+	uint16_t				sectors;
+	uint16_t				reserve;				// free sectors w25qxx_ftl_gc keeps erased, >= 2
+	uint16_t				pages;					// logical pages : (sectors - reserve - 1) * W25Q_FTL_SLOTS, one sector of slack past the reserve
+	uint32_t				wear_threshold;
+	uint16_t				*_map;					// logical page -> sector * 16 + slot, W25Q_FTL_NONE : never written
+	w25qxx_ftl_sector_t		*_sector;
+	uint16_t				_active;				// sector written to, W25Q_FTL_NONE : open one on next write
+	uint8_t					_slot;					// next slot of _active
+	uint16_t				_free_count;
+	uint32_t				_seq;
+}w25qxx_ftl_t;
+
+/*==================================================================================================
+*                                       FUNCTION PROTOTYPES
+==================================================================================================*/
+bool w25qxx_ftl_init(w25qxx_ftl_t *me, w25qxx_handle_t *flash, uint16_t start_sector, uint16_t sectors, uint16_t reserve);
+bool w25qxx_ftl_mount(w25qxx_ftl_t *me);
+
+bool w25qxx_ftl_read(w25qxx_ftl_t *me, uint16_t page, uint8_t *data);
+bool w25qxx_ftl_write(w25qxx_ftl_t *me, uint16_t page, uint8_t *data);
+bool w25qxx_ftl_gc(w25qxx_ftl_t *me);
+
+uint16_t w25qxx_ftl_pages(w25qxx_ftl_t *me);
+
+#endif /* W25QXX_FTL_H */
@@ -0,0 +1,470 @@
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "w25qxx_kv.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define W25Q_KV_MAGIC						0x564B5157UL	// "WQKV" : sector in the log
+#define W25Q_KV_RETIRED						0x00000000UL	// programmed over the magic once compacted
+#define W25Q_KV_SECTOR_HEADER_SIZE			8				// magic, sector seq
+
+/* record : key (2) len (1) type (1) seq (4) crc (2) value (len), little endian, inside one page */
+#define W25Q_KV_RECORD_HEADER_SIZE			10
+#define W25Q_KV_TYPE_SET					0x01
+#define W25Q_KV_TYPE_DELETE					0x02
+
+_Static_assert((W25Q_KV_RECORD_HEADER_SIZE + W25Q_KV_VALUE_MAX) <= W25Q_PAGE_SIZE, "W25Q_KV_VALUE_MAX : a record must fit one page");
+
+/*==================================================================================================
+*                                              ENUMS
+==================================================================================================*/
+typedef enum{
+	W25Q_KV_APPEND_OK,
+	W25Q_KV_APPEND_SECTOR_FULL,		// the head moves on, then again
+	W25Q_KV_APPEND_ERROR,			// index full or flash error, moving the head would not help
+}w25qxx_kv_append_e;
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+/* checkpoint data, the index follows */
+typedef struct{
+	uint16_t				start_sector;
+	uint16_t				sectors;
+	uint16_t				head;
+	uint32_t				head_seq;
+	uint32_t				write;
+	uint32_t				seq;
+}w25qxx_kv_snapshot_t;
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static uint32_t w25qxx_kv_base(w25qxx_kv_t *me, uint16_t sector)
+{
+	return (uint32_t)(me->start_sector + sector) * W25Q_SECTOR_SIZE;
+}
+
+/*
+ * slot of key, or the slot it would take : the first one of a deleted key on the way, else the empty one.
+ * NULL : index full. a deleted key's slot keeps the probe chain going until another key takes it over.
+ */
+static w25qxx_kv_entry_t *w25qxx_kv_find(w25qxx_kv_t *me, uint16_t key)
+{
+	w25qxx_kv_entry_t *reuse = NULL;
+	uint32_t h = key * 2654435761UL;
+	h ^= h >> 16;
+	for (uint16_t n = 0; n < me->index_size; n++)
+	{
+		w25qxx_kv_entry_t *entry = &me->_index[(h + n) & (me->index_size - 1U)];
+		if (entry->key == key)
+		{
+			return entry;
+		}
+		if (entry->key == W25Q_KV_KEY_NONE)
+		{
+			return (reuse != NULL) ? reuse : entry;
+		}
+		if ((reuse == NULL) && (entry->is_deleted))
+		{
+			reuse = entry;
+		}
+	}
+	return reuse;
+}
+
+static void w25qxx_kv_index(w25qxx_kv_entry_t *entry, uint16_t key, uint8_t type, uint8_t len, uint32_t address)
+{
+	entry->key        = key;
+	entry->len        = len;
+	entry->is_deleted = (type == W25Q_KV_TYPE_DELETE);
+	entry->address    = address;
+}
+
+/* one page program at _write, the index slot is taken before anything is programmed */
+static w25qxx_kv_append_e w25qxx_kv_append(w25qxx_kv_t *me, uint16_t key, uint8_t type, const void *value, uint8_t len)
+{
+	uint8_t record[W25Q_KV_RECORD_HEADER_SIZE + W25Q_KV_VALUE_MAX];
+	uint32_t size = W25Q_KV_RECORD_HEADER_SIZE + len;
+	uint32_t seq = me->_seq + 1;
+	w25qxx_kv_entry_t *entry = w25qxx_kv_find(me, key);
+	uint16_t crc;
+
+	if (entry == NULL)
+	{
+		return W25Q_KV_APPEND_ERROR;
+	}
+	if ((W25Q_PAGE_SIZE - (me->_write % W25Q_PAGE_SIZE)) < size)
+	{
+		me->_write += W25Q_PAGE_SIZE - (me->_write % W25Q_PAGE_SIZE);
+	}
+	if ((me->_write + size) > (w25qxx_kv_base(me, me->_head) + W25Q_SECTOR_SIZE))
+	{
+		return W25Q_KV_APPEND_SECTOR_FULL;
+	}
+	record[0] = key & 0xFF;
+	record[1] = key >> 8;
+	record[2] = len;
+	record[3] = type;
+	record[4] = seq & 0xFF;
+	record[5] = (seq >> 8) & 0xFF;
+	record[6] = (seq >> 16) & 0xFF;
+	record[7] = seq >> 24;
+	if (len > 0)
+	{
+		memcpy(&record[W25Q_KV_RECORD_HEADER_SIZE], value, len);
+	}
+	crc = w25qxx_crc16(0xFFFF, record, 8);
+	crc = w25qxx_crc16(crc, &record[W25Q_KV_RECORD_HEADER_SIZE], len);
+	record[8] = crc & 0xFF;
+	record[9] = crc >> 8;
+
+	if (false == flash_WriteMemory(me->flash, me->_write, record, size)) return W25Q_KV_APPEND_ERROR;
+	w25qxx_kv_index(entry, key, type, len, me->_write);
+	me->_seq = seq;
+	me->_write += size;
+	return W25Q_KV_APPEND_OK;
+}
+
+static bool w25qxx_kv_open(w25qxx_kv_t *me, uint16_t sector)
+{
+	uint32_t header[2];
+	if (false == w25qxx_Erase_Sector(me->flash, me->start_sector + sector)) return false;
+	header[0] = W25Q_KV_MAGIC;
+	header[1] = me->_sector_seq + 1;
+	if (false == flash_WriteMemory(me->flash, w25qxx_kv_base(me, sector), (uint8_t*)header, sizeof(header))) return false;
+	me->_sector_seq++;
+	me->_head  = sector;
+	me->_write = w25qxx_kv_base(me, sector) + W25Q_KV_SECTOR_HEADER_SIZE;
+	return true;
+}
+
+/*
+ * walk the records of sector from address on, record() gets each one with a good CRC.
+ * a blank or damaged header skips to the next page. returns the end of the last record.
+ */
+static uint32_t w25qxx_kv_scan(w25qxx_kv_t *me, uint16_t sector, uint32_t address, bool (*record)(w25qxx_kv_t *me, const uint8_t *hdr, uint32_t address))
+{
+	uint8_t buf[W25Q_KV_RECORD_HEADER_SIZE + W25Q_KV_VALUE_MAX];
+	uint32_t end = w25qxx_kv_base(me, sector) + W25Q_SECTOR_SIZE;
+	uint32_t last = address;
+
+	while ((address + W25Q_KV_RECORD_HEADER_SIZE) <= end)
+	{
+		uint32_t room = W25Q_PAGE_SIZE - (address % W25Q_PAGE_SIZE);
+		uint16_t key;
+		uint8_t len;
+		uint16_t crc;
+
+		if (room < W25Q_KV_RECORD_HEADER_SIZE)
+		{
+			address += room;
+			continue;
+		}
+		flash_ReadMemory(me->flash, address, buf, W25Q_KV_RECORD_HEADER_SIZE);
+		key = buf[0] | (buf[1] << 8);
+		len = buf[2];
+		if ((key == W25Q_KV_KEY_NONE) && (buf[3] == 0xFF))
+		{
+			address += room;
+			continue;
+		}
+		if ((len > W25Q_KV_VALUE_MAX) || ((uint32_t)(W25Q_KV_RECORD_HEADER_SIZE + len) > room))
+		{
+			address += room;
+			last = address;
+			continue;
+		}
+		flash_ReadMemory(me->flash, address + W25Q_KV_RECORD_HEADER_SIZE, &buf[W25Q_KV_RECORD_HEADER_SIZE], len);
+		crc = w25qxx_crc16(0xFFFF, buf, 8);
+		crc = w25qxx_crc16(crc, &buf[W25Q_KV_RECORD_HEADER_SIZE], len);
+		if ((crc == (buf[8] | (buf[9] << 8))) && (false == record(me, buf, address)))
+		{
+			return 0;
+		}
+		address += W25Q_KV_RECORD_HEADER_SIZE + len;
+		last = address;
+	}
+	return last;
+}
+
+static bool w25qxx_kv_replay(w25qxx_kv_t *me, const uint8_t *hdr, uint32_t address)
+{
+	uint32_t seq = hdr[4] | (hdr[5] << 8) | ((uint32_t)hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+	uint16_t key = hdr[0] | (hdr[1] << 8);
+	w25qxx_kv_entry_t *entry = w25qxx_kv_find(me, key);
+	if (entry == NULL)
+	{
+		return false;
+	}
+	if (seq > me->_seq)
+	{
+		me->_seq = seq;
+	}
+	w25qxx_kv_index(entry, key, hdr[3], hdr[2], address);
+	return true;
+}
+
+/* still the current record of its key : copied forward. delete records are dropped, older values can only be in the same sector */
+static bool w25qxx_kv_copy(w25qxx_kv_t *me, const uint8_t *hdr, uint32_t address)
+{
+	w25qxx_kv_entry_t *entry = w25qxx_kv_find(me, hdr[0] | (hdr[1] << 8));
+	if ((entry == NULL) || (entry->address != address) || (entry->is_deleted))
+	{
+		return true;
+	}
+	return (W25Q_KV_APPEND_OK == w25qxx_kv_append(me, entry->key, hdr[3], &hdr[W25Q_KV_RECORD_HEADER_SIZE], hdr[2]));
+}
+
+/* live records of the oldest sector copied to the head, then it is retired to be erased when opened again */
+static bool w25qxx_kv_compact(w25qxx_kv_t *me)
+{
+	uint32_t retired = W25Q_KV_RETIRED;
+
+	if (0 == w25qxx_kv_scan(me, me->_tail, w25qxx_kv_base(me, me->_tail) + W25Q_KV_SECTOR_HEADER_SIZE, w25qxx_kv_copy)) return false;
+	if (false == flash_WriteMemory(me->flash, w25qxx_kv_base(me, me->_tail), (uint8_t*)&retired, sizeof(retired))) return false;
+	me->_tail = (me->_tail + 1) % me->sectors;
+	return true;
+}
+
+/* next sector becomes the head, the oldest is compacted into it when no erased one would be left */
+static bool w25qxx_kv_advance(w25qxx_kv_t *me)
+{
+	uint16_t next = (me->_head + 1) % me->sectors;
+
+	if (next == me->_tail)
+	{
+		return false;
+	}
+	if (false == w25qxx_kv_open(me, next)) return false;
+	if ((((me->_head + 1) % me->sectors) == me->_tail) && (false == w25qxx_kv_compact(me)))
+	{
+		return false;
+	}
+	if (me->_ckpt != NULL)
+	{
+		return w25qxx_kv_checkpoint(me);
+	}
+	return true;
+}
+
+/* index and head position from the newest snapshot, false : none or the log has moved past it */
+static bool w25qxx_kv_restore(w25qxx_kv_t *me)
+{
+	w25qxx_kv_snapshot_t snap;
+	uint32_t header[2];
+
+	if ((me->_ckpt == NULL) || (false == w25qxx_ckpt_open(me->_ckpt)) ||
+		(me->_ckpt->size != (sizeof(snap) + me->index_size * sizeof(w25qxx_kv_entry_t))))
+	{
+		return false;
+	}
+	w25qxx_ckpt_read(me->_ckpt, 0, &snap, sizeof(snap));
+	if ((snap.start_sector != me->start_sector) || (snap.sectors != me->sectors) || (snap.head >= me->sectors))
+	{
+		return false;
+	}
+	flash_ReadMemory(me->flash, w25qxx_kv_base(me, snap.head), (uint8_t*)header, sizeof(header));
+	if ((header[0] != W25Q_KV_MAGIC) || (header[1] != snap.head_seq))
+	{
+		return false;
+	}
+	w25qxx_ckpt_read(me->_ckpt, sizeof(snap), me->_index, me->index_size * sizeof(w25qxx_kv_entry_t));
+	me->_head       = snap.head;
+	me->_sector_seq = snap.head_seq;
+	me->_write      = snap.write;
+	me->_seq        = snap.seq;
+	return true;
+}
+
+/*==================================================================================================
+*                                        GLOBAL FUNCTIONS
+==================================================================================================*/
+bool w25qxx_kv_init(w25qxx_kv_t *me, w25qxx_handle_t *flash, uint16_t start_sector, uint16_t sectors, uint16_t keys)
+{
+	if ((sectors < 2) || (keys == 0))
+	{
+		return false;
+	}
+	me->flash        = flash;
+	me->start_sector = start_sector;
+	me->sectors      = sectors;
+	me->index_size   = 2;
+	while (me->index_size < (2U * keys))
+	{
+		me->index_size <<= 1;
+	}
+	me->_ckpt  = NULL;
+	me->_index = (w25qxx_kv_entry_t*)malloc(me->index_size * sizeof(w25qxx_kv_entry_t));
+	return (me->_index != NULL);
+}
+
+/*
+ * snapshots of the index go to ckpt each time the head moves to a new sector (and on w25qxx_kv_checkpoint),
+ * a copy must hold sizeof(w25qxx_kv_snapshot_t) + index_size * sizeof(w25qxx_kv_entry_t). set before mount / format.
+ */
+void w25qxx_kv_set_checkpoint(w25qxx_kv_t *me, w25qxx_ckpt_t *ckpt)
+{
+	me->_ckpt = ckpt;
+}
+
+bool w25qxx_kv_checkpoint(w25qxx_kv_t *me)
+{
+	w25qxx_kv_snapshot_t snap;
+
+	if (me->_ckpt == NULL)
+	{
+		return false;
+	}
+	snap.start_sector = me->start_sector;
+	snap.sectors      = me->sectors;
+	snap.head         = me->_head;
+	snap.head_seq     = me->_sector_seq;
+	snap.write        = me->_write;
+	snap.seq          = me->_seq;
+	if (false == w25qxx_ckpt_begin(me->_ckpt)) return false;
+	if (false == w25qxx_ckpt_append(me->_ckpt, &snap, sizeof(snap))) return false;
+	if (false == w25qxx_ckpt_append(me->_ckpt, me->_index, me->index_size * sizeof(w25qxx_kv_entry_t))) return false;
+	return w25qxx_ckpt_commit(me->_ckpt);
+}
+
+/*
+ * false : no log found, w25qxx_kv_format first.
+ * with a checkpoint set only the records written after the newest snapshot are read.
+ */
+bool w25qxx_kv_mount(w25qxx_kv_t *me)
+{
+	uint32_t header[2];
+	uint32_t tail_seq = 0;
+	uint16_t start;
+	uint16_t n;
+	uint32_t last;
+
+	me->_tail = W25Q_KV_KEY_NONE;
+	for (uint16_t s = 0; s < me->sectors; s++)
+	{
+		flash_ReadMemory(me->flash, w25qxx_kv_base(me, s), (uint8_t*)header, sizeof(header));
+		if ((header[0] == W25Q_KV_MAGIC) && ((me->_tail == W25Q_KV_KEY_NONE) || (header[1] < tail_seq)))
+		{
+			me->_tail = s;
+			tail_seq  = header[1];
+		}
+	}
+	if (me->_tail == W25Q_KV_KEY_NONE)
+	{
+		return false;
+	}
+
+	/* without a usable snapshot the whole log is replayed from the oldest sector */
+	if (false == w25qxx_kv_restore(me))
+	{
+		memset(me->_index, 0xFF, me->index_size * sizeof(w25qxx_kv_entry_t));
+		me->_seq        = 0;
+		me->_head       = me->_tail;
+		me->_sector_seq = tail_seq;
+		me->_write      = w25qxx_kv_base(me, me->_tail) + W25Q_KV_SECTOR_HEADER_SIZE;
+	}
+	/* the log runs forward while the sector seq keeps growing */
+	start = me->_head;
+	for (n = 0; n < me->sectors; n++)
+	{
+		uint16_t s = (start + n) % me->sectors;
+		flash_ReadMemory(me->flash, w25qxx_kv_base(me, s), (uint8_t*)header, sizeof(header));
+		if ((header[0] != W25Q_KV_MAGIC) || (header[1] < me->_sector_seq))
+		{
+			break;
+		}
+		last = w25qxx_kv_scan(me, s, (n == 0) ? me->_write : (w25qxx_kv_base(me, s) + W25Q_KV_SECTOR_HEADER_SIZE), w25qxx_kv_replay);
+		if (last == 0)
+		{
+			return false;
+		}
+		me->_head       = s;
+		me->_sector_seq = header[1];
+		me->_write      = last;
+	}
+	/* a record cut by power loss may have left bits programmed past the last good one */
+	if ((me->_write % W25Q_PAGE_SIZE) != 0)
+	{
+		me->_write += W25Q_PAGE_SIZE - (me->_write % W25Q_PAGE_SIZE);
+	}
+	/* power lost during a compaction : finish it, the records already copied are skipped */
+	if (((me->_head + 1) % me->sectors) == me->_tail)
+	{
+		return w25qxx_kv_compact(me);
+	}
+	return true;
+}
+
+bool w25qxx_kv_format(w25qxx_kv_t *me)
+{
+	uint32_t start = w25qxx_kv_base(me, 0);
+	if (false == flash_EraseRange(me->flash, start, start + (uint32_t)me->sectors * W25Q_SECTOR_SIZE - 1, NULL, NULL)) return false;
+	memset(me->_index, 0xFF, me->index_size * sizeof(w25qxx_kv_entry_t));
+	me->_seq        = 0;
+	me->_sector_seq = 0;
+	me->_tail       = 0;
+	if (false == w25qxx_kv_open(me, 0)) return false;
+	/* an older snapshot may name this very head */
+	if (me->_ckpt != NULL)
+	{
+		return w25qxx_kv_checkpoint(me);
+	}
+	return true;
+}
+
+/* a record of key, the head moving on (and a compaction) only when its sector is full */
+static bool w25qxx_kv_put(w25qxx_kv_t *me, uint16_t key, uint8_t type, const void *value, uint8_t len)
+{
+	for (uint16_t n = 0; n < me->sectors; n++)
+	{
+		w25qxx_kv_append_e ret = w25qxx_kv_append(me, key, type, value, len);
+		if (ret != W25Q_KV_APPEND_SECTOR_FULL)
+		{
+			return (ret == W25Q_KV_APPEND_OK);
+		}
+		if (false == w25qxx_kv_advance(me)) return false;
+	}
+	return false;
+}
+
+/* one page program. false at once, nothing written, when a new key finds the index full (deleted keys' slots are reused) */
+bool w25qxx_kv_set(w25qxx_kv_t *me, uint16_t key, const void *value, uint8_t len)
+{
+	if ((key == W25Q_KV_KEY_NONE) || (len > W25Q_KV_VALUE_MAX))
+	{
+		return false;
+	}
+	return w25qxx_kv_put(me, key, W25Q_KV_TYPE_SET, value, len);
+}
+
+/* len : in size of value, out length stored. one read of the value */
+bool w25qxx_kv_get(w25qxx_kv_t *me, uint16_t key, void *value, uint8_t *len)
+{
+	w25qxx_kv_entry_t *entry = w25qxx_kv_find(me, key);
+	if ((entry == NULL) || (entry->key != key) || (entry->is_deleted) || (entry->len > *len))
+	{
+		return false;
+	}
+	flash_ReadMemory(me->flash, entry->address + W25Q_KV_RECORD_HEADER_SIZE, (uint8_t*)value, entry->len);
+	*len = entry->len;
+	return true;
+}
+
+bool w25qxx_kv_delete(w25qxx_kv_t *me, uint16_t key)
+{
+	w25qxx_kv_entry_t *entry = w25qxx_kv_find(me, key);
+	if ((entry == NULL) || (entry->key != key) || (entry->is_deleted))
+	{
+		return true;
+	}
+	return w25qxx_kv_put(me, key, W25Q_KV_TYPE_DELETE, NULL, 0);
+}
@@ -0,0 +1,68 @@
+#ifndef W25QXX_KV_H
+#define W25QXX_KV_H
+
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+#include "w25qxx_ckpt.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#ifndef W25Q_KV_VALUE_MAX
+#define W25Q_KV_VALUE_MAX					64		// bytes per value, a record never crosses a page
+#endif
+
+#define W25Q_KV_KEY_NONE					0xFFFF	// reserved : erased flash
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+/* RAM index entry, one per live key, a deleted key's entry is reused by the next new key */
+typedef struct{
+	uint16_t				key;					// W25Q_KV_KEY_NONE : empty slot
+	uint8_t					len;
+	uint8_t					is_deleted;
+	uint32_t				address;				// record in flash
+}w25qxx_kv_entry_t;
+
+/*
+ * key / value log over sectors [start_sector, start_sector + sectors) used as a ring :
+ * a set appends one record (header + value, CRC16 and sequence number) to the head sector,
+ * when it is full the next one is opened and the oldest compacted into it once a single erased sector is left.
+ */
+typedef struct{
+	w25qxx_handle_t			*flash;
+	uint16_t				start_sector;
+	uint16_t				sectors;				// >= 2
+	uint16_t				index_size;				// power of 2, >= 2 * keys
+	w25qxx_kv_entry_t		*_index;
+	uint16_t				_head;					// sector appended to
+	uint16_t				_tail;					// oldest sector holding records
+	uint32_t				_write;					// next record address in _head
+	uint32_t				_seq;					// last record sequence number
+	uint32_t				_sector_seq;			// last sector opened
+	w25qxx_ckpt_t			*_ckpt;					// NULL : mount replays the whole log
+}w25qxx_kv_t;
+
+/*==================================================================================================
+*                                       FUNCTION PROTOTYPES
+==================================================================================================*/
+bool w25qxx_kv_init(w25qxx_kv_t *me, w25qxx_handle_t *flash, uint16_t start_sector, uint16_t sectors, uint16_t keys);
+bool w25qxx_kv_mount(w25qxx_kv_t *me);
+bool w25qxx_kv_format(w25qxx_kv_t *me);
+void w25qxx_kv_set_checkpoint(w25qxx_kv_t *me, w25qxx_ckpt_t *ckpt);
+bool w25qxx_kv_checkpoint(w25qxx_kv_t *me);
+
+bool w25qxx_kv_set(w25qxx_kv_t *me, uint16_t key, const void *value, uint8_t len);
+bool w25qxx_kv_get(w25qxx_kv_t *me, uint16_t key, void *value, uint8_t *len);
+bool w25qxx_kv_delete(w25qxx_kv_t *me, uint16_t key);
+
+#endif /* W25QXX_KV_H */
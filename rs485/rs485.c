@@ -18,7 +18,10 @@
 #define RS485_REPLY_WAIT_US						10000
 #define RS485_REPLY_DELAY_US					250
 #define RS485_SEND_TIMEOUT_US					4000
-#define RS485_CHANNEL_OFFLINE_SYNC_DURATION_US	5000000
+#define RS485_CHANNEL_OFFLINE_BACKOFF_MIN_US	200000					// first probe after a channel went offline
+#define RS485_CHANNEL_OFFLINE_BACKOFF_MAX_US	60000000
+#define RS485_CHANNEL_OFFLINE_BACKOFF_LIMIT_US	600000000				// keeps timers far from the tick wrap
+#define RS485_CHANNEL_OFFLINE_BACKOFF_JITTER	25						// in percent
 #define RS485_CHANNEL_ONLINE_SYNC_DURATION_US	2000000
 
 #define RS485_CHANNEL_NOT_RESPONSE_THRESHOLD	3
@@ -40,6 +43,7 @@ typedef enum {
     RS485_EVENT_TIMEOUT,
     RS485_EVENT_NONE
 }rs485_state_event_e;
+#define RS485_EVENT_NUMBER		(RS485_EVENT_NONE + 1)
 
 typedef enum{
 	RS485_INIT_STATE,
@@ -54,7 +58,8 @@ typedef enum{
 	POLL_SEND_WAIT,
 	POLL_REPLY_WAIT,
 	POLL_SEND_ACK_DELAY,
-	POLL_SEND_ACK_WAIT
+	POLL_SEND_ACK_WAIT,
+	POLL_STATE_END,
 }rs485_poll_state_e;
 
 typedef enum{
@@ -62,20 +67,23 @@ typedef enum{
 	SELLECT_SEND_WAIT,
 	SELLECT_SEND_ACK_DELAY,
 	SELLECT_REPLY_ACK_WAIT,
+	SELLECT_STATE_END,
 }rs485_sellect_state_e;
 
+#define RS485_SUBSTATE_NUMBER	POLL_STATE_END		// widest of the poll / sellect sub states
+#define RS485_BUS_MODE_NUMBER	2
+
 /*==================================================================================================
 *                                  STRUCTURES AND OTHER TYPEDEFS
 ==================================================================================================*/
 
 typedef void (*rs485StateEntry)(rs485_state_machine_data_t *data);
-typedef void (*rs485StateFunc)(rs485_state_machine_data_t *data,uint8_t event);
 typedef void (*rs485StateExit)(rs485_state_machine_data_t *data);
+typedef void (*rs485Action)(rs485_state_machine_data_t *data);
 
 typedef struct {
 	rs485StateEntry entry;
 	rs485StateExit  exit;
-	rs485StateFunc  state;
 } rs485StateFunctions;
 
 typedef enum{
@@ -90,37 +98,63 @@ static void rs485_tx_current_frame(rs485_t *me);
 static void rs485_tx_prepare(rs485_t *me, Frame_e frame_type, bool _is_instant_tx);
 static uint8_t rs485_find_emptyChannel(rs485_t *me);
 static bool rs485_go_next_channel(rs485_t *me);
+static void rs485_address_map_add(rs485_t *me, uint8_t address, uint8_t channel_id);
+static void rs485_address_map_compat(rs485_t *me, uint8_t channel_id);
+static uint8_t rs485_channel_rx_address(rs485_t *me, rs485_channel_t *channel);
 bool rs485_channel_create(rs485_t *me, uint8_t address, uint8_t channel_id, bool is_tx_active, bool is_rx_active, uint8_t tx_cache_number, uint8_t rx_cache_number);
-static void rs485_diagnostic_count(rs485_state_machine_data_t *data, uint8_t type);
+static void rs485_diagnostic_count(rs485_state_machine_data_t *data, rs485_channel_t *channel, uint8_t type);
+static void rs485_latency_record(rs485_t *me, rs485_channel_t *channel);
+static void rs485_retry_record(rs485_channel_t *channel, bool is_given_up);
+static uint32_t rs485_backoff_ticks(rs485_t *me, rs485_channel_t *channel);
+static void rs485_baud_apply(rs485_t *me, uint32_t baud);
+static bool rs485_baud_is_pending(rs485_t *me, rs485_channel_t *channel);
+static bool rs485_baud_accept(rs485_t *me);
+static void rs485_baud_error(rs485_channel_t *channel);
+static void rs485_trace_frame(rs485_t *me, uint8_t type, uint8_t frame, uint32_t tick, uint8_t address, uint8_t opcode, uint8_t *data, uint16_t length);
+static void rs485_response_frame(rs485_t *me, rs485_staged_t *staged);
+static void rs485_response_stage(rs485_t *me, rs485_channel_t *channel);
+static void rs485_tx_handoff(rs485_t *me, rs485_staged_t *staged);
 
 /************************************ Rs485 State function ****************************************/
-void Rs485StateInit(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485StateInitEntry(rs485_state_machine_data_t *data);
 void Rs485StateInitExit(rs485_state_machine_data_t *data);
+static void Rs485InitFrame(rs485_state_machine_data_t *data);
+static void Rs485PollSend(rs485_state_machine_data_t *data);
+static void Rs485PollSent(rs485_state_machine_data_t *data);
 
-void Rs485MasterStateIdle(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485MasterStateIdleEntry(rs485_state_machine_data_t *data);
 void Rs485MasterStateIdleExit(rs485_state_machine_data_t *data);
+static void Rs485MasterIdleRun(rs485_state_machine_data_t *data);
 
-void Rs485MasterStatePoll(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485MasterStatePollEntry(rs485_state_machine_data_t *data);
 void Rs485MasterStatePollExit(rs485_state_machine_data_t *data);
+static void Rs485MasterPollReply(rs485_state_machine_data_t *data);
+static void Rs485MasterPollNoReply(rs485_state_machine_data_t *data);
+static void Rs485MasterPollSendAck(rs485_state_machine_data_t *data);
 
-void Rs485MasterStateSellect(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485MasterStateSellectEntry(rs485_state_machine_data_t *data);
 void Rs485MasterStateSellectExit(rs485_state_machine_data_t *data);
+static void Rs485MasterSellectSent(rs485_state_machine_data_t *data);
+static void Rs485MasterSellectReply(rs485_state_machine_data_t *data);
+static void Rs485MasterSellectNoReply(rs485_state_machine_data_t *data);
 
-void Rs485SlaveStateIdle(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485SlaveStateIdleEntry(rs485_state_machine_data_t *data);
 void Rs485SlaveStateIdleExit(rs485_state_machine_data_t *data);
+static void Rs485SlaveIdleRun(rs485_state_machine_data_t *data);
 
-void Rs485SlaveStatePoll(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485SlaveStatePollEntry(rs485_state_machine_data_t *data);
 void Rs485SlaveStatePollExit(rs485_state_machine_data_t *data);
+static void Rs485SlavePollReply(rs485_state_machine_data_t *data);
+static void Rs485SlavePollNoReply(rs485_state_machine_data_t *data);
+static void Rs485SlavePollSendEot(rs485_state_machine_data_t *data);
+static void Rs485SlavePollDone(rs485_state_machine_data_t *data);
 
-void Rs485SlaveStateSellect(rs485_state_machine_data_t *data, uint8_t event);
 void Rs485SlaveStateSellectEntry(rs485_state_machine_data_t *data);
 void Rs485SlaveStateSellectExit(rs485_state_machine_data_t *data);
+static void Rs485SlaveSellectSync(rs485_state_machine_data_t *data);
+static void Rs485SlaveSellectReceive(rs485_state_machine_data_t *data);
+static void Rs485SlaveSellectSendAck(rs485_state_machine_data_t *data);
+static void Rs485SlaveSellectCancelAck(rs485_state_machine_data_t *data);
 
 /************************************ Rs485 State machine functions ****************************************/
 static void rs485_timer_start(rs485_state_machine_data_t *data, rs485timer_t *timer, uint32_t tick);
@@ -130,20 +164,60 @@ static void rs485_timer_clear(rs485_state_machine_data_t *data, rs485timer_t *ti
 static void rs485_state_machine_post_internal_event(void *data, uint8_t event);
 static void rs485_state_transition(rs485_state_machine_data_t *data, uint8_t next_state);
 static uint8_t rs485_process_input(rs485_state_machine_data_t *data);
-static rs485StateFunctions* rs485_get_state_fp(rs485_state_machine_data_t *data, uint8_t state);
 static uint8_t rs485_get_next_state(rs485_state_machine_data_t *data, uint8_t next_event);
 static void rs485_state_machine_run(rs485_state_machine_data_t *data);
+static void rs485_tick_update(rs485_t *me);
 /*==================================================================================================
 *                                  GLOBAL VARIABLE DECLARATIONS
 ==================================================================================================*/
-rs485StateFunctions rs485stateFunctions[] = {
-	{Rs485StateInitEntry	  		, Rs485StateInitExit	    	, Rs485StateInit   	  		},
-	{Rs485MasterStateIdleEntry	  	, Rs485MasterStateIdleExit	    , Rs485MasterStateIdle      },
-	{Rs485MasterStatePollEntry	    , Rs485MasterStatePollExit	    , Rs485MasterStatePoll      },
-	{Rs485MasterStateSellectEntry	, Rs485MasterStateSellectExit   , Rs485MasterStateSellect   },
-	{Rs485SlaveStateIdleEntry		, Rs485SlaveStateIdleExit		, Rs485SlaveStateIdle 		},
-	{Rs485SlaveStatePollEntry		, Rs485SlaveStatePollExit		, Rs485SlaveStatePoll 		},
-	{Rs485SlaveStateSellectEntry	, Rs485SlaveStateSellectExit	, Rs485SlaveStateSellect   	},
+static const rs485StateFunctions rs485stateFunctions[RS485_BUS_MODE_NUMBER][RS485_STATE_END] = {
+	[MASTER_MODE] = {
+		{Rs485StateInitEntry	  		, Rs485StateInitExit	    	},
+		{Rs485MasterStateIdleEntry	  	, Rs485MasterStateIdleExit	    },
+		{Rs485MasterStatePollEntry	    , Rs485MasterStatePollExit	    },
+		{Rs485MasterStateSellectEntry	, Rs485MasterStateSellectExit   },
+	},
+	[SLAVE_MODE] = {
+		{Rs485StateInitEntry	  		, Rs485StateInitExit	    	},
+		{Rs485SlaveStateIdleEntry		, Rs485SlaveStateIdleExit		},
+		{Rs485SlaveStatePollEntry		, Rs485SlaveStatePollExit		},
+		{Rs485SlaveStateSellectEntry	, Rs485SlaveStateSellectExit	},
+	},
+};
+
+#define RS485_ON_ANY_EVENT(action)	{action, action, action, action, action, action}
+
+static const rs485Action rs485ActionTable[RS485_BUS_MODE_NUMBER][RS485_STATE_END][RS485_SUBSTATE_NUMBER][RS485_EVENT_NUMBER] = {
+	[MASTER_MODE] = {
+		[RS485_INIT_STATE][0][RS485_EVENT_FRAME] 								= Rs485InitFrame,
+		[RS485_IDLE_STATE][0] 													= RS485_ON_ANY_EVENT(Rs485MasterIdleRun),
+		[RS485_POLL_STATE][POLL_SEND_DELAY][RS485_EVENT_TIMEOUT] 				= Rs485PollSend,
+		[RS485_POLL_STATE][POLL_SEND_WAIT][RS485_EVENT_LOOPBACK] 				= Rs485PollSent,
+		[RS485_POLL_STATE][POLL_REPLY_WAIT][RS485_EVENT_FRAME] 					= Rs485MasterPollReply,
+		[RS485_POLL_STATE][POLL_REPLY_WAIT][RS485_EVENT_TIMEOUT] 				= Rs485MasterPollNoReply,
+		[RS485_POLL_STATE][POLL_SEND_ACK_DELAY][RS485_EVENT_TIMEOUT] 			= Rs485MasterPollSendAck,
+		[RS485_SELLECT_STATE][SELLECT_SEND_WAIT][RS485_EVENT_LOOPBACK] 			= Rs485MasterSellectSent,
+		[RS485_SELLECT_STATE][SELLECT_REPLY_ACK_WAIT][RS485_EVENT_FRAME] 		= Rs485MasterSellectReply,
+		[RS485_SELLECT_STATE][SELLECT_REPLY_ACK_WAIT][RS485_EVENT_TIMEOUT] 		= Rs485MasterSellectNoReply,
+	},
+	[SLAVE_MODE] = {
+		[RS485_INIT_STATE][0][RS485_EVENT_FRAME] 								= Rs485InitFrame,
+		[RS485_IDLE_STATE][0] 													= RS485_ON_ANY_EVENT(Rs485SlaveIdleRun),
+		[RS485_POLL_STATE][POLL_SEND_DELAY][RS485_EVENT_TIMEOUT] 				= Rs485PollSend,
+		[RS485_POLL_STATE][POLL_SEND_WAIT][RS485_EVENT_LOOPBACK] 				= Rs485PollSent,
+		[RS485_POLL_STATE][POLL_REPLY_WAIT][RS485_EVENT_FRAME] 					= Rs485SlavePollReply,
+		[RS485_POLL_STATE][POLL_REPLY_WAIT][RS485_EVENT_TIMEOUT] 				= Rs485SlavePollNoReply,
+		[RS485_POLL_STATE][POLL_SEND_ACK_DELAY][RS485_EVENT_TIMEOUT] 			= Rs485SlavePollSendEot,
+		[RS485_POLL_STATE][POLL_SEND_ACK_DELAY][RS485_EVENT_FRAME] 				= Rs485SlavePollDone,
+		[RS485_POLL_STATE][POLL_SEND_ACK_WAIT][RS485_EVENT_FRAME] 				= Rs485SlavePollDone,
+		[RS485_POLL_STATE][POLL_SEND_ACK_WAIT][RS485_EVENT_LOOPBACK] 			= Rs485SlavePollDone,
+		[RS485_POLL_STATE][POLL_SEND_ACK_WAIT][RS485_EVENT_TIMEOUT] 			= Rs485SlavePollDone,
+		[RS485_SELLECT_STATE][SELLECT_RECEIVE_WAIT][RS485_EVENT_FRAME] 			= Rs485SlaveSellectReceive,
+		[RS485_SELLECT_STATE][SELLECT_RECEIVE_WAIT][RS485_EVENT_NONE] 			= Rs485SlaveSellectSync,
+		[RS485_SELLECT_STATE][SELLECT_SEND_ACK_DELAY][RS485_EVENT_TIMEOUT] 		= Rs485SlaveSellectSendAck,
+		[RS485_SELLECT_STATE][SELLECT_SEND_ACK_DELAY][RS485_EVENT_FRAME] 		= Rs485SlaveSellectCancelAck,
+		[RS485_SELLECT_STATE][SELLECT_SEND_ACK_DELAY][RS485_EVENT_NONE] 		= Rs485SlaveSellectSync,
+	},
 };
 /*==================================================================================================
 *                                         LOCAL FUNCTIONS
@@ -193,22 +267,137 @@ static bool rs485_go_next_channel(rs485_t *me)
 	return retVal;
 }
 
+/*
+ * slave : every SA the channel answers to (same device type and physical address, either mirror bit) points to it.
+ * its own address always wins, the other entries go to the first channel claiming them.
+ */
+static void rs485_address_map_add(rs485_t *me, uint8_t address, uint8_t channel_id)
+{
+	address_valid_t address_valid;
+	uint16_t sa;
+	for(sa = 0; sa <= 0xFFU; sa++)
+	{
+		address_valid = rs485_address_validate(address, (uint8_t)sa);
+		if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true) && (me->address_map[sa] == RS485_INVALID_CHANNEL_ID)){
+			me->address_map[sa] = channel_id;
+		}
+	}
+	me->address_map[address] = channel_id;
+}
+
+/*
+ * slave with a single channel : it also answers the deviceID given to rs485_init, as before channels had addresses.
+ * a second channel ends it, SAs not tied to the first channel's own address are given back.
+ */
+static void rs485_address_map_compat(rs485_t *me, uint8_t channel_id)
+{
+	address_valid_t address_valid;
+	uint16_t sa;
+	if(me->num_of_channel == 0U){
+		rs485_address_map_add(me, me->address, channel_id);
+		return;
+	}
+	for(sa = 0; sa <= 0xFFU; sa++)
+	{
+		address_valid = rs485_address_validate(me->channel_list[0]->address, (uint8_t)sa);
+		if((me->address_map[sa] == 0U) && ((address_valid.device_type_valid == false) || (address_valid.physical_addr_valid == false))){
+			me->address_map[sa] = RS485_INVALID_CHANNEL_ID;
+		}
+	}
+}
+
+/* slave : address the channel was reached on, its own or the deviceID of the single channel compatibility path */
+static uint8_t rs485_channel_rx_address(rs485_t *me, rs485_channel_t *channel)
+{
+	address_valid_t address_valid = rs485_address_validate(channel->address, me->rx_view.address);
+	if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true)){
+		return channel->address;
+	}
+	return me->address;
+}
+
+/* one copy from the receive buffer into the channel queue */
+static bool rs485_rx_packet_put(rs485_t *me, rs485_channel_t *channel)
+{
+	rs485_channel_telemetry_t *telemetry = &channel->_telemetry;
+	uint16_t depth;
+	if(ring_buffer_is_full(&channel->rxPacket_rb)){
+		rs485_diagnostic_count(&me->sm_data, channel, SLAVE_BUSY_COUNT);
+		return false;
+	}
+	if(me->rx_view.data != me->rx_packet.data){
+		/* frame was unframed from rxframe after the line silence */
+		memcpy(me->rx_packet.data, me->rx_view.data, me->rx_view.length);
+	}
+	me->rx_packet.address = me->rx_view.address;
+	me->rx_packet.opcode  = me->rx_view.opcode;
+	me->rx_packet.length  = me->rx_view.length;
+	ring_buffer_put(&channel->rxPacket_rb, &me->rx_packet);
+	channel->_rx_put++;
+	depth = (uint16_t)(channel->_rx_put - channel->_rx_get);
+	if(depth > telemetry->rx_queue_max){
+		telemetry->rx_queue_max = (uint8_t)depth;
+	}
+	return true;
+}
+
+static bool rs485_frame_complete(rs485_t *me, bool is_parsed)
+{
+	bool ret = false;
+	if(true == me->_loopback_flag)
+	{
+		me->_loopback_flag = false;
+		rs485_state_machine_post_internal_event(&me->sm_data,RS485_EVENT_LOOPBACK);
+		rs485_rx_mode(me);
+		if(me->_baud_next != 0U){
+			/* accepted rate proposal : our ACK is out, the line is ours to switch */
+			rs485_baud_apply(me, me->_baud_next);
+			me->_baud_next = 0;
+		}
+	}else{
+		if(true == is_parsed){
+			me->_cur_rxframe = packet_parser_view(&me->rx_parser, &me->rx_view);
+		}else{
+			me->_cur_rxframe = packet_unframe_view(&me->rx_view, me->rxframe , me->_rx_byte_count);
+		}
+		if(me->_trace != NULL){
+			if(ERROR_FRAME == me->_cur_rxframe){
+				rs485_trace_frame(me, RS485_TRACE_RX, ERROR_FRAME, me->_rx_start_tick, 0, 0, me->rxframe, me->_rx_byte_count);
+			}else if((ACK_FRAME == me->_cur_rxframe) || (NACK_FRAME == me->_cur_rxframe) || (EOT_FRAME == me->_cur_rxframe)){
+				rs485_trace_frame(me, RS485_TRACE_RX, me->_cur_rxframe, me->_rx_start_tick, 0, 0, NULL, 0);
+			}else{
+				rs485_trace_frame(me, RS485_TRACE_RX, me->_cur_rxframe, me->_rx_start_tick, me->rx_view.address, me->rx_view.opcode, me->rx_view.data, me->rx_view.length);
+			}
+		}
+		ret = true;
+	}
+	me->_rx_byte_count = 0;
+	me->_eof_pending = false;
+	packet_parser_reset(&me->rx_parser);
+	return ret;
+}
+
 static bool rs485_frame_avaiable(rs485_t *me)
 {
     bool ret = false;
-    if(true == rs485_timer_timeout(&me->sm_data,&me->sm_data._t35_timer)){
-    	rs485_timer_clear(&me->sm_data,&me->sm_data._t35_timer);
+    if(true == me->_eof_flag){
+    	/* parser already saw the whole frame, no need to wait for the line silence */
+    	me->_eof_flag = false;
+    	rs485_timer_clear(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer);
+    	ret = rs485_frame_complete(me, true);
+    }else if(true == rs485_timer_timeout(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer)){
+    	rs485_timer_clear(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer);
     	me->meIF->uart_rx((uint8_t*)&me->rxByte,1U);
-    	if(true == me->_loopback_flag)
-    	{
-    		me->_loopback_flag = false;
-    		me->_rx_byte_count = 0;
-    		rs485_state_machine_post_internal_event(&me->sm_data,RS485_EVENT_LOOPBACK);
-    		rs485_rx_mode(me);
+    	ret = rs485_frame_complete(me, false);
+    }else if(true == rs485_timer_timeout(&me->sm_data,(uint32_t*)&me->sm_data._t15_timer)){
+    	rs485_timer_clear(&me->sm_data,(uint32_t*)&me->sm_data._t15_timer);
+    	if(true == me->_eof_pending){
+    		/* ETX and check matched and nothing followed : the frame is complete */
+    		rs485_timer_clear(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer);
+    		ret = rs485_frame_complete(me, true);
     	}else{
-    		me->_cur_rxframe = packet_unframe(&me->rx_packet, me->rxframe , me->_rx_byte_count);
-			me->_rx_byte_count = 0;
-			ret = true;
+    		/* character gap inside a frame : drop the partial frame so the next one is parsed from its start */
+    		packet_parser_reset(&me->rx_parser);
     	}
     }
     return ret;
@@ -217,15 +406,47 @@ static bool rs485_frame_avaiable(rs485_t *me)
 static void rs485_tx_current_frame(rs485_t *me)
 {
 	rs485IF_t *tmpIF = me->meIF;
+	rs485_iovec_t iov[3];
 	rs485_tx_mode(me);
-	tmpIF->uart_tx(me->txframe,me->_tx_size);
+	me->_rx_byte_count = 0;
+	me->_eof_pending = false;
+	packet_parser_reset(&me->rx_parser);
+	if(tmpIF->uart_txv != NULL){
+		/* payload goes out of the packet directly, retries resend the same vectors */
+		iov[0].pdata = me->_tx_builder_p->header;
+		iov[0].len   = me->_tx_builder_p->header_len;
+		iov[1].pdata = me->_tx_packet_p->data;
+		iov[1].len   = me->_tx_builder_p->payload_len;
+		iov[2].pdata = me->_tx_builder_p->trailer;
+		iov[2].len   = me->_tx_builder_p->trailer_len;
+		tmpIF->uart_txv(iov,3U);
+	}else{
+		tmpIF->uart_tx(me->_txframe_p,me->_tx_size);
+	}
 	me->_loopback_flag = true;
-	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer,RS485_US_TO_TICKS(RS485_T35_DURATION_US));
+	me->_request_tick = me->_tick_count;
+	me->_is_reply_pending = (POLL_FRAME == me->_tx_frame) || (SELLECT_FRAME == me->_tx_frame) || (RESPOND_FRAME == me->_tx_frame);
+	if(me->_trace != NULL){
+		if((SELLECT_FRAME == me->_tx_frame) || (RESPOND_FRAME == me->_tx_frame)){
+			rs485_trace_frame(me, RS485_TRACE_TX, me->_tx_frame, me->_tick_count, me->_tx_packet_p->address, me->_tx_packet_p->opcode, me->_tx_packet_p->data, me->_tx_packet_p->length);
+		}else{
+			rs485_trace_frame(me, RS485_TRACE_TX, me->_tx_frame, me->_tick_count, me->_tx_packet_p->address, 0, NULL, 0);
+		}
+	}
+	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer,me->_t35_ticks);
 }
 
 static void rs485_tx_prepare(rs485_t *me, Frame_e frame_type, bool _is_instant_tx)
 {
-	me->_tx_size = packet_frame(me->txframe,&me->tx_packet,frame_type);
+	me->_tx_frame 		= (uint8_t)frame_type;
+	me->_tx_packet_p 	= &me->tx_packet;
+	me->_txframe_p 		= me->txframe;
+	me->_tx_builder_p 	= &me->tx_builder;
+	if(me->meIF->uart_txv != NULL){
+		me->_tx_size = packet_frame_build(&me->tx_builder,&me->tx_packet,frame_type);
+	}else{
+		me->_tx_size = packet_frame(me->txframe,&me->tx_packet,frame_type);
+	}
 	if(true == _is_instant_tx)
 	{
 		rs485_tx_current_frame(me);
@@ -237,6 +458,8 @@ bool rs485_channel_create(rs485_t *me, uint8_t address, uint8_t channel_id, bool
 	bool retVal = false;
 	me->channel_list[channel_id] = (rs485_channel_t*)malloc(sizeof(rs485_channel_t));
 	if(me->channel_list[channel_id] != NULL){
+		memset(me->channel_list[channel_id], 0, sizeof(rs485_channel_t));
+		me->channel_list[channel_id]->_staged = NULL;
 		if(me->bus_mode == MASTER_MODE){
 			if(true == is_tx_active)
 			{
@@ -249,6 +472,13 @@ bool rs485_channel_create(rs485_t *me, uint8_t address, uint8_t channel_id, bool
 			me->channel_list[channel_id]->is_sellect_active = is_tx_active;
 		}else if(me->bus_mode == SLAVE_MODE){
 			if(true == is_tx_active){
+				me->channel_list[channel_id]->_staged = (rs485_staged_t*)malloc(sizeof(rs485_staged_t));
+				if(me->channel_list[channel_id]->_staged == NULL){
+					free(me->channel_list[channel_id]);
+					me->channel_list[channel_id] = NULL;
+					return false;
+				}
+				me->channel_list[channel_id]->_staged->state = RS485_STAGED_EMPTY;
 				ring_buffer_init(&me->channel_list[channel_id]->txPacket_rb,tx_cache_number,sizeof(Packet_t));
 			}
 			if(true == is_rx_active){
@@ -258,8 +488,24 @@ bool rs485_channel_create(rs485_t *me, uint8_t address, uint8_t channel_id, bool
 			me->channel_list[channel_id]->is_sellect_active = is_rx_active;
 		}
 		me->channel_list[channel_id]->address = address;
+		if(me->bus_mode == SLAVE_MODE){
+			rs485_address_map_compat(me, channel_id);
+			rs485_address_map_add(me, address, channel_id);
+		}
 		me->channel_list[channel_id]->state = RS485_CHANNEL_INIT_STATE;
 		me->channel_list[channel_id]->_not_respond_count = 0;
+		me->channel_list[channel_id]->backoff.min_us 			= RS485_CHANNEL_OFFLINE_BACKOFF_MIN_US;
+		me->channel_list[channel_id]->backoff.max_us 			= RS485_CHANNEL_OFFLINE_BACKOFF_MAX_US;
+		me->channel_list[channel_id]->backoff.jitter_percent 	= RS485_CHANNEL_OFFLINE_BACKOFF_JITTER;
+		me->channel_list[channel_id]->_backoff_us 				= RS485_CHANNEL_OFFLINE_BACKOFF_MIN_US;
+		me->channel_list[channel_id]->baud 						= RS485_DEFAULT_BAUD;
+		me->channel_list[channel_id]->baud_max 					= RS485_DEFAULT_BAUD;
+		me->channel_list[channel_id]->_baud_err_count 			= 0;
+		me->channel_list[channel_id]->_tx_put 					= 0;
+		me->channel_list[channel_id]->_tx_get 					= 0;
+		me->channel_list[channel_id]->_rx_put 					= 0;
+		me->channel_list[channel_id]->_rx_get 					= 0;
+		memset(&me->channel_list[channel_id]->_telemetry, 0, sizeof(rs485_channel_telemetry_t));
 		me->num_of_channel++;
 		retVal = true;
 	}
@@ -276,7 +522,8 @@ static void rs485_channel_state_transition(rs485_state_machine_data_t *data, uin
 			case RS485_CHANNEL_INIT_STATE:
 				break;
 			case RS485_CHANNEL_OFFLINE_STATE:
-				rs485_timer_start(data,&cur_channel->_sync_timer,RS485_US_TO_TICKS(RS485_CHANNEL_OFFLINE_SYNC_DURATION_US));
+				cur_channel->_backoff_us = cur_channel->backoff.min_us;
+				rs485_timer_start(data,&cur_channel->_sync_timer,rs485_backoff_ticks(data->common,cur_channel));
 				break;
 			case RS485_CHANNEL_ONLINE_STATE:
 				if(true == cur_channel->is_poll_active){
@@ -293,24 +540,183 @@ static void rs485_channel_state_transition(rs485_state_machine_data_t *data, uin
 	}
 }
 
-static void rs485_diagnostic_count(rs485_state_machine_data_t *data, uint8_t type)
+/* bus counters always, channel counters when the event belongs to a channel (channel may be NULL) */
+static void rs485_diagnostic_count(rs485_state_machine_data_t *data, rs485_channel_t *channel, uint8_t type)
 {
+	rs485_diagnostic_t *diagnostic = &data->common->_diagnostic;
 	switch(type)
 	{
 	case BUS_MSG_COUNT:
-		data->common->_diagnostic._bus_msg_count++;
+		diagnostic->_bus_msg_count++;
+		if(channel != NULL) channel->_telemetry.msg_count++;
 		break;
 	case BUS_ERR_COUNT:
 		DEV_Digital_Toggle(TRIGGER3_PORT_PIN);
-		data->common->_diagnostic._slave_err_count++;
+		diagnostic->_bus_err_count++;
+		if(channel != NULL) channel->_telemetry.err_count++;
 		break;
 	case BUS_OVERRUN_COUNT:
-		data->common->_diagnostic._bus_overrun_count++;
+		diagnostic->_bus_overrun_count++;
+		break;
+	case SLAVE_MSG_COUNT:
+		diagnostic->_slave_msg_count++;
+		if(channel != NULL) channel->_telemetry.msg_count++;
+		break;
+	case SLAVE_ERR_COUNT:
+		diagnostic->_slave_err_count++;
+		if(channel != NULL) channel->_telemetry.err_count++;
+		break;
+	case SLAVE_NO_RESP_COUNT:
+		diagnostic->_slave_no_resp_count++;
+		if(channel != NULL) channel->_telemetry.no_resp_count++;
+		break;
+	case SLAVE_NAK_COUNT:
+		diagnostic->_slave_nak_count++;
+		if(channel != NULL) channel->_telemetry.nak_count++;
+		break;
+	case SLAVE_BUSY_COUNT:
+		diagnostic->_slave_busy_count++;
+		if(channel != NULL) channel->_telemetry.busy_count++;
 		break;
 	default:
 		break;
 	}
 }
+
+/* log2 bins of the ticks between the last request going out and its reply */
+/* first reply to a POLL / SELLECT / RESPOND only, not the EOT answering our ACK */
+static void rs485_latency_record(rs485_t *me, rs485_channel_t *channel)
+{
+	uint32_t ticks = me->_tick_count - me->_request_tick;
+	uint8_t bin = 0;
+	if(false == me->_is_reply_pending){
+		return;
+	}
+	me->_is_reply_pending = false;
+	while((ticks > 1U) && (bin < (RS485_LATENCY_HIST_BINS - 1))){
+		ticks >>= 1;
+		bin++;
+	}
+	channel->_telemetry.latency_hist[bin]++;
+}
+
+static void rs485_retry_record(rs485_channel_t *channel, bool is_given_up)
+{
+	if((true == is_given_up) || (channel->_retry_count > MAX_RETRY_NUMBER)){
+		channel->_telemetry.retry_hist[RS485_RETRY_HIST_BINS - 1]++;
+	}else{
+		channel->_telemetry.retry_hist[channel->_retry_count]++;
+	}
+}
+/* _backoff_us spread by +/- jitter_percent so dead channels do not line up on the same cycle */
+static uint32_t rs485_backoff_ticks(rs485_t *me, rs485_channel_t *channel)
+{
+	uint32_t delay = channel->_backoff_us;
+	uint32_t jitter = (delay / 100U) * channel->backoff.jitter_percent;
+	if(jitter > 0U){
+		/* xorshift32 */
+		me->_rand ^= me->_rand << 13;
+		me->_rand ^= me->_rand >> 17;
+		me->_rand ^= me->_rand << 5;
+		delay = delay - jitter + (me->_rand % (2U * jitter + 1U));
+	}
+	return RS485_US_TO_TICKS(delay);
+}
+/* only with the line idle : frame gaps follow the character time, never below 2 ticks */
+static void rs485_baud_apply(rs485_t *me, uint32_t baud)
+{
+	uint32_t gap_us;
+	if((baud == me->_baud) || (NULL == me->meIF->set_baud)){
+		return;
+	}
+	me->meIF->set_baud(baud);
+	me->_baud = baud;
+	gap_us = (uint32_t)(((uint64_t)RS485_T35_DURATION_US * RS485_DEFAULT_BAUD) / baud);
+	me->_t35_ticks = RS485_US_TO_TICKS(gap_us);
+	gap_us = (uint32_t)(((uint64_t)RS485_T15_DURATION_US * RS485_DEFAULT_BAUD) / baud);
+	me->_t15_ticks = RS485_US_TO_TICKS(gap_us);
+	if(me->_t35_ticks < 2U) me->_t35_ticks = 2U;
+	if(me->_t15_ticks < 2U) me->_t15_ticks = 2U;
+}
+
+static bool rs485_baud_is_pending(rs485_t *me, rs485_channel_t *channel)
+{
+	return ((NULL != me->meIF->set_baud) && (channel->baud_max > channel->baud));
+}
+
+/* slave : proposal in rx_view, switch is armed for after our ACK */
+static bool rs485_baud_accept(rs485_t *me)
+{
+	uint32_t baud;
+	/* one line rate for every channel : a proposal from one master exchange can't speak for the others */
+	if((NULL == me->meIF->set_baud) || (me->rx_view.length != 4U) || (me->num_of_channel > 1U)){
+		return false;
+	}
+	baud = (uint32_t)me->rx_view.data[0] | ((uint32_t)me->rx_view.data[1] << 8) | ((uint32_t)me->rx_view.data[2] << 16) | ((uint32_t)me->rx_view.data[3] << 24);
+	if((baud < RS485_DEFAULT_BAUD) || (baud > me->_baud_max)){
+		return false;
+	}
+	me->_baud_next = baud;
+	return true;
+}
+
+/* master : the slave is not heard at the agreed rate, both ends meet again at RS485_DEFAULT_BAUD */
+static void rs485_baud_error(rs485_channel_t *channel)
+{
+	if(channel->baud != RS485_DEFAULT_BAUD){
+		channel->_baud_err_count++;
+		if(channel->_baud_err_count >= RS485_BAUD_FALLBACK_THRESHOLD){
+			channel->baud 			= RS485_DEFAULT_BAUD;
+			channel->baud_max 		= RS485_DEFAULT_BAUD;
+			channel->_baud_err_count = 0;
+		}
+	}
+}
+static void rs485_trace_frame(rs485_t *me, uint8_t type, uint8_t frame, uint32_t tick, uint8_t address, uint8_t opcode, uint8_t *data, uint16_t length)
+{
+	rs485_trace_record_t record;
+	record.tick 		= tick;
+	record.type 		= type;
+	record.frame 		= frame;
+	record.address 		= address;
+	record.opcode 		= opcode;
+	record.length 		= length;
+	record.channel_id 	= me->_cur_channel_id;
+	record.bus_mode 	= (uint8_t)me->bus_mode;
+	rs485_trace_put(me->_trace, &record, data);
+}
+static void rs485_response_frame(rs485_t *me, rs485_staged_t *staged)
+{
+	if(me->meIF->uart_txv != NULL){
+		staged->size = packet_frame_build(&staged->builder, &staged->packet, RESPOND_FRAME);
+	}else{
+		staged->size = packet_frame(staged->frame, &staged->packet, RESPOND_FRAME);
+	}
+}
+
+/* slave : frame the channel's next response now, a POLL then only hands it to the line */
+static void rs485_response_stage(rs485_t *me, rs485_channel_t *channel)
+{
+	rs485_staged_t *staged = channel->_staged;
+	if((staged == NULL) || (RS485_STAGED_EMPTY != staged->state) || (true == ring_buffer_is_empty(&channel->txPacket_rb))){
+		return;
+	}
+	ring_buffer_get(&channel->txPacket_rb, &staged->packet);
+	channel->_tx_get++;
+	staged->packet.address = channel->address;
+	rs485_response_frame(me, staged);
+	staged->state = RS485_STAGED_READY;
+}
+
+static void rs485_tx_handoff(rs485_t *me, rs485_staged_t *staged)
+{
+	me->_tx_frame 		= RESPOND_FRAME;
+	me->_tx_size 		= staged->size;
+	me->_tx_packet_p 	= &staged->packet;
+	me->_txframe_p 		= staged->frame;
+	me->_tx_builder_p 	= &staged->builder;
+	staged->state 		= RS485_STAGED_IN_USE;
+}
 /************************************ Rs485 State machine functions ****************************************/
 #define RS485_TIMER_CLEARED (0u)
 
@@ -346,33 +752,6 @@ static void rs485_state_transition(rs485_state_machine_data_t *data, uint8_t nex
 	rs485_state_machine_post_internal_event(data, RS485_EVENT_JUMP_STATE);
 }
 
-static rs485StateFunctions* rs485_get_state_fp(rs485_state_machine_data_t *data, uint8_t state)
-{
-	rs485StateFunctions *retVal = NULL;
-	switch(state)
-	{
-		case RS485_INIT_STATE:
-			retVal = &rs485stateFunctions[RS485_INIT_STATE];
-			break;
-		case RS485_IDLE_STATE:
-		case RS485_POLL_STATE:
-		case RS485_SELLECT_STATE:
-			switch(data->common->bus_mode)
-			{
-				case MASTER_MODE:
-					retVal = &rs485stateFunctions[state];
-					break;
-				case SLAVE_MODE:
-					retVal = &rs485stateFunctions[RS485_SELLECT_STATE + state];
-					break;
-			}
-			break;
-		default:
-			return NULL;
-	}
-	return retVal;
-}
-
 static uint8_t rs485_get_next_state(rs485_state_machine_data_t *data, uint8_t next_event)
 {
 	uint8_t next_state;
@@ -385,6 +764,21 @@ static uint8_t rs485_get_next_state(rs485_state_machine_data_t *data, uint8_t ne
 	return next_state;
 }
 
+/* a shared tick may have moved several steps since the last run when the bus was left idle */
+static void rs485_tick_update(rs485_t *me)
+{
+	uint32_t elapsed = 1U;
+	if(me->_tick_source != NULL){
+		me->_tick_count = *me->_tick_source;
+		elapsed = me->_tick_count - me->_run_tick;
+		me->_run_tick = me->_tick_count;
+	}else{
+		me->_tick_count++;
+	}
+	me->_telemetry.total_ticks += elapsed;
+	me->_telemetry.state_ticks[me->sm_data.cur_state] += elapsed;
+}
+
 static uint8_t rs485_process_input(rs485_state_machine_data_t *data)
 {
 	/*
@@ -398,7 +792,11 @@ static uint8_t rs485_process_input(rs485_state_machine_data_t *data)
 	if(data->common->_is_bus_running == false){
 		return ev_ret;
 	}
-	data->common->_tick_count++;
+	rs485_tick_update(data->common);
+	if(true == data->common->_rx_activity){
+		data->common->_rx_activity = false;
+		data->common->_telemetry.busy_ticks++;
+	}
 	if(true == rs485_frame_avaiable(data->common)){
 		ev_ret = RS485_EVENT_FRAME;
 	}else if(data->internal_event < RS485_EVENT_NONE){
@@ -413,8 +811,10 @@ static uint8_t rs485_process_input(rs485_state_machine_data_t *data)
 
 static void rs485_state_machine_run(rs485_state_machine_data_t *data)
 {
+	const rs485StateFunctions *state_fp = rs485stateFunctions[data->common->bus_mode];
 	uint8_t event = RS485_EVENT_NONE;
 	uint8_t next_state;
+	rs485Action action;
 	event = rs485_process_input(data);
 	if(RS485_EVENT_NONE != event)
 	{
@@ -422,34 +822,35 @@ static void rs485_state_machine_run(rs485_state_machine_data_t *data)
 		if(RS485_EVENT_INIT == event)
 		{
 			data->cur_state = next_state;
-			rs485_get_state_fp(data, data->cur_state)->entry(data);
+			data->cur_substate = 0;
+			state_fp[data->cur_state].entry(data);
 		}else
 		{
 			if(next_state != data->cur_state)
 			{
+				if(data->common->_trace != NULL){
+					rs485_trace_frame(data->common, RS485_TRACE_STATE, data->cur_state, data->common->_tick_count, next_state, event, NULL, 0);
+				}
 				//state transiton process : exit current state and entry next state
-				rs485_get_state_fp(data, data->cur_state)->exit(data);
+				state_fp[data->cur_state].exit(data);
 				data->cur_state = next_state;
-				rs485_get_state_fp(data, data->cur_state)->entry(data);
+				data->cur_substate = 0;
+				state_fp[data->cur_state].entry(data);
 			}
 		}
 	}
-	rs485_get_state_fp(data, data->cur_state)->state(data,event);
-}
-/************************************ Rs485 State function ****************************************/
-///////////////////////////// MASTER PROCESS ///////////////////////////////////////
-// INIT
-void Rs485StateInit(rs485_state_machine_data_t *data, uint8_t event)
-{
-	switch(event)
+	action = rs485ActionTable[data->common->bus_mode][data->cur_state][data->cur_substate][event];
+	if(action != NULL)
 	{
-		case RS485_EVENT_FRAME:
-			rs485_state_transition(data, RS485_IDLE_STATE);
-			break;
-		default:
-			break;
+		action(data);
 	}
 }
+/************************************ Rs485 State function ****************************************/
+/*
+ * entry / exit run on state transitions, actions are looked up in rs485ActionTable[bus_mode][state][substate][event].
+ * a NULL action : the event is ignored in that substate.
+ */
+// INIT
 void Rs485StateInitEntry(rs485_state_machine_data_t *data)
 {
 	;
@@ -458,10 +859,34 @@ void Rs485StateInitExit(rs485_state_machine_data_t *data)
 {
 	;
 }
+static void Rs485InitFrame(rs485_state_machine_data_t *data)
+{
+	rs485_state_transition(data, RS485_IDLE_STATE);
+}
+
+// POL : shared by master (send POL, wait reply) and slave (send reply, wait ACK)
+static void Rs485PollSend(rs485_state_machine_data_t *data)
+{
+	rs485_tx_current_frame(data->common);
+	data->cur_substate = POLL_SEND_WAIT;
+}
+static void Rs485PollSent(rs485_state_machine_data_t *data)
+{
+	data->cur_substate = POLL_REPLY_WAIT;
+	rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
+}
 
 ///////////////////////////// MASTER PROCESS ///////////////////////////////////////
 // IDLE
-void Rs485MasterStateIdle(rs485_state_machine_data_t *data, uint8_t event)
+void Rs485MasterStateIdleEntry(rs485_state_machine_data_t *data)
+{
+	;
+}
+void Rs485MasterStateIdleExit(rs485_state_machine_data_t *data)
+{
+	rs485_timer_clear(data,&data->timer);
+}
+static void Rs485MasterIdleRun(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
 	if(true == rs485_go_next_channel(data->common))
@@ -474,12 +899,19 @@ void Rs485MasterStateIdle(rs485_state_machine_data_t *data, uint8_t event)
 				break;
 			case RS485_CHANNEL_OFFLINE_STATE:
 				if(true == rs485_timer_timeout(data, &cur_channel->_sync_timer)){
-					rs485_timer_start(data,&cur_channel->_sync_timer,RS485_US_TO_TICKS(RS485_CHANNEL_OFFLINE_SYNC_DURATION_US));
+					/* next probe in case this one is not answered either */
+					cur_channel->_backoff_us <<= 1;
+					if(cur_channel->_backoff_us > cur_channel->backoff.max_us){
+						cur_channel->_backoff_us = cur_channel->backoff.max_us;
+					}
+					rs485_timer_start(data,&cur_channel->_sync_timer,rs485_backoff_ticks(data->common,cur_channel));
 					rs485_state_transition(data, RS485_POLL_STATE);
 				}
 				break;
 			case RS485_CHANNEL_ONLINE_STATE:
-				if((true == cur_channel->is_sellect_active) && (BUFFER_NOT_EMPTY == ring_buffer_is_empty(&cur_channel->txPacket_rb)) && ((false == cur_channel->is_pre_sellect) || (false == cur_channel->is_poll_active))){
+				if(true == rs485_baud_is_pending(data->common, cur_channel)){
+					rs485_state_transition(data, RS485_SELLECT_STATE);
+				}else if((true == cur_channel->is_sellect_active) && (BUFFER_NOT_EMPTY == ring_buffer_is_empty(&cur_channel->txPacket_rb)) && ((false == cur_channel->is_pre_sellect) || (false == cur_channel->is_poll_active))){
 					rs485_state_transition(data, RS485_SELLECT_STATE);
 					cur_channel->is_pre_sellect = true;
 				}else{
@@ -503,204 +935,172 @@ void Rs485MasterStateIdle(rs485_state_machine_data_t *data, uint8_t event)
 		}
 	}
 }
-void Rs485MasterStateIdleEntry(rs485_state_machine_data_t *data)
+
+// POL
+void Rs485MasterStatePollEntry(rs485_state_machine_data_t *data)
 {
-	;
+	rs485_channel_t *cur_channel;
+
+	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
+	rs485_baud_apply(data->common, cur_channel->baud);
+	data->common->tx_packet.address = cur_channel->address;
+	rs485_tx_prepare(data->common,POLL_FRAME,false);
+	data->cur_substate = POLL_SEND_DELAY;
+	rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_POLL_DELAY_US));
+
 }
-void Rs485MasterStateIdleExit(rs485_state_machine_data_t *data)
+void Rs485MasterStatePollExit(rs485_state_machine_data_t *data)
 {
 	rs485_timer_clear(data,&data->timer);
 }
-
-// POL
-void Rs485MasterStatePoll(rs485_state_machine_data_t *data, uint8_t event)
+static void Rs485MasterPollReply(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
 	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
-	switch(data->cur_poll_state)
+	if(cur_channel->state != RS485_CHANNEL_ONLINE_STATE)
 	{
-		case POLL_SEND_DELAY:
-			switch(event)
-			{
-				case RS485_EVENT_TIMEOUT:
-					rs485_tx_current_frame(data->common);
-					data->cur_poll_state = POLL_SEND_WAIT;
-					break;
-				default:
-					break;
-			}
+		rs485_channel_state_transition(data,RS485_CHANNEL_ONLINE_STATE);
+	}
+	cur_channel->_not_respond_count = 0;
+	cur_channel->_baud_err_count = 0;
+	rs485_latency_record(data->common, cur_channel);
+	switch(data->common->_cur_rxframe)
+	{
+		case EOT_FRAME:
+			rs485_state_transition(data, RS485_IDLE_STATE);
 			break;
-		case POLL_SEND_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_LOOPBACK:
-					data->cur_poll_state = POLL_REPLY_WAIT;
-					rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
-					break;
-				default:
-					break;
+		case RESPOND_FRAME:
+			rs485_diagnostic_count(data,cur_channel,BUS_MSG_COUNT);
+			if(cur_channel->address == data->common->rx_view.address){
+				rs485_rx_packet_put(data->common, cur_channel);
+				data->cur_substate = POLL_SEND_ACK_DELAY;
+				rs485_tx_prepare(data->common,ACK_FRAME,false);
+				rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
+			}else{
+				rs485_diagnostic_count(data,cur_channel,SLAVE_ERR_COUNT);
+				rs485_state_transition(data, RS485_IDLE_STATE);
 			}
 			break;
-		case POLL_REPLY_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_FRAME:
-					if(cur_channel->state != RS485_CHANNEL_ONLINE_STATE)
-					{
-						rs485_channel_state_transition(data,RS485_CHANNEL_ONLINE_STATE);
-					}
-					cur_channel->_not_respond_count = 0;
-					switch(data->common->_cur_rxframe)
-					{
-						case EOT_FRAME:
-							rs485_state_transition(data, RS485_IDLE_STATE);
-							break;
-						case RESPOND_FRAME:
-							rs485_diagnostic_count(data,BUS_MSG_COUNT);
-							if(cur_channel->address == data->common->rx_packet.address){
-								ring_buffer_put(&cur_channel->rxPacket_rb, &data->common->rx_packet);
-								data->cur_poll_state = POLL_SEND_ACK_DELAY;
-								rs485_tx_prepare(data->common,ACK_FRAME,false);
-								rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
-							}else{
-								rs485_state_transition(data, RS485_IDLE_STATE);
-							}
-							break;
-						case ERROR_FRAME:
-							rs485_diagnostic_count(data,BUS_ERR_COUNT);
-							rs485_tx_prepare(data->common,NACK_FRAME,false);
-							data->cur_poll_state = POLL_SEND_ACK_DELAY;
-							rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
-							break;
-						default:
-//							rs485_state_transition(data, RS485_IDLE_STATE);
-							break;
-					}
-					break;
-				case RS485_EVENT_TIMEOUT:
-					cur_channel->_not_respond_count++;
-					if(cur_channel->_not_respond_count > RS485_CHANNEL_NOT_RESPONSE_THRESHOLD){
-						rs485_channel_state_transition(data,RS485_CHANNEL_OFFLINE_STATE);
-					}
-					rs485_state_transition(data, RS485_IDLE_STATE);
-					break;
-				default:
-					break;
-			}
-			break;
-		case POLL_SEND_ACK_DELAY:
-			switch(event)
-			{
-				case RS485_EVENT_TIMEOUT:
-					rs485_tx_current_frame(data->common);
-					data->cur_poll_state = POLL_REPLY_WAIT;
-					rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
-					break;
-				default:
-					break;
-			}
+		case ERROR_FRAME:
+			rs485_diagnostic_count(data,cur_channel,BUS_ERR_COUNT);
+			rs485_tx_prepare(data->common,NACK_FRAME,false);
+			data->cur_substate = POLL_SEND_ACK_DELAY;
+			rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
 			break;
 		default:
+//			rs485_state_transition(data, RS485_IDLE_STATE);
 			break;
 	}
 }
-void Rs485MasterStatePollEntry(rs485_state_machine_data_t *data)
+static void Rs485MasterPollNoReply(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
+	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
+	rs485_diagnostic_count(data,cur_channel,SLAVE_NO_RESP_COUNT);
+	rs485_baud_error(cur_channel);
+	cur_channel->_not_respond_count++;
+	if(cur_channel->_not_respond_count > RS485_CHANNEL_NOT_RESPONSE_THRESHOLD){
+		rs485_channel_state_transition(data,RS485_CHANNEL_OFFLINE_STATE);
+	}
+	rs485_state_transition(data, RS485_IDLE_STATE);
+}
+static void Rs485MasterPollSendAck(rs485_state_machine_data_t *data)
+{
+	rs485_tx_current_frame(data->common);
+	data->cur_substate = POLL_REPLY_WAIT;
+	rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
+}
 
+// SELLECT
+void Rs485MasterStateSellectEntry(rs485_state_machine_data_t *data)
+{
+	rs485_channel_t *cur_channel;
+	data->cur_substate = SELLECT_SEND_WAIT;
 	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
+	rs485_baud_apply(data->common, cur_channel->baud);
+	if(true == rs485_baud_is_pending(data->common, cur_channel)){
+		/* rate proposal, sent at the current rate */
+		data->common->tx_packet.opcode 	= RS485_OPCODE_BAUD;
+		data->common->tx_packet.length 	= 4;
+		data->common->tx_packet.data[0] = (uint8_t)(cur_channel->baud_max);
+		data->common->tx_packet.data[1] = (uint8_t)(cur_channel->baud_max >> 8);
+		data->common->tx_packet.data[2] = (uint8_t)(cur_channel->baud_max >> 16);
+		data->common->tx_packet.data[3] = (uint8_t)(cur_channel->baud_max >> 24);
+	}else{
+		ring_buffer_get(&cur_channel->txPacket_rb, &data->common->tx_packet);
+		cur_channel->_tx_get++;
+	}
 	data->common->tx_packet.address = cur_channel->address;
-	rs485_tx_prepare(data->common,POLL_FRAME,false);
-	data->cur_poll_state = POLL_SEND_DELAY;
-	rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_POLL_DELAY_US));
-
+	cur_channel->_retry_count = 0;
+	rs485_tx_prepare(data->common,SELLECT_FRAME,true);
+	rs485_diagnostic_count(data,cur_channel,BUS_MSG_COUNT);
 }
-void Rs485MasterStatePollExit(rs485_state_machine_data_t *data)
+void Rs485MasterStateSellectExit(rs485_state_machine_data_t *data)
 {
 	rs485_timer_clear(data,&data->timer);
-	data->cur_poll_state = POLL_SEND_DELAY;
 }
-
-// SELLECT
-void Rs485MasterStateSellect(rs485_state_machine_data_t *data, uint8_t event)
+static void Rs485MasterSellectSent(rs485_state_machine_data_t *data)
+{
+	data->cur_substate = SELLECT_REPLY_ACK_WAIT;
+	rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
+}
+static void Rs485MasterSellectReply(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
 	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
-	switch(data->cur_sellect_state)
+	switch(data->common->_cur_rxframe)
 	{
-		case SELLECT_SEND_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_LOOPBACK:
-					data->cur_sellect_state = SELLECT_REPLY_ACK_WAIT;
-					rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
-					break;
-				default:
-					break;
+		case ACK_FRAME:
+			rs485_latency_record(data->common, cur_channel);
+			rs485_retry_record(cur_channel, false);
+			cur_channel->_baud_err_count = 0;
+			if(RS485_OPCODE_BAUD == data->common->tx_packet.opcode){
+				/* switched on the next transaction with this slave, a legacy slave ACKs too and falls back on errors */
+				cur_channel->baud = cur_channel->baud_max;
 			}
+			rs485_state_transition(data, RS485_IDLE_STATE);
 			break;
-		case SELLECT_REPLY_ACK_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_FRAME:
-					switch(data->common->_cur_rxframe)
-					{
-						case ACK_FRAME:
-							rs485_state_transition(data, RS485_IDLE_STATE);
-							break;
-						case NACK_FRAME:
-							cur_channel->_retry_count++;
-							if(cur_channel->_retry_count > MAX_RETRY_NUMBER){
-								rs485_state_transition(data, RS485_IDLE_STATE);
-							}else{
-								rs485_tx_current_frame(data->common);
-								data->cur_sellect_state = SELLECT_SEND_WAIT;
-							}
-							rs485_diagnostic_count(data,BUS_ERR_COUNT);
-							break;
-						default:
-//							rs485_state_transition(data, RS485_IDLE_STATE);
-							break;
-					}
-					break;
-				case RS485_EVENT_TIMEOUT:
-					rs485_diagnostic_count(data,BUS_OVERRUN_COUNT);
-					rs485_state_transition(data, RS485_IDLE_STATE);
-					break;
-				default:
-					break;
+		case NACK_FRAME:
+			rs485_latency_record(data->common, cur_channel);
+			if(RS485_OPCODE_BAUD == data->common->tx_packet.opcode){
+				/* refused : final, a retry would get the same answer */
+				rs485_retry_record(cur_channel, false);
+				cur_channel->baud_max = cur_channel->baud;
+				rs485_state_transition(data, RS485_IDLE_STATE);
+				rs485_diagnostic_count(data,cur_channel,SLAVE_NAK_COUNT);
+				break;
 			}
+			cur_channel->_retry_count++;
+			if(cur_channel->_retry_count > MAX_RETRY_NUMBER){
+				rs485_retry_record(cur_channel, true);
+				rs485_state_transition(data, RS485_IDLE_STATE);
+			}else{
+				rs485_tx_current_frame(data->common);
+				data->cur_substate = SELLECT_SEND_WAIT;
+			}
+			rs485_diagnostic_count(data,cur_channel,SLAVE_NAK_COUNT);
 			break;
 		default:
+//			rs485_state_transition(data, RS485_IDLE_STATE);
 			break;
 	}
 }
-void Rs485MasterStateSellectEntry(rs485_state_machine_data_t *data)
+static void Rs485MasterSellectNoReply(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
-	data->cur_sellect_state = SELLECT_SEND_WAIT;
 	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
-	ring_buffer_get(&cur_channel->txPacket_rb, &data->common->tx_packet);
-	data->common->tx_packet.address = cur_channel->address;
-	cur_channel->_retry_count = 0;
-	rs485_tx_prepare(data->common,SELLECT_FRAME,true);
-	rs485_diagnostic_count(data,BUS_MSG_COUNT);
-}
-void Rs485MasterStateSellectExit(rs485_state_machine_data_t *data)
-{
-	data->cur_sellect_state = SELLECT_SEND_WAIT;
-	rs485_timer_clear(data,&data->timer);
+	rs485_diagnostic_count(data,cur_channel,BUS_OVERRUN_COUNT);
+	rs485_diagnostic_count(data,cur_channel,SLAVE_NO_RESP_COUNT);
+	rs485_retry_record(cur_channel, true);
+	if(RS485_OPCODE_BAUD == data->common->tx_packet.opcode){
+		cur_channel->baud_max = cur_channel->baud;
+	}
+	rs485_baud_error(cur_channel);
+	rs485_state_transition(data, RS485_IDLE_STATE);
 }
 
 ///////////////////////////// SLAVE PROCESS ///////////////////////////////////////
-
-void Rs485SlaveStateIdle(rs485_state_machine_data_t *data, uint8_t event)
-{
-	rs485_channel_t *cur_channel;
-	cur_channel = data->common->channel_list[0];
-	rs485_state_transition(data, RS485_SELLECT_STATE);
-	rs485_timer_start(data,&cur_channel->_sync_timer,RS485_US_TO_TICKS(RS485_CHANNEL_ONLINE_SYNC_DURATION_US));
-}
+// IDLE
 void Rs485SlaveStateIdleEntry(rs485_state_machine_data_t *data)
 {
 	;
@@ -709,227 +1109,236 @@ void Rs485SlaveStateIdleExit(rs485_state_machine_data_t *data)
 {
 	;
 }
-
-void Rs485SlaveStatePoll(rs485_state_machine_data_t *data, uint8_t event)
+static void Rs485SlaveIdleRun(rs485_state_machine_data_t *data)
 {
-	rs485_channel_t *cur_channel;
-	cur_channel = data->common->channel_list[0];
-	switch(data->cur_poll_state)
+	uint8_t i;
+	rs485_state_transition(data, RS485_SELLECT_STATE);
+	for(i = 0; i < RS485_MAX_CHANNEL_NUMBER; i++)
 	{
-		case POLL_SEND_DELAY:
-			switch(event)
-			{
-				case RS485_EVENT_TIMEOUT:
-					rs485_tx_current_frame(data->common);
-					data->cur_poll_state = POLL_SEND_WAIT;
-					break;
-				default:
-					break;
-			}
-			break;
-		case POLL_SEND_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_LOOPBACK:
-					data->cur_poll_state = POLL_REPLY_WAIT;
-					rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_WAIT_US));
-					break;
-				default:
-					break;
-			}
-			break;
-		case POLL_REPLY_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_FRAME:
-					switch(data->common->_cur_rxframe)
-					{
-						case ACK_FRAME:
-							rs485_tx_prepare(data->common,EOT_FRAME,false);
-							data->cur_poll_state = POLL_SEND_ACK_DELAY;
-							rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
-							break;
-						case NACK_FRAME:
-							cur_channel->_retry_count++;
-							if(cur_channel->_retry_count > MAX_RETRY_NUMBER){
-								rs485_tx_prepare(data->common,EOT_FRAME,false);
-								data->cur_poll_state = POLL_SEND_ACK_DELAY;
-								rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
-							}else{
-								rs485_tx_current_frame(data->common);
-								data->cur_poll_state = POLL_SEND_WAIT;
-							}
-							break;
-						case POLL_FRAME:
-						case SELLECT_FRAME:
-						case RESPOND_FRAME:
-							rs485_state_transition(data, RS485_SELLECT_STATE);
-							break;
-						case ERROR_FRAME:
-						default:
-							//rs485_state_transition(data, RS485_SELLECT_STATE);
-							break;
-					}
-					break;
-				case RS485_EVENT_TIMEOUT:
-					cur_channel->_not_respond_count++;
-					rs485_state_transition(data, RS485_SELLECT_STATE);
-					break;
-				default:
-					break;
-			}
-			break;
-		case POLL_SEND_ACK_DELAY:
-			switch(event)
-			{
-				case RS485_EVENT_TIMEOUT:
-					rs485_tx_current_frame(data->common);
-					data->cur_poll_state = POLL_SEND_ACK_WAIT;
-					break;
-				case RS485_EVENT_FRAME:
-					rs485_state_transition(data, RS485_SELLECT_STATE);
-					break;
-				default:
-					break;
-			}
-			break;
-		case POLL_SEND_ACK_WAIT:
-			switch(event)
-			{
-				case RS485_EVENT_FRAME:
-				case RS485_EVENT_LOOPBACK:
-				case RS485_EVENT_TIMEOUT:
-					rs485_state_transition(data, RS485_SELLECT_STATE);
-					break;
-				default:
-					break;
-			}
-			break;
-		default:
-			break;
+		if(data->common->channel_list[i] != NULL){
+			rs485_timer_start(data,&data->common->channel_list[i]->_sync_timer,RS485_US_TO_TICKS(RS485_CHANNEL_ONLINE_SYNC_DURATION_US));
+		}
 	}
 }
+
+// POL
 void Rs485SlaveStatePollEntry(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
-	cur_channel = data->common->channel_list[0];
-	if((true == cur_channel->is_poll_active) && (false == ring_buffer_is_empty(&cur_channel->txPacket_rb)))
+	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
+	/* normally staged already, framed here only when queued since the last tick */
+	rs485_response_stage(data->common, cur_channel);
+	if((cur_channel->_staged != NULL) && (RS485_STAGED_READY == cur_channel->_staged->state))
 	{
-		ring_buffer_get(&cur_channel->txPacket_rb, &data->common->tx_packet);
-		data->common->tx_packet.address = data->common->address;
+		if(rs485_channel_rx_address(data->common, cur_channel) != cur_channel->address){
+			/* polled on the deviceID : framed again with the SA received */
+			cur_channel->_staged->packet.address = data->common->rx_view.address;
+			rs485_response_frame(data->common, cur_channel->_staged);
+		}
+		rs485_tx_handoff(data->common, cur_channel->_staged);
 		cur_channel->_retry_count = 0;
-		rs485_tx_prepare(data->common,RESPOND_FRAME,false);
-		data->cur_poll_state = POLL_SEND_DELAY;
+		data->cur_substate = POLL_SEND_DELAY;
 		rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
 	}else{
 		rs485_tx_prepare(data->common,EOT_FRAME,false);
-		data->cur_poll_state = POLL_SEND_ACK_DELAY;
+		data->cur_substate = POLL_SEND_ACK_DELAY;
 		rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
 	}
 }
 void Rs485SlaveStatePollExit(rs485_state_machine_data_t *data)
 {
-	data->cur_poll_state = POLL_SEND_DELAY;
+	rs485_channel_t *cur_channel;
+	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
 	rs485_timer_clear(data,&data->timer);
+	if((cur_channel->_staged != NULL) && (RS485_STAGED_IN_USE == cur_channel->_staged->state)){
+		cur_channel->_staged->state = RS485_STAGED_EMPTY;
+		rs485_response_stage(data->common, cur_channel);
+	}
+}
+static void Rs485SlavePollReply(rs485_state_machine_data_t *data)
+{
+	rs485_channel_t *cur_channel;
+	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
+	switch(data->common->_cur_rxframe)
+	{
+		case ACK_FRAME:
+			rs485_latency_record(data->common, cur_channel);
+			rs485_retry_record(cur_channel, false);
+			rs485_tx_prepare(data->common,EOT_FRAME,false);
+			data->cur_substate = POLL_SEND_ACK_DELAY;
+			rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
+			break;
+		case NACK_FRAME:
+			rs485_latency_record(data->common, cur_channel);
+			rs485_diagnostic_count(data,cur_channel,SLAVE_NAK_COUNT);
+			cur_channel->_retry_count++;
+			if(cur_channel->_retry_count > MAX_RETRY_NUMBER){
+				rs485_retry_record(cur_channel, true);
+				rs485_tx_prepare(data->common,EOT_FRAME,false);
+				data->cur_substate = POLL_SEND_ACK_DELAY;
+				rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
+			}else{
+				rs485_tx_current_frame(data->common);
+				data->cur_substate = POLL_SEND_WAIT;
+			}
+			break;
+		case POLL_FRAME:
+		case SELLECT_FRAME:
+		case RESPOND_FRAME:
+			rs485_state_transition(data, RS485_SELLECT_STATE);
+			break;
+		case ERROR_FRAME:
+		default:
+			//rs485_state_transition(data, RS485_SELLECT_STATE);
+			break;
+	}
+}
+static void Rs485SlavePollNoReply(rs485_state_machine_data_t *data)
+{
+	rs485_channel_t *cur_channel;
+	cur_channel = data->common->channel_list[data->common->_cur_channel_id];
+	rs485_diagnostic_count(data,cur_channel,SLAVE_NO_RESP_COUNT);
+	rs485_retry_record(cur_channel, true);
+	cur_channel->_not_respond_count++;
+	rs485_state_transition(data, RS485_SELLECT_STATE);
+}
+static void Rs485SlavePollSendEot(rs485_state_machine_data_t *data)
+{
+	rs485_tx_current_frame(data->common);
+	data->cur_substate = POLL_SEND_ACK_WAIT;
+}
+static void Rs485SlavePollDone(rs485_state_machine_data_t *data)
+{
+	rs485_state_transition(data, RS485_SELLECT_STATE);
 }
 
-void Rs485SlaveStateSellect(rs485_state_machine_data_t *data, uint8_t event)
+// SELLECT
+void Rs485SlaveStateSellectEntry(rs485_state_machine_data_t *data)
+{
+	data->cur_substate = SELLECT_RECEIVE_WAIT;
+}
+void Rs485SlaveStateSellectExit(rs485_state_machine_data_t *data)
+{
+	rs485_timer_clear(data,&data->timer);
+}
+/* no poll from the master for RS485_CHANNEL_ONLINE_SYNC_DURATION_US */
+static void Rs485SlaveSellectSync(rs485_state_machine_data_t *data)
+{
+	rs485_channel_t *channel;
+	bool is_lost = false;
+	uint8_t i;
+	for(i = 0; i < RS485_MAX_CHANNEL_NUMBER; i++)
+	{
+		channel = data->common->channel_list[i];
+		if(channel == NULL){
+			continue;
+		}
+		if(true == rs485_timer_timeout(data, &channel->_sync_timer)){
+			rs485_timer_clear(data,&channel->_sync_timer);
+			channel->state = RS485_CHANNEL_OFFLINE_STATE;
+			is_lost = true;
+		}
+		rs485_response_stage(data->common, channel);
+	}
+	if((true == is_lost) && (RS485_DEFAULT_BAUD != data->common->_baud)){
+		/* master gave up on our rate or was restarted : listen where it starts again */
+		for(i = 0; i < RS485_MAX_CHANNEL_NUMBER; i++)
+		{
+			channel = data->common->channel_list[i];
+			if((channel != NULL) && (RS485_CHANNEL_ONLINE_STATE == channel->state)){
+				return;
+			}
+		}
+		rs485_baud_apply(data->common, RS485_DEFAULT_BAUD);
+	}
+}
+static void Rs485SlaveSellectReceive(rs485_state_machine_data_t *data)
 {
 	rs485_channel_t *cur_channel;
 	address_valid_t address_valid;
-	cur_channel = data->common->channel_list[0];
-	if(true == rs485_timer_timeout(data, &cur_channel->_sync_timer)){
-		cur_channel->state = RS485_CHANNEL_OFFLINE_STATE;
+	uint8_t channel_id;
+	/* SA(1B) : one lookup finds the logical slave, frames for other slaves on the bus end here */
+	channel_id = data->common->address_map[data->common->rx_view.address];
+	if(channel_id >= RS485_INVALID_CHANNEL_ID){
+		return;
 	}
-	switch(data->cur_sellect_state)
+	data->common->_cur_channel_id = channel_id;
+	cur_channel = data->common->channel_list[channel_id];
+	switch(data->common->_cur_rxframe)
 	{
-		case SELLECT_RECEIVE_WAIT:
-			switch(event)
+		case POLL_FRAME:
+			/* Polling masssage*/
+			/* EOT(1B) | SA(1B) | POL(1B) */
+			/* SA(1B) : slave address check valid*/
+			address_valid = rs485_address_validate(rs485_channel_rx_address(data->common, cur_channel), data->common->rx_view.address);
+			if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true) && (address_valid.is_reply == true))
 			{
-				case RS485_EVENT_FRAME:
-					switch(data->common->_cur_rxframe)
+				if(cur_channel->state != RS485_CHANNEL_ONLINE_STATE){
+					cur_channel->state = RS485_CHANNEL_ONLINE_STATE;
+				}
+				rs485_state_transition(data, RS485_POLL_STATE);
+				rs485_timer_start(data,&cur_channel->_sync_timer,RS485_US_TO_TICKS(RS485_CHANNEL_ONLINE_SYNC_DURATION_US));
+			}else{
+
+			}
+			break;
+		case SELLECT_FRAME:
+			/* Sellecting masssage*/
+			/* EOT(1B) | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B) */
+			/* SA(1B) : slave address check valid*/
+			address_valid = rs485_address_validate(rs485_channel_rx_address(data->common, cur_channel), data->common->rx_view.address);
+			if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true))
+			{
+				if(RS485_OPCODE_BAUD == data->common->rx_view.opcode)
+				{
+					/* rate proposal : answered here, not queued for the application */
+					if(address_valid.is_reply == true)
 					{
-						case POLL_FRAME:
-							/* Polling masssage*/
-							/* EOT(1B) | SA(1B) | POL(1B) */
-							/* SA(1B) : slave address check valid*/
-							address_valid = rs485_address_validate(data->common->address, data->common->rx_packet.address);
-							if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true) && (address_valid.is_reply == true))
-							{
-								if(cur_channel->state != RS485_CHANNEL_ONLINE_STATE){
-									cur_channel->state = RS485_CHANNEL_ONLINE_STATE;
-								}
-								rs485_state_transition(data, RS485_POLL_STATE);
-								rs485_timer_start(data,&cur_channel->_sync_timer,RS485_US_TO_TICKS(RS485_CHANNEL_ONLINE_SYNC_DURATION_US));
-							}else{
-
-							}
-							break;
-						case SELLECT_FRAME:
-							/* Sellecting masssage*/
-							/* EOT(1B) | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B) */
-							/* SA(1B) : slave address check valid*/
-							address_valid = rs485_address_validate(data->common->address, data->common->rx_packet.address);
-							if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true))
-							{
-								ring_buffer_put(&cur_channel->rxPacket_rb, &data->common->rx_packet);
-								if(address_valid.is_reply == true)
-								{
-									rs485_tx_prepare(data->common,ACK_FRAME,false);
-									data->cur_sellect_state = SELLECT_SEND_ACK_DELAY;
-									rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
-								}
-							}
-							break;
-						case ERROR_FRAME:
-							/* Sellecting masssage*/
-							/* EOT(1B) | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B) */
-							/* SA(1B) : slave address check valid*/
-							address_valid = rs485_address_validate(data->common->address, data->common->rx_packet.address);
-							if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true))
-							{
-								if(address_valid.is_reply == true)
-								{
-									rs485_tx_prepare(data->common,NACK_FRAME,false);
-									data->cur_sellect_state = SELLECT_SEND_ACK_DELAY;
-									rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
-								}
-							}
-							break;
-						default:
-							break;
+						rs485_tx_prepare(data->common,(true == rs485_baud_accept(data->common)) ? ACK_FRAME : NACK_FRAME,false);
+						data->cur_substate = SELLECT_SEND_ACK_DELAY;
+						rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
 					}
 					break;
-				default:
-					break;
+				}
+				rs485_diagnostic_count(data,cur_channel,SLAVE_MSG_COUNT);
+				rs485_rx_packet_put(data->common, cur_channel);
+				if(address_valid.is_reply == true)
+				{
+					rs485_tx_prepare(data->common,ACK_FRAME,false);
+					data->cur_substate = SELLECT_SEND_ACK_DELAY;
+					rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
+				}
 			}
 			break;
-		case SELLECT_SEND_ACK_DELAY:
-			switch(event)
+		case ERROR_FRAME:
+			/* Sellecting masssage*/
+			/* EOT(1B) | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B) */
+			/* SA(1B) : slave address check valid*/
+			address_valid = rs485_address_validate(rs485_channel_rx_address(data->common, cur_channel), data->common->rx_view.address);
+			if((address_valid.device_type_valid == true) && (address_valid.physical_addr_valid == true))
 			{
-				case RS485_EVENT_TIMEOUT:
-					rs485_tx_current_frame(data->common);
-					data->cur_sellect_state = SELLECT_RECEIVE_WAIT;
-					break;
-				case RS485_EVENT_FRAME:
-					data->cur_sellect_state = SELLECT_RECEIVE_WAIT;
-					rs485_timer_clear(data,&data->timer);
-					break;
-				default:
-					break;
+				rs485_diagnostic_count(data,cur_channel,SLAVE_ERR_COUNT);
+				if(address_valid.is_reply == true)
+				{
+					rs485_tx_prepare(data->common,NACK_FRAME,false);
+					data->cur_substate = SELLECT_SEND_ACK_DELAY;
+					rs485_timer_start(data,&data->timer,RS485_US_TO_TICKS(RS485_REPLY_DELAY_US));
+				}
 			}
 			break;
 		default:
 			break;
 	}
 }
-void Rs485SlaveStateSellectEntry(rs485_state_machine_data_t *data)
+static void Rs485SlaveSellectSendAck(rs485_state_machine_data_t *data)
 {
-	data->cur_sellect_state = SELLECT_RECEIVE_WAIT;
+	rs485_tx_current_frame(data->common);
+	data->cur_substate = SELLECT_RECEIVE_WAIT;
 }
-void Rs485SlaveStateSellectExit(rs485_state_machine_data_t *data)
+static void Rs485SlaveSellectCancelAck(rs485_state_machine_data_t *data)
 {
-	data->cur_sellect_state = SELLECT_RECEIVE_WAIT;
+	/* master went on before our reply */
+	data->cur_substate = SELLECT_RECEIVE_WAIT;
 	rs485_timer_clear(data,&data->timer);
 }
 
@@ -949,22 +1358,50 @@ void rs485_init(rs485_t *me, rs485IF_t *meIF, uint8_t deviceID, rs485_bus_mode_e
     {
     	me->channel_list[i] = NULL;
     }
+    memset(me->address_map, RS485_INVALID_CHANNEL_ID, sizeof(me->address_map));
     me->_tick_count 	= 0;
+    me->_tick_source 	= NULL;
+    me->_trace 			= NULL;
+    me->_tx_packet_p 	= &me->tx_packet;
+    me->_txframe_p 		= me->txframe;
+    me->_tx_builder_p 	= &me->tx_builder;
+    me->_rx_start_tick 	= 0;
+    me->_run_tick 		= 0;
     me->_is_bus_running	= false;
     me->_cur_channel_id = RS485_MAX_CHANNEL_NUMBER;
     me->num_of_channel 	= 0;
     me->_loopback_flag 	= false;
+    me->_eof_flag 		= false;
+    me->_eof_pending 	= false;
+    me->_rx_activity 	= false;
+    me->_request_tick 	= 0;
+    me->_is_reply_pending = false;
+    me->_rand 			= 0x9E3779B9UL ^ deviceID;
+    me->_baud 			= RS485_DEFAULT_BAUD;
+    me->_baud_max 		= RS485_DEFAULT_BAUD;
+    me->_baud_next 		= 0;
+    me->_t35_ticks 		= RS485_US_TO_TICKS(RS485_T35_DURATION_US);
+    me->_t15_ticks 		= RS485_US_TO_TICKS(RS485_T15_DURATION_US);
+    memset(&me->_diagnostic, 0, sizeof(rs485_diagnostic_t));
+    memset(&me->_telemetry, 0, sizeof(rs485_bus_telemetry_t));
+    /* master : slaves never send EOT-led frames, a lone EOT is a complete reply */
+    packet_parser_init(&me->rx_parser, (MASTER_MODE == bus_mode), me->rx_packet.data);
 
     /*** state mạchine init ****/
     me->sm_data.common				= me;
     me->sm_data.cur_state 			= RS485_INIT_STATE;
-    me->sm_data.cur_poll_state 		= POLL_SEND_WAIT;
-    me->sm_data.cur_sellect_state 	= SELLECT_SEND_WAIT;
+    me->sm_data.cur_substate 		= 0;
     me->sm_data.internal_event 		= RS485_EVENT_INIT;
     me->sm_data.timer 				= 0;
 
 }
 
+/*
+ * master : address = slave polled / sellected on this channel.
+ * slave  : address = SA this channel answers (either mirror bit) and puts in its RESPOND frames.
+ *          while it is the only channel it also answers the deviceID given to rs485_init, as it did
+ *          before channels had addresses, and responds to a POLL on it with the SA received.
+ */
 bool rs485_channel_init(rs485_t *me, uint8_t address, uint8_t *channel_id, bool is_tx_active, bool is_rx_active, uint8_t tx_cache_number, uint8_t rx_cache_number){
 	uint8_t retVal = false;
 	*channel_id = rs485_find_emptyChannel(me);
@@ -974,10 +1411,62 @@ bool rs485_channel_init(rs485_t *me, uint8_t address, uint8_t *channel_id, bool
 	return retVal;
 }
 
+bool rs485_channel_set_backoff(rs485_t *me, uint8_t channel_id, const rs485_backoff_t *backoff)
+{
+	ASSERT((me!=NULL)&&(backoff!=NULL));
+	bool retVal = false;
+	if((channel_id < RS485_MAX_CHANNEL_NUMBER) && (me->channel_list[channel_id] != NULL) &&
+	   (backoff->min_us > 0U) && (backoff->min_us <= backoff->max_us) && (backoff->max_us <= RS485_CHANNEL_OFFLINE_BACKOFF_LIMIT_US) && (backoff->jitter_percent <= 50U))
+	{
+		me->channel_list[channel_id]->backoff = *backoff;
+		retVal = true;
+	}
+	return retVal;
+}
+
+/* master : re-poll an offline channel on the next round, e.g. when the application knows the node was plugged back */
+bool rs485_channel_probe(rs485_t *me, uint8_t channel_id)
+{
+	ASSERT(me!=NULL);
+	bool retVal = false;
+	rs485_channel_t *channel;
+	if((MASTER_MODE == me->bus_mode) && (channel_id < RS485_MAX_CHANNEL_NUMBER) && (me->channel_list[channel_id] != NULL))
+	{
+		channel = me->channel_list[channel_id];
+		if(RS485_CHANNEL_OFFLINE_STATE == channel->state)
+		{
+			channel->_backoff_us = channel->backoff.min_us;
+			rs485_timer_start(&me->sm_data,&channel->_sync_timer,0);
+			retVal = true;
+		}
+	}
+	return retVal;
+}
+
+/* master : propose baud_max to this slave once it is online, needs meIF->set_baud */
+bool rs485_channel_set_baud(rs485_t *me, uint8_t channel_id, uint32_t baud_max)
+{
+	ASSERT(me!=NULL);
+	bool retVal = false;
+	if((MASTER_MODE == me->bus_mode) && (channel_id < RS485_MAX_CHANNEL_NUMBER) && (me->channel_list[channel_id] != NULL) && (baud_max >= RS485_DEFAULT_BAUD))
+	{
+		me->channel_list[channel_id]->baud_max = baud_max;
+		retVal = true;
+	}
+	return retVal;
+}
+
+/* slave : highest rate accepted from the master, RS485_DEFAULT_BAUD (or more than one channel) refuses every proposal */
+void rs485_set_baud_max(rs485_t *me, uint32_t baud_max)
+{
+	ASSERT(me!=NULL);
+	me->_baud_max = baud_max;
+}
+
 bool rs485_bus_start(rs485_t *me)
 {
 	uint8_t retVal = false;
-	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer,RS485_US_TO_TICKS(RS485_T35_DURATION_US));
+	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer,me->_t35_ticks);
 	me->_is_bus_running = true;
 
 	/*** start receive data *****/
@@ -992,12 +1481,19 @@ bool rs485_transmit(rs485_t *me, uint8_t channel_id,  rs485_msg *msg)
     ASSERT(me!=NULL);
     bool retVal = false;
 
-    if((me->channel_list[channel_id] != NULL) && (channel_id < RS485_MAX_CHANNEL_NUMBER) && (RS485_CHANNEL_ONLINE_STATE == rs485_get_channelState(me,channel_id)))
+    if((me->channel_list[channel_id] != NULL) && (channel_id < RS485_MAX_CHANNEL_NUMBER) && (RS485_CHANNEL_ONLINE_STATE == rs485_get_channelState(me,channel_id)) && (RS485_OPCODE_BAUD != msg->opcode) && (msg->length <= MAX_PACKET_LENGTH))
     {
     	if(!ring_buffer_is_full(&me->channel_list[channel_id]->txPacket_rb))
 		{
+    		rs485_channel_t *channel = me->channel_list[channel_id];
+    		uint16_t depth;
     		retVal = true;
-			ring_buffer_put(&me->channel_list[channel_id]->txPacket_rb,msg);
+			ring_buffer_put(&channel->txPacket_rb,msg);
+			channel->_tx_put++;
+			depth = (uint16_t)(channel->_tx_put - channel->_tx_get);
+			if(depth > channel->_telemetry.tx_queue_max){
+				channel->_telemetry.tx_queue_max = (uint8_t)depth;
+			}
 		}
     }
     return retVal;
@@ -1014,6 +1510,7 @@ bool rs485_receive(rs485_t *me, uint8_t channel_id, rs485_msg *msg)
 		{
     		retVal = true;
     		ring_buffer_get(&me->channel_list[channel_id]->rxPacket_rb,msg);
+    		me->channel_list[channel_id]->_rx_get++;
 		}
 	}
     return retVal;
@@ -1037,6 +1534,83 @@ uint8_t rs485_get_channelState(rs485_t *me, uint8_t channel_id)
 	return me->channel_list[channel_id]->state;
 }
 
+/* counters keep running, the snapshot is a plain copy taken from the application context */
+void rs485_get_bus_telemetry(rs485_t *me, rs485_bus_telemetry_t *snapshot)
+{
+	ASSERT((me!=NULL)&&(snapshot!=NULL));
+	*snapshot = me->_telemetry;
+	snapshot->diagnostic = me->_diagnostic;
+	/* left idle on a shared tick : the ticks since the last run are not counted yet, they are spent in the current state */
+	if(me->_tick_source != NULL){
+		uint32_t idle = *me->_tick_source - me->_run_tick;
+		snapshot->total_ticks += idle;
+		snapshot->state_ticks[me->sm_data.cur_state] += idle;
+	}
+}
+
+bool rs485_get_channel_telemetry(rs485_t *me, uint8_t channel_id, rs485_channel_telemetry_t *snapshot)
+{
+	ASSERT((me!=NULL)&&(snapshot!=NULL));
+	bool retVal = false;
+	if((channel_id < RS485_MAX_CHANNEL_NUMBER) && (me->channel_list[channel_id] != NULL))
+	{
+		rs485_channel_t *channel = me->channel_list[channel_id];
+		*snapshot = channel->_telemetry;
+		snapshot->tx_queue_depth = (uint8_t)(channel->_tx_put - channel->_tx_get);
+		snapshot->rx_queue_depth = (uint8_t)(channel->_rx_put - channel->_rx_get);
+		retVal = true;
+	}
+	return retVal;
+}
+
+/* queue depths describe the queues and are kept, everything else restarts from zero */
+void rs485_telemetry_reset(rs485_t *me)
+{
+	ASSERT(me!=NULL);
+	uint8_t i;
+	rs485_channel_telemetry_t *telemetry;
+	memset((void*)&me->_diagnostic, 0, sizeof(rs485_diagnostic_t));
+	memset(&me->_telemetry, 0, sizeof(rs485_bus_telemetry_t));
+	for(i = 0; i < RS485_MAX_CHANNEL_NUMBER; i++)
+	{
+		if(me->channel_list[i] != NULL)
+		{
+			telemetry = &me->channel_list[i]->_telemetry;
+			memset(telemetry->latency_hist, 0, sizeof(telemetry->latency_hist));
+			memset(telemetry->retry_hist, 0, sizeof(telemetry->retry_hist));
+			telemetry->msg_count 		= 0;
+			telemetry->err_count 		= 0;
+			telemetry->no_resp_count 	= 0;
+			telemetry->nak_count 		= 0;
+			telemetry->busy_count 		= 0;
+			telemetry->tx_queue_max 	= (uint8_t)(me->channel_list[i]->_tx_put - me->channel_list[i]->_tx_get);
+			telemetry->rx_queue_max 	= (uint8_t)(me->channel_list[i]->_rx_put - me->channel_list[i]->_rx_get);
+		}
+	}
+}
+
+/* one line per table entry in use : state substate event action address (resolve with the map file) */
+void rs485_state_table_dump(rs485_bus_mode_e bus_mode, void (*print)(const char *const fmt, ...))
+{
+	ASSERT((print!=NULL)&&(bus_mode < RS485_BUS_MODE_NUMBER));
+	uint8_t state, substate, event;
+	rs485Action action;
+	for(state = 0; state < RS485_STATE_END; state++)
+	{
+		print("state %u entry %p exit %p\r\n", state, (void*)rs485stateFunctions[bus_mode][state].entry, (void*)rs485stateFunctions[bus_mode][state].exit);
+		for(substate = 0; substate < RS485_SUBSTATE_NUMBER; substate++)
+		{
+			for(event = 0; event < RS485_EVENT_NUMBER; event++)
+			{
+				action = rs485ActionTable[bus_mode][state][substate][event];
+				if(action != NULL){
+					print("  substate %u event %u : %p\r\n", substate, event, (void*)action);
+				}
+			}
+		}
+	}
+}
+
 /* this process each 250us */
 void rs485_process(rs485_t *me)
 {
@@ -1046,19 +1620,114 @@ void rs485_process(rs485_t *me)
 	}
 }
 
+/*
+ * number of ticks rs485_process can be left out without missing anything : 0 when the bus has to run on the next tick.
+ * only the IDLE states act on RS485_EVENT_NONE, every other state waits for a byte, an internal event or one of its timers.
+ */
+uint32_t rs485_idle_ticks(rs485_t *me)
+{
+	rs485_state_machine_data_t *data = &me->sm_data;
+	uint32_t idle = UINT32_MAX;
+	rs485timer_t timers[3 + RS485_MAX_CHANNEL_NUMBER];
+	uint8_t num_of_timer = 0;
+	uint8_t i;
+	int32_t left;
+
+	if(false == me->_is_bus_running){
+		return idle;
+	}
+	if((data->internal_event < RS485_EVENT_NONE) || (true == me->_eof_flag) || (true == me->_rx_activity) || (RS485_IDLE_STATE == data->cur_state)){
+		return 0;
+	}
+	timers[num_of_timer++] = data->timer;
+	timers[num_of_timer++] = data->_t35_timer;
+	timers[num_of_timer++] = data->_t15_timer;
+	if((SLAVE_MODE == me->bus_mode) && (RS485_SELLECT_STATE == data->cur_state)){
+		for(i = 0; i < RS485_MAX_CHANNEL_NUMBER; i++)
+		{
+			if(me->channel_list[i] != NULL){
+				if((me->channel_list[i]->_staged != NULL) && (RS485_STAGED_EMPTY == me->channel_list[i]->_staged->state) && (false == ring_buffer_is_empty(&me->channel_list[i]->txPacket_rb))){
+					/* response to stage before the next POLL */
+					return 0;
+				}
+				timers[num_of_timer++] = me->channel_list[i]->_sync_timer;
+			}
+		}
+	}
+	for(i = 0; i < num_of_timer; i++)
+	{
+		if(timers[i] != RS485_TIMER_CLEARED){
+			left = timers[i] - me->_tick_count;
+			if(left <= 0){
+				return 0;
+			}
+			if((uint32_t)left < idle){
+				idle = (uint32_t)left;
+			}
+		}
+	}
+	return idle;
+}
+
+/* follow a tick owned by someone else, the bus may then be left out for up to rs485_idle_ticks() ticks */
+void rs485_set_tick_source(rs485_t *me, volatile uint32_t *tick_source)
+{
+	ASSERT(me!=NULL);
+	me->_tick_source = tick_source;
+	if(tick_source != NULL){
+		me->_tick_count = *tick_source;
+		me->_run_tick 	= *tick_source;
+	}
+}
+
+/* capture tx / rx frames and state transitions into trace, NULL stops the capture */
+void rs485_set_trace(rs485_t *me, rs485_trace_t *trace)
+{
+	ASSERT(me!=NULL);
+	me->_trace = trace;
+}
+
 /****************************** callback ***********************************/
 void rs485_RxByte_callback(rs485_t *me)
 {
 	/*
 	 * what we do here?
 	 * 1. fill buffer with rx Byte; increment number of rxbyte
-	 * 2. reset response timeout counter & frame silent interval counter (t3.5)
+	 * 2. flag end of frame as soon as it is known : own echo fully back, or parser saw a whole control frame
+	 *    (an STX-led frame is only pending until t1.5 of silence, see packet_parser_put)
+	 * 3. reset response timeout counter & frame silent interval counter (t3.5, t1.5)
 	 *
 	 * */
     rs485IF_t *tmpIF = me->meIF;
-	me->rxframe[me->_rx_byte_count] = me->rxByte;
-	me->_rx_byte_count++;
-	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer,RS485_US_TO_TICKS(RS485_T35_DURATION_US));
+    if(me->_tick_source != NULL){
+    	/* bus may be idle in between runs, timers below start from the current tick */
+    	me->_tick_count = *me->_tick_source;
+    }
+	if(me->_rx_byte_count == 0U){
+		me->_rx_start_tick = me->_tick_count;
+	}
+	if(me->_rx_byte_count < RS485_MAX_DATA_LENGTH){
+		/* longer than any frame : the rest is dropped, the frame fails to unframe */
+		me->rxframe[me->_rx_byte_count] = me->rxByte;
+		me->_rx_byte_count++;
+	}
+	me->_rx_activity = true;
+	if(true == me->_loopback_flag){
+		if(me->_rx_byte_count >= me->_tx_size){
+			me->_eof_flag = true;
+		}
+	}else{
+		me->_eof_pending = false;
+		if(true == packet_parser_put(&me->rx_parser, me->rxByte)){
+			if((RESPOND_FRAME == me->rx_parser.frame_type) || (SELLECT_FRAME == me->rx_parser.frame_type)){
+				me->_eof_pending = true;
+			}else{
+				me->_eof_flag = true;
+			}
+		}
+	}
+	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t35_timer,me->_t35_ticks);
+	rs485_timer_start(&me->sm_data,(uint32_t*)&me->sm_data._t15_timer,me->_t15_ticks);
 
 	tmpIF->uart_rx((uint8_t*)&me->rxByte,1U); /* receive 1 byte */
 }
@@ -1,3 +1,6 @@
+#ifndef RS485_H
+#define RS485_H
+
 /*==================================================================================================
 *                                        INCLUDE FILES
 * 1) system and project includes
@@ -9,6 +12,7 @@
 #include <stdbool.h>
 
 #include "rs_packet.h"
+#include "rs485_trace.h"
 #include "ring_buffer.h"
 
 /*==================================================================================================
@@ -19,10 +23,20 @@
 #define RS485_MAX_DATA_LENGTH         		256
 #define RS485_MAX_CHANNEL_NUMBER			32
 #define RS485_INVALID_CHANNEL_ID			RS485_MAX_CHANNEL_NUMBER
+#define RS485_FRAME_MAX_SIZE				(MAX_PACKET_LENGTH + 5 + PACKET_CHECK_SIZE)	// EOT STX SA OP data ETX check
 
 #define MAX_RETRY_NUMBER					3
 #define RS485_TICK_US						200  	// duration per tick in us
 #define RS485_T35_DURATION_US				1000	// duration t35 in us
+#define RS485_T15_DURATION_US				400		// character gap that breaks a frame in us
+
+#define RS485_DEFAULT_BAUD					115200	// rate every node starts at, t35 / t15 above are for this rate
+#define RS485_OPCODE_BAUD					0xFE	// reserved : baud rate proposal, data = baud (4B, LSB first)
+#define RS485_BAUD_FALLBACK_THRESHOLD		2		// missed exchanges at a negotiated rate before going back to RS485_DEFAULT_BAUD
+
+#define RS485_SM_STATE_NUMBER				4		// init, idle, poll, sellect
+#define RS485_LATENCY_HIST_BINS				8		// request to reply in ticks : 0-1, 2-3, 4-7, ... , >=128
+#define RS485_RETRY_HIST_BINS				(MAX_RETRY_NUMBER + 2)	// done after 0..MAX_RETRY_NUMBER retries, last bin : given up
 
 /*==================================================================================================
 *                                              ENUMS
@@ -43,8 +57,19 @@ typedef enum{
 	BUS_MSG_COUNT,
 	BUS_ERR_COUNT,
 	BUS_OVERRUN_COUNT,
+	SLAVE_MSG_COUNT,
+	SLAVE_ERR_COUNT,
+	SLAVE_NO_RESP_COUNT,
+	SLAVE_NAK_COUNT,
+	SLAVE_BUSY_COUNT,
 }rs485_diagnostic_e;
 
+typedef enum{
+	RS485_STAGED_EMPTY,
+	RS485_STAGED_READY,			// next RESPOND frame built, waiting for a POLL
+	RS485_STAGED_IN_USE,		// on the line, released when the poll ends
+}rs485_staged_state_e;
+
 
 /*==================================================================================================
 *                                  STRUCTURES AND OTHER TYPEDEFS
@@ -55,11 +80,18 @@ typedef uint32_t rs485timer_t;
 typedef struct rs485_state_machine_data 	rs485_state_machine_data_t;
 typedef struct rs485 						rs485_t;
 
+typedef struct{
+    uint8_t 	*pdata;
+    uint16_t 	len;
+}rs485_iovec_t;
+
 typedef struct{
     void (*txMode)(void);
     void (*rxMode)(void);
     void (*uart_rx)(uint8_t *pdata,uint16_t len);
     void (*uart_tx)(uint8_t *pdata,uint16_t len);
+    void (*uart_txv)(rs485_iovec_t *iov,uint8_t iovcnt);	// optional (NULL : frame staged in txframe) : send header | data | trailer back to back
+    void (*set_baud)(uint32_t baud);						// optional (NULL : fixed RS485_DEFAULT_BAUD) : only called with the line idle
 }rs485IF_t;
 
 struct rs485_state_machine_data{
@@ -67,8 +99,7 @@ struct rs485_state_machine_data{
     uint8_t                	cur_state;
     uint8_t                	next_state;
     rs485timer_t            timer;
-    uint8_t					cur_poll_state;
-    uint8_t					cur_sellect_state;
+    uint8_t					cur_substate;			// poll / sellect sub state of cur_state, 0 for init and idle
 	volatile rs485timer_t	_timeout_timer;
 	volatile rs485timer_t	_t35_timer; 			// frame silent interval 3.5 character
 	volatile rs485timer_t	_t15_timer;
@@ -86,6 +117,43 @@ typedef struct{
     volatile uint32_t   _bus_overrun_count;		// CPT8
 }rs485_diagnostic_t;
 
+typedef struct{
+	uint32_t			msg_count;
+	uint32_t			err_count;
+	uint32_t			no_resp_count;
+	uint32_t			nak_count;
+	uint32_t			busy_count;								// frame dropped, rx queue full
+	uint32_t			latency_hist[RS485_LATENCY_HIST_BINS];	// request sent to reply received, in ticks
+	uint32_t			retry_hist[RS485_RETRY_HIST_BINS];		// retries needed per sellect
+	uint8_t				tx_queue_depth;							// filled in on snapshot
+	uint8_t				tx_queue_max;
+	uint8_t				rx_queue_depth;							// filled in on snapshot
+	uint8_t				rx_queue_max;
+}rs485_channel_telemetry_t;
+
+typedef struct{
+	rs485_diagnostic_t	diagnostic;
+	uint32_t			total_ticks;
+	uint32_t			busy_ticks;								// ticks with a byte on the line (own echo included)
+	uint32_t			state_ticks[RS485_SM_STATE_NUMBER];		// ticks spent in each state machine state
+}rs485_bus_telemetry_t;
+
+/* slave : next response framed ahead of the POLL, handed to the line as is */
+typedef struct{
+	uint8_t					state;					// rs485_staged_state_e
+	uint8_t					size;
+	Packet_t				packet;
+	PacketBuilder_t			builder;				// meIF->uart_txv set
+	uint8_t					frame[RS485_FRAME_MAX_SIZE];
+}rs485_staged_t;
+
+/* master side re-poll of an offline channel : min_us doubling per missed probe up to max_us, +/- jitter_percent */
+typedef struct{
+	uint32_t				min_us;
+	uint32_t				max_us;
+	uint8_t					jitter_percent;
+}rs485_backoff_t;
+
 typedef struct{
 	uint8_t					address;
 	uint8_t					group_address;
@@ -98,23 +166,48 @@ typedef struct{
 	bool					is_poll_active;
 	bool					is_sellect_active;
 	rs485timer_t			_sync_timer;
+	rs485_backoff_t			backoff;
+	uint32_t				_backoff_us;			// delay before the next probe while offline
+	uint32_t				baud;					// master : rate agreed with this slave
+	uint32_t				baud_max;				// master : rate to propose, negotiation runs while baud_max > baud
+	uint8_t					_baud_err_count;
+	rs485_staged_t			*_staged;				// slave with tx active, else NULL
+	volatile uint16_t		_tx_put;				// queue counters, each written from one context only :
+	volatile uint16_t		_tx_get;				// depth = put - get, taken on snapshot
+	volatile uint16_t		_rx_put;
+	volatile uint16_t		_rx_get;
+	rs485_channel_telemetry_t	_telemetry;
 }rs485_channel_t;
 
 struct rs485{
-    uint8_t             address; 				// address of device
+    uint8_t             address; 				// address of device (slave : each channel answers its own address, a single channel this one too)
     rs485IF_t           *meIF;
     rs485_bus_mode_e 	bus_mode; 				// MASTER or SLAVE
 
     volatile uint16_t   _rx_byte_count;
     rs485_diagnostic_t  _diagnostic;
+    rs485_bus_telemetry_t	_telemetry;			// diagnostic copied in from _diagnostic on snapshot
+    volatile bool		_rx_activity;			// byte received since last tick
+    uint32_t			_request_tick;			// tick the last request went out (latency)
+    bool				_is_reply_pending;		// POLL / SELLECT / RESPOND sent, first reply not timed yet
+    uint32_t			_rand;					// backoff jitter
+    uint32_t			_baud;					// current line rate
+    uint32_t			_baud_max;				// slave : highest rate accepted from the master
+    uint32_t			_baud_next;				// slave : rate to switch to once the ACK has left the line
+    uint32_t			_t35_ticks;				// t35 / t15 at the current rate
+    uint32_t			_t15_ticks;
 
     bool				_is_bus_running;
     volatile bool 		_loopback_flag;
     volatile bool 		_eof_flag;				// end of frame flag
+    volatile bool 		_eof_pending;			// STX-led frame whose check matched, complete after t1.5 of silence
     volatile uint32_t	_tick_count;
+    volatile uint32_t	*_tick_source;			// NULL : own tick counted by rs485_process, else shared tick
+    uint32_t			_run_tick;				// tick rs485_process last ran (shared tick only)
 
 	rs485_channel_t*	channel_list[RS485_MAX_CHANNEL_NUMBER];
 	uint8_t 			num_of_channel;
+	uint8_t				address_map[256];		// slave : SA -> channel id, RS485_INVALID_CHANNEL_ID when not ours
 
 	uint8_t             rxByte;
 	uint8_t 			_cur_rxframe;
@@ -122,13 +215,23 @@ struct rs485{
 	uint8_t             _rx_size;
 	uint8_t             rxframe[RS485_MAX_DATA_LENGTH];
 	uint8_t             _tx_size;
+	uint8_t				_tx_frame;				// Frame_e of the frame staged for tx
 	uint8_t             txframe[RS485_MAX_DATA_LENGTH];
+	PacketBuilder_t		tx_builder;				// used instead of txframe when meIF->uart_txv is set
+	Packet_t			*_tx_packet_p;			// frame rs485_tx_current_frame sends : tx_packet / txframe / tx_builder,
+	uint8_t				*_txframe_p;			// or a channel's staged response
+	PacketBuilder_t		*_tx_builder_p;
 
-	Packet_t 			rx_packet;
+	Packet_t 			rx_packet;				// parser writes the payload straight into rx_packet.data
 	Packet_t 			tx_packet;
+	PacketView_t		rx_view;				// last received frame, data left in place
+	RsPacket			rx_parser;				// incremental frame parser fed from rs485_RxByte_callback
 
 	rs485_state_machine_data_t	sm_data;
 
+	rs485_trace_t		*_trace;				// NULL : no capture
+	volatile uint32_t	_rx_start_tick;			// tick of the first byte of the frame being received
+
 };
 
 /*==================================================================================================
@@ -136,6 +239,10 @@ struct rs485{
 ==================================================================================================*/
 void rs485_init(rs485_t *me, rs485IF_t *meIF, uint8_t deviceID, rs485_bus_mode_e bus_mode);
 bool rs485_channel_init(rs485_t *me, uint8_t address, uint8_t *channel_id, bool is_tx_active, bool is_rx_active, uint8_t tx_cache_number, uint8_t rx_cache_number);
+bool rs485_channel_set_backoff(rs485_t *me, uint8_t channel_id, const rs485_backoff_t *backoff);
+bool rs485_channel_probe(rs485_t *me, uint8_t channel_id);
+bool rs485_channel_set_baud(rs485_t *me, uint8_t channel_id, uint32_t baud_max);
+void rs485_set_baud_max(rs485_t *me, uint32_t baud_max);
 
 bool rs485_bus_start(rs485_t *me);
 
@@ -144,10 +251,19 @@ bool rs485_transmit(rs485_t *me, uint8_t channel_id, rs485_msg *msg);
 bool rs485_receive(rs485_t *me, uint8_t channel_id, rs485_msg *msg);
 
 void rs485_process(rs485_t *me);
+uint32_t rs485_idle_ticks(rs485_t *me);
+void rs485_set_tick_source(rs485_t *me, volatile uint32_t *tick_source);
+void rs485_set_trace(rs485_t *me, rs485_trace_t *trace);
+void rs485_state_table_dump(rs485_bus_mode_e bus_mode, void (*print)(const char *const fmt, ...));
 
 uint8_t rs485_get_channelState(rs485_t *me, uint8_t channel_id);
 
+void rs485_get_bus_telemetry(rs485_t *me, rs485_bus_telemetry_t *snapshot);
+bool rs485_get_channel_telemetry(rs485_t *me, uint8_t channel_id, rs485_channel_telemetry_t *snapshot);
+void rs485_telemetry_reset(rs485_t *me);
+
 /*************************** callback function **********************************/
 
 void rs485_RxByte_callback(rs485_t *me);
 
+#endif /* RS485_H */
@@ -0,0 +1,143 @@
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include "rs485_multi.h"
+#include "assert_handler.h"
+
+/*==================================================================================================
+*                                       FUNCTION PROTOTYPES
+==================================================================================================*/
+static void rs485_multi_wake(rs485_multi_t *me, uint8_t bus_id);
+static bool rs485_multi_is_due(uint32_t tick, uint32_t now);
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static void rs485_multi_wake(rs485_multi_t *me, uint8_t bus_id)
+{
+	me->_wake_flag[bus_id] = true;
+	me->_is_any_wake = true;
+}
+
+static bool rs485_multi_is_due(uint32_t tick, uint32_t now)
+{
+	int32_t left = tick - now;
+	return (left <= 0);
+}
+
+/*==================================================================================================
+*                                        GLOBAL FUNCTIONS
+==================================================================================================*/
+void rs485_multi_init(rs485_multi_t *me)
+{
+	ASSERT(me!=NULL);
+	uint8_t i;
+	for(i = 0; i < RS485_MULTI_MAX_BUS; i++)
+	{
+		me->bus_list[i] 	= NULL;
+		me->_wake_tick[i] 	= 0;
+		me->_wake_flag[i] 	= false;
+	}
+	me->num_of_bus 		= 0;
+	me->_tick_count 	= 0;
+	me->_next_wake_tick = 0;
+	me->_is_any_wake 	= false;
+}
+
+/* bus must already be rs485_init'ed, returns the bus id used by the rx callback */
+uint8_t rs485_multi_add(rs485_multi_t *me, rs485_t *bus)
+{
+	ASSERT((me!=NULL)&&(bus!=NULL));
+	uint8_t bus_id = RS485_MULTI_INVALID_BUS_ID;
+	if(me->num_of_bus < RS485_MULTI_MAX_BUS)
+	{
+		bus_id = me->num_of_bus;
+		me->bus_list[bus_id] 	= bus;
+		rs485_set_tick_source(bus, &me->_tick_count);
+		me->num_of_bus++;
+		rs485_multi_wake(me, bus_id);
+	}
+	return bus_id;
+}
+
+void rs485_multi_start(rs485_multi_t *me)
+{
+	uint8_t i;
+	for(i = 0; i < me->num_of_bus; i++)
+	{
+		rs485_bus_start(me->bus_list[i]);
+		rs485_multi_wake(me, i);
+	}
+}
+
+/* this process each RS485_TICK_US, for all buses */
+void rs485_multi_process(rs485_multi_t *me)
+{
+	uint8_t i;
+	uint32_t idle;
+	uint32_t next_wake_tick;
+	rs485_t *bus;
+
+	me->_tick_count++;
+	if((false == me->_is_any_wake) && (false == rs485_multi_is_due(me->_next_wake_tick, me->_tick_count))){
+		return;
+	}
+	/* cleared before the flags are read : a byte arriving meanwhile is seen now or on the next tick */
+	me->_is_any_wake = false;
+	next_wake_tick = me->_tick_count + RS485_MULTI_MAX_IDLE_TICKS;
+	for(i = 0; i < me->num_of_bus; i++)
+	{
+		bus = me->bus_list[i];
+		if((true == me->_wake_flag[i]) || (true == rs485_multi_is_due(me->_wake_tick[i], me->_tick_count)))
+		{
+			me->_wake_flag[i] = false;
+			rs485_process(bus);
+			idle = rs485_idle_ticks(bus);
+			if(idle > RS485_MULTI_MAX_IDLE_TICKS){
+				idle = RS485_MULTI_MAX_IDLE_TICKS;
+			}
+			me->_wake_tick[i] = me->_tick_count + 1U + idle;
+		}
+		if((int32_t)(me->_wake_tick[i] - next_wake_tick) < 0){
+			next_wake_tick = me->_wake_tick[i];
+		}
+	}
+	me->_next_wake_tick = next_wake_tick;
+}
+
+/* sum of every bus, state_ticks add up to num_of_bus * total_ticks */
+void rs485_multi_get_telemetry(rs485_multi_t *me, rs485_bus_telemetry_t *snapshot)
+{
+	ASSERT((me!=NULL)&&(snapshot!=NULL));
+	uint8_t i, j;
+	rs485_bus_telemetry_t bus_snapshot;
+	memset(snapshot, 0, sizeof(rs485_bus_telemetry_t));
+	for(i = 0; i < me->num_of_bus; i++)
+	{
+		rs485_get_bus_telemetry(me->bus_list[i], &bus_snapshot);
+		snapshot->diagnostic._bus_msg_count 		+= bus_snapshot.diagnostic._bus_msg_count;
+		snapshot->diagnostic._bus_err_count 		+= bus_snapshot.diagnostic._bus_err_count;
+		snapshot->diagnostic._slave_err_count 		+= bus_snapshot.diagnostic._slave_err_count;
+		snapshot->diagnostic._slave_msg_count 		+= bus_snapshot.diagnostic._slave_msg_count;
+		snapshot->diagnostic._slave_no_resp_count 	+= bus_snapshot.diagnostic._slave_no_resp_count;
+		snapshot->diagnostic._slave_nak_count 		+= bus_snapshot.diagnostic._slave_nak_count;
+		snapshot->diagnostic._slave_busy_count 		+= bus_snapshot.diagnostic._slave_busy_count;
+		snapshot->diagnostic._bus_overrun_count 	+= bus_snapshot.diagnostic._bus_overrun_count;
+		snapshot->total_ticks 	+= bus_snapshot.total_ticks;
+		snapshot->busy_ticks 	+= bus_snapshot.busy_ticks;
+		for(j = 0; j < RS485_SM_STATE_NUMBER; j++)
+		{
+			snapshot->state_ticks[j] += bus_snapshot.state_ticks[j];
+		}
+	}
+}
+
+/****************************** callback ***********************************/
+void rs485_multi_RxByte_callback(rs485_multi_t *me, uint8_t bus_id)
+{
+	rs485_RxByte_callback(me->bus_list[bus_id]);
+	rs485_multi_wake(me, bus_id);
+}
@@ -0,0 +1,56 @@
+#ifndef RS485_MULTI_H
+#define RS485_MULTI_H
+
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rs485.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define RS485_MULTI_MAX_BUS					8
+#define RS485_MULTI_INVALID_BUS_ID			RS485_MULTI_MAX_BUS
+#define RS485_MULTI_MAX_IDLE_TICKS			5000	// a quiet bus still runs once per second
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+/*
+ * several rs485_t serviced from one RS485_TICK_US tick.
+ * a bus only runs on the ticks it has something to do : a received byte, a pending event or a timer due.
+ */
+typedef struct{
+	rs485_t				*bus_list[RS485_MULTI_MAX_BUS];
+	uint8_t				num_of_bus;
+
+	volatile uint32_t	_tick_count;						// shared by every bus
+	uint32_t			_wake_tick[RS485_MULTI_MAX_BUS];	// tick the bus has to run again
+	uint32_t			_next_wake_tick;					// earliest _wake_tick of all buses
+	volatile bool		_wake_flag[RS485_MULTI_MAX_BUS];	// set from the rx byte callback
+	volatile bool		_is_any_wake;
+}rs485_multi_t;
+
+/*==================================================================================================
+*                                       FUNCTION PROTOTYPES
+==================================================================================================*/
+void rs485_multi_init(rs485_multi_t *me);
+uint8_t rs485_multi_add(rs485_multi_t *me, rs485_t *bus);
+void rs485_multi_start(rs485_multi_t *me);
+
+void rs485_multi_process(rs485_multi_t *me);
+
+void rs485_multi_get_telemetry(rs485_multi_t *me, rs485_bus_telemetry_t *snapshot);
+
+/*************************** callback function **********************************/
+
+/* use instead of rs485_RxByte_callback so the bus is serviced on the next tick */
+void rs485_multi_RxByte_callback(rs485_multi_t *me, uint8_t bus_id);
+
+#endif /* RS485_MULTI_H */
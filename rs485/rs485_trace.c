@@ -0,0 +1,109 @@
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <string.h>
+
+#include "rs485_trace.h"
+#include "assert_handler.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define RS485_TRACE_INDEX(seq)				((seq) & (RS485_TRACE_RECORD_NUMBER - 1U))
+/* keeps the payload stores / loads between the two seq accesses, single core : no fence needed */
+#ifndef RS485_TRACE_BARRIER
+#define RS485_TRACE_BARRIER()				__asm__ volatile("" ::: "memory")
+#endif
+
+_Static_assert((RS485_TRACE_RECORD_NUMBER & (RS485_TRACE_RECORD_NUMBER - 1)) == 0, "RS485_TRACE_RECORD_NUMBER must be a power of 2");
+
+/*==================================================================================================
+*                                        GLOBAL FUNCTIONS
+==================================================================================================*/
+void rs485_trace_init(rs485_trace_t *me)
+{
+	ASSERT(me!=NULL);
+	memset(me->record, 0, sizeof(me->record));
+	me->_seq 		= 0;
+	me->is_frozen 	= false;
+}
+
+void rs485_trace_freeze(rs485_trace_t *me, bool is_frozen)
+{
+	me->is_frozen = is_frozen;
+}
+
+/* data : record->length payload bytes, first RS485_TRACE_DATA_BYTES kept */
+void rs485_trace_put(rs485_trace_t *me, const rs485_trace_record_t *record, const uint8_t *data)
+{
+	rs485_trace_record_t *slot;
+	uint16_t len;
+	if(true == me->is_frozen){
+		return;
+	}
+	slot = &me->record[RS485_TRACE_INDEX(me->_seq)];
+	slot->seq = 0;
+	RS485_TRACE_BARRIER();
+	slot->tick 			= record->tick;
+	slot->type 			= record->type;
+	slot->frame 		= record->frame;
+	slot->address 		= record->address;
+	slot->opcode 		= record->opcode;
+	slot->length 		= record->length;
+	slot->channel_id 	= record->channel_id;
+	slot->bus_mode 		= record->bus_mode;
+	len = (record->length < RS485_TRACE_DATA_BYTES) ? record->length : RS485_TRACE_DATA_BYTES;
+	if((data != NULL) && (len > 0U)){
+		memcpy(slot->data, data, len);
+	}
+	memset(&slot->data[len], 0, RS485_TRACE_DATA_BYTES - len);
+	RS485_TRACE_BARRIER();
+	me->_seq++;
+	slot->seq = me->_seq;
+}
+
+/* oldest record still in the ring */
+uint32_t rs485_trace_first(rs485_trace_t *me)
+{
+	uint32_t seq = me->_seq;
+	return (seq > RS485_TRACE_RECORD_NUMBER) ? (seq - RS485_TRACE_RECORD_NUMBER) : 0U;
+}
+
+/* record number seq (0 = first ever), false : not written yet or already overwritten */
+bool rs485_trace_read(rs485_trace_t *me, uint32_t seq, rs485_trace_record_t *record)
+{
+	ASSERT((me!=NULL)&&(record!=NULL));
+	const rs485_trace_record_t *slot = &me->record[RS485_TRACE_INDEX(seq)];
+	if(slot->seq != (seq + 1U)){
+		return false;
+	}
+	RS485_TRACE_BARRIER();
+	memcpy(record, (const void*)slot, sizeof(rs485_trace_record_t));
+	RS485_TRACE_BARRIER();
+	/* overwritten while copying */
+	return ((record->seq == (seq + 1U)) && (slot->seq == (seq + 1U)));
+}
+
+/*
+ * oldest to newest, one record per write call at offset 0, 24, 48 ...
+ * write may be flash_WriteMemory behind a wrapper; freeze first to dump a consistent window.
+ */
+uint32_t rs485_trace_dump(rs485_trace_t *me, void *ctx, void (*write)(void *ctx, uint32_t offset, uint8_t *pdata, uint32_t len))
+{
+	ASSERT((me!=NULL)&&(write!=NULL));
+	rs485_trace_record_t record;
+	uint32_t seq;
+	uint32_t last = me->_seq;
+	uint32_t count = 0;
+	for(seq = rs485_trace_first(me); seq != last; seq++)
+	{
+		if(true == rs485_trace_read(me, seq, &record)){
+			write(ctx, count * sizeof(rs485_trace_record_t), (uint8_t*)&record, sizeof(rs485_trace_record_t));
+			count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,75 @@
+#ifndef RS485_TRACE_H
+#define RS485_TRACE_H
+
+/*==================================================================================================
+*                                        INCLUDE FILES
+* 1) system and project includes
+* 2) needed interfaces from external units
+* 3) internal and external interfaces from this unit
+==================================================================================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#ifndef RS485_TRACE_RECORD_NUMBER
+#define RS485_TRACE_RECORD_NUMBER			64		// power of 2, oldest record is overwritten when full
+#endif
+
+#ifndef RS485_TRACE_DATA_BYTES
+#define RS485_TRACE_DATA_BYTES				8		// first payload bytes kept per frame
+#endif
+
+/*==================================================================================================
+*                                              ENUMS
+==================================================================================================*/
+typedef enum{
+	RS485_TRACE_TX,				// frame put on the line
+	RS485_TRACE_RX,				// frame received, frame = unframe result (ERROR_FRAME included)
+	RS485_TRACE_STATE,			// state machine transition
+}rs485_trace_type_e;
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+/*
+ * one record, the layout is the dump format : little endian, 24 bytes.
+ * RS485_TRACE_STATE : frame = state left, address = state entered, opcode = event.
+ */
+typedef struct{
+	volatile uint32_t	seq;					// record number + 1, written last : 0 = empty slot
+	uint32_t			tick;					// RS485_TICK_US ticks, rx : first byte of the frame
+	uint8_t				type;					// rs485_trace_type_e
+	uint8_t				frame;					// Frame_e
+	uint8_t				address;
+	uint8_t				opcode;
+	uint16_t			length;					// payload length, ERROR_FRAME : raw bytes received
+	uint8_t				channel_id;
+	uint8_t				bus_mode;
+	uint8_t				data[RS485_TRACE_DATA_BYTES];
+}rs485_trace_record_t;
+
+/*
+ * single writer (the rs485_process context), readers never block it :
+ * a record read while being overwritten is seen with a changed seq and skipped.
+ */
+typedef struct{
+	rs485_trace_record_t	record[RS485_TRACE_RECORD_NUMBER];
+	volatile uint32_t		_seq;				// records written so far
+	volatile bool			is_frozen;			// stop recording, keeps the ring as it was for a dump
+}rs485_trace_t;
+
+/*==================================================================================================
+*                                       FUNCTION PROTOTYPES
+==================================================================================================*/
+void rs485_trace_init(rs485_trace_t *me);
+void rs485_trace_freeze(rs485_trace_t *me, bool is_frozen);
+
+void rs485_trace_put(rs485_trace_t *me, const rs485_trace_record_t *record, const uint8_t *data);
+
+uint32_t rs485_trace_first(rs485_trace_t *me);
+bool rs485_trace_read(rs485_trace_t *me, uint32_t seq, rs485_trace_record_t *record);
+uint32_t rs485_trace_dump(rs485_trace_t *me, void *ctx, void (*write)(void *ctx, uint32_t offset, uint8_t *pdata, uint32_t len));
+
+#endif /* RS485_TRACE_H */
@@ -22,38 +22,623 @@
 #define POL        0x05U
 #define ACK        0x06U
 #define NACK       0x15U
+
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_BCC)
+#define CHECK_INIT      0x0000U
+#else
+#define CHECK_INIT      0xFFFFU
+#endif
+
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_CCITT)
+#define CRC16_UPDATE(crc, byte)     ((uint16_t)((crc) << 8) ^ crc16_table[0][(((crc) >> 8) ^ (byte)) & 0xFFU])
+#elif (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_MODBUS)
+#define CRC16_UPDATE(crc, byte)     ((uint16_t)((crc) >> 8) ^ crc16_table[0][((crc) ^ (byte)) & 0xFFU])
+#endif
 /*==================================================================================================
 *                                              CONSTANTS
 ==================================================================================================*/
+#if (PACKET_CHECK_TYPE != PACKET_CHECK_BCC)
+#if (PACKET_CRC_SLICE_BY_4 == 1)
+#define CRC16_TABLE_NUM     4
+#else
+#define CRC16_TABLE_NUM     1
+#endif
+/* crc16_table[0] is the classic byte table, crc16_table[k] = crc of a byte followed by k zero bytes */
+static const uint16_t crc16_table[CRC16_TABLE_NUM][256] = {
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_CCITT)
+    {
+        0x0000U, 0x1021U, 0x2042U, 0x3063U, 0x4084U, 0x50A5U, 0x60C6U, 0x70E7U,
+        0x8108U, 0x9129U, 0xA14AU, 0xB16BU, 0xC18CU, 0xD1ADU, 0xE1CEU, 0xF1EFU,
+        0x1231U, 0x0210U, 0x3273U, 0x2252U, 0x52B5U, 0x4294U, 0x72F7U, 0x62D6U,
+        0x9339U, 0x8318U, 0xB37BU, 0xA35AU, 0xD3BDU, 0xC39CU, 0xF3FFU, 0xE3DEU,
+        0x2462U, 0x3443U, 0x0420U, 0x1401U, 0x64E6U, 0x74C7U, 0x44A4U, 0x5485U,
+        0xA56AU, 0xB54BU, 0x8528U, 0x9509U, 0xE5EEU, 0xF5CFU, 0xC5ACU, 0xD58DU,
+        0x3653U, 0x2672U, 0x1611U, 0x0630U, 0x76D7U, 0x66F6U, 0x5695U, 0x46B4U,
+        0xB75BU, 0xA77AU, 0x9719U, 0x8738U, 0xF7DFU, 0xE7FEU, 0xD79DU, 0xC7BCU,
+        0x48C4U, 0x58E5U, 0x6886U, 0x78A7U, 0x0840U, 0x1861U, 0x2802U, 0x3823U,
+        0xC9CCU, 0xD9EDU, 0xE98EU, 0xF9AFU, 0x8948U, 0x9969U, 0xA90AU, 0xB92BU,
+        0x5AF5U, 0x4AD4U, 0x7AB7U, 0x6A96U, 0x1A71U, 0x0A50U, 0x3A33U, 0x2A12U,
+        0xDBFDU, 0xCBDCU, 0xFBBFU, 0xEB9EU, 0x9B79U, 0x8B58U, 0xBB3BU, 0xAB1AU,
+        0x6CA6U, 0x7C87U, 0x4CE4U, 0x5CC5U, 0x2C22U, 0x3C03U, 0x0C60U, 0x1C41U,
+        0xEDAEU, 0xFD8FU, 0xCDECU, 0xDDCDU, 0xAD2AU, 0xBD0BU, 0x8D68U, 0x9D49U,
+        0x7E97U, 0x6EB6U, 0x5ED5U, 0x4EF4U, 0x3E13U, 0x2E32U, 0x1E51U, 0x0E70U,
+        0xFF9FU, 0xEFBEU, 0xDFDDU, 0xCFFCU, 0xBF1BU, 0xAF3AU, 0x9F59U, 0x8F78U,
+        0x9188U, 0x81A9U, 0xB1CAU, 0xA1EBU, 0xD10CU, 0xC12DU, 0xF14EU, 0xE16FU,
+        0x1080U, 0x00A1U, 0x30C2U, 0x20E3U, 0x5004U, 0x4025U, 0x7046U, 0x6067U,
+        0x83B9U, 0x9398U, 0xA3FBU, 0xB3DAU, 0xC33DU, 0xD31CU, 0xE37FU, 0xF35EU,
+        0x02B1U, 0x1290U, 0x22F3U, 0x32D2U, 0x4235U, 0x5214U, 0x6277U, 0x7256U,
+        0xB5EAU, 0xA5CBU, 0x95A8U, 0x8589U, 0xF56EU, 0xE54FU, 0xD52CU, 0xC50DU,
+        0x34E2U, 0x24C3U, 0x14A0U, 0x0481U, 0x7466U, 0x6447U, 0x5424U, 0x4405U,
+        0xA7DBU, 0xB7FAU, 0x8799U, 0x97B8U, 0xE75FU, 0xF77EU, 0xC71DU, 0xD73CU,
+        0x26D3U, 0x36F2U, 0x0691U, 0x16B0U, 0x6657U, 0x7676U, 0x4615U, 0x5634U,
+        0xD94CU, 0xC96DU, 0xF90EU, 0xE92FU, 0x99C8U, 0x89E9U, 0xB98AU, 0xA9ABU,
+        0x5844U, 0x4865U, 0x7806U, 0x6827U, 0x18C0U, 0x08E1U, 0x3882U, 0x28A3U,
+        0xCB7DU, 0xDB5CU, 0xEB3FU, 0xFB1EU, 0x8BF9U, 0x9BD8U, 0xABBBU, 0xBB9AU,
+        0x4A75U, 0x5A54U, 0x6A37U, 0x7A16U, 0x0AF1U, 0x1AD0U, 0x2AB3U, 0x3A92U,
+        0xFD2EU, 0xED0FU, 0xDD6CU, 0xCD4DU, 0xBDAAU, 0xAD8BU, 0x9DE8U, 0x8DC9U,
+        0x7C26U, 0x6C07U, 0x5C64U, 0x4C45U, 0x3CA2U, 0x2C83U, 0x1CE0U, 0x0CC1U,
+        0xEF1FU, 0xFF3EU, 0xCF5DU, 0xDF7CU, 0xAF9BU, 0xBFBAU, 0x8FD9U, 0x9FF8U,
+        0x6E17U, 0x7E36U, 0x4E55U, 0x5E74U, 0x2E93U, 0x3EB2U, 0x0ED1U, 0x1EF0U
+    }
+#if (PACKET_CRC_SLICE_BY_4 == 1)
+    ,
+    {
+        0x0000U, 0x3331U, 0x6662U, 0x5553U, 0xCCC4U, 0xFFF5U, 0xAAA6U, 0x9997U,
+        0x89A9U, 0xBA98U, 0xEFCBU, 0xDCFAU, 0x456DU, 0x765CU, 0x230FU, 0x103EU,
+        0x0373U, 0x3042U, 0x6511U, 0x5620U, 0xCFB7U, 0xFC86U, 0xA9D5U, 0x9AE4U,
+        0x8ADAU, 0xB9EBU, 0xECB8U, 0xDF89U, 0x461EU, 0x752FU, 0x207CU, 0x134DU,
+        0x06E6U, 0x35D7U, 0x6084U, 0x53B5U, 0xCA22U, 0xF913U, 0xAC40U, 0x9F71U,
+        0x8F4FU, 0xBC7EU, 0xE92DU, 0xDA1CU, 0x438BU, 0x70BAU, 0x25E9U, 0x16D8U,
+        0x0595U, 0x36A4U, 0x63F7U, 0x50C6U, 0xC951U, 0xFA60U, 0xAF33U, 0x9C02U,
+        0x8C3CU, 0xBF0DU, 0xEA5EU, 0xD96FU, 0x40F8U, 0x73C9U, 0x269AU, 0x15ABU,
+        0x0DCCU, 0x3EFDU, 0x6BAEU, 0x589FU, 0xC108U, 0xF239U, 0xA76AU, 0x945BU,
+        0x8465U, 0xB754U, 0xE207U, 0xD136U, 0x48A1U, 0x7B90U, 0x2EC3U, 0x1DF2U,
+        0x0EBFU, 0x3D8EU, 0x68DDU, 0x5BECU, 0xC27BU, 0xF14AU, 0xA419U, 0x9728U,
+        0x8716U, 0xB427U, 0xE174U, 0xD245U, 0x4BD2U, 0x78E3U, 0x2DB0U, 0x1E81U,
+        0x0B2AU, 0x381BU, 0x6D48U, 0x5E79U, 0xC7EEU, 0xF4DFU, 0xA18CU, 0x92BDU,
+        0x8283U, 0xB1B2U, 0xE4E1U, 0xD7D0U, 0x4E47U, 0x7D76U, 0x2825U, 0x1B14U,
+        0x0859U, 0x3B68U, 0x6E3BU, 0x5D0AU, 0xC49DU, 0xF7ACU, 0xA2FFU, 0x91CEU,
+        0x81F0U, 0xB2C1U, 0xE792U, 0xD4A3U, 0x4D34U, 0x7E05U, 0x2B56U, 0x1867U,
+        0x1B98U, 0x28A9U, 0x7DFAU, 0x4ECBU, 0xD75CU, 0xE46DU, 0xB13EU, 0x820FU,
+        0x9231U, 0xA100U, 0xF453U, 0xC762U, 0x5EF5U, 0x6DC4U, 0x3897U, 0x0BA6U,
+        0x18EBU, 0x2BDAU, 0x7E89U, 0x4DB8U, 0xD42FU, 0xE71EU, 0xB24DU, 0x817CU,
+        0x9142U, 0xA273U, 0xF720U, 0xC411U, 0x5D86U, 0x6EB7U, 0x3BE4U, 0x08D5U,
+        0x1D7EU, 0x2E4FU, 0x7B1CU, 0x482DU, 0xD1BAU, 0xE28BU, 0xB7D8U, 0x84E9U,
+        0x94D7U, 0xA7E6U, 0xF2B5U, 0xC184U, 0x5813U, 0x6B22U, 0x3E71U, 0x0D40U,
+        0x1E0DU, 0x2D3CU, 0x786FU, 0x4B5EU, 0xD2C9U, 0xE1F8U, 0xB4ABU, 0x879AU,
+        0x97A4U, 0xA495U, 0xF1C6U, 0xC2F7U, 0x5B60U, 0x6851U, 0x3D02U, 0x0E33U,
+        0x1654U, 0x2565U, 0x7036U, 0x4307U, 0xDA90U, 0xE9A1U, 0xBCF2U, 0x8FC3U,
+        0x9FFDU, 0xACCCU, 0xF99FU, 0xCAAEU, 0x5339U, 0x6008U, 0x355BU, 0x066AU,
+        0x1527U, 0x2616U, 0x7345U, 0x4074U, 0xD9E3U, 0xEAD2U, 0xBF81U, 0x8CB0U,
+        0x9C8EU, 0xAFBFU, 0xFAECU, 0xC9DDU, 0x504AU, 0x637BU, 0x3628U, 0x0519U,
+        0x10B2U, 0x2383U, 0x76D0U, 0x45E1U, 0xDC76U, 0xEF47U, 0xBA14U, 0x8925U,
+        0x991BU, 0xAA2AU, 0xFF79U, 0xCC48U, 0x55DFU, 0x66EEU, 0x33BDU, 0x008CU,
+        0x13C1U, 0x20F0U, 0x75A3U, 0x4692U, 0xDF05U, 0xEC34U, 0xB967U, 0x8A56U,
+        0x9A68U, 0xA959U, 0xFC0AU, 0xCF3BU, 0x56ACU, 0x659DU, 0x30CEU, 0x03FFU
+    },
+    {
+        0x0000U, 0x3730U, 0x6E60U, 0x5950U, 0xDCC0U, 0xEBF0U, 0xB2A0U, 0x8590U,
+        0xA9A1U, 0x9E91U, 0xC7C1U, 0xF0F1U, 0x7561U, 0x4251U, 0x1B01U, 0x2C31U,
+        0x4363U, 0x7453U, 0x2D03U, 0x1A33U, 0x9FA3U, 0xA893U, 0xF1C3U, 0xC6F3U,
+        0xEAC2U, 0xDDF2U, 0x84A2U, 0xB392U, 0x3602U, 0x0132U, 0x5862U, 0x6F52U,
+        0x86C6U, 0xB1F6U, 0xE8A6U, 0xDF96U, 0x5A06U, 0x6D36U, 0x3466U, 0x0356U,
+        0x2F67U, 0x1857U, 0x4107U, 0x7637U, 0xF3A7U, 0xC497U, 0x9DC7U, 0xAAF7U,
+        0xC5A5U, 0xF295U, 0xABC5U, 0x9CF5U, 0x1965U, 0x2E55U, 0x7705U, 0x4035U,
+        0x6C04U, 0x5B34U, 0x0264U, 0x3554U, 0xB0C4U, 0x87F4U, 0xDEA4U, 0xE994U,
+        0x1DADU, 0x2A9DU, 0x73CDU, 0x44FDU, 0xC16DU, 0xF65DU, 0xAF0DU, 0x983DU,
+        0xB40CU, 0x833CU, 0xDA6CU, 0xED5CU, 0x68CCU, 0x5FFCU, 0x06ACU, 0x319CU,
+        0x5ECEU, 0x69FEU, 0x30AEU, 0x079EU, 0x820EU, 0xB53EU, 0xEC6EU, 0xDB5EU,
+        0xF76FU, 0xC05FU, 0x990FU, 0xAE3FU, 0x2BAFU, 0x1C9FU, 0x45CFU, 0x72FFU,
+        0x9B6BU, 0xAC5BU, 0xF50BU, 0xC23BU, 0x47ABU, 0x709BU, 0x29CBU, 0x1EFBU,
+        0x32CAU, 0x05FAU, 0x5CAAU, 0x6B9AU, 0xEE0AU, 0xD93AU, 0x806AU, 0xB75AU,
+        0xD808U, 0xEF38U, 0xB668U, 0x8158U, 0x04C8U, 0x33F8U, 0x6AA8U, 0x5D98U,
+        0x71A9U, 0x4699U, 0x1FC9U, 0x28F9U, 0xAD69U, 0x9A59U, 0xC309U, 0xF439U,
+        0x3B5AU, 0x0C6AU, 0x553AU, 0x620AU, 0xE79AU, 0xD0AAU, 0x89FAU, 0xBECAU,
+        0x92FBU, 0xA5CBU, 0xFC9BU, 0xCBABU, 0x4E3BU, 0x790BU, 0x205BU, 0x176BU,
+        0x7839U, 0x4F09U, 0x1659U, 0x2169U, 0xA4F9U, 0x93C9U, 0xCA99U, 0xFDA9U,
+        0xD198U, 0xE6A8U, 0xBFF8U, 0x88C8U, 0x0D58U, 0x3A68U, 0x6338U, 0x5408U,
+        0xBD9CU, 0x8AACU, 0xD3FCU, 0xE4CCU, 0x615CU, 0x566CU, 0x0F3CU, 0x380CU,
+        0x143DU, 0x230DU, 0x7A5DU, 0x4D6DU, 0xC8FDU, 0xFFCDU, 0xA69DU, 0x91ADU,
+        0xFEFFU, 0xC9CFU, 0x909FU, 0xA7AFU, 0x223FU, 0x150FU, 0x4C5FU, 0x7B6FU,
+        0x575EU, 0x606EU, 0x393EU, 0x0E0EU, 0x8B9EU, 0xBCAEU, 0xE5FEU, 0xD2CEU,
+        0x26F7U, 0x11C7U, 0x4897U, 0x7FA7U, 0xFA37U, 0xCD07U, 0x9457U, 0xA367U,
+        0x8F56U, 0xB866U, 0xE136U, 0xD606U, 0x5396U, 0x64A6U, 0x3DF6U, 0x0AC6U,
+        0x6594U, 0x52A4U, 0x0BF4U, 0x3CC4U, 0xB954U, 0x8E64U, 0xD734U, 0xE004U,
+        0xCC35U, 0xFB05U, 0xA255U, 0x9565U, 0x10F5U, 0x27C5U, 0x7E95U, 0x49A5U,
+        0xA031U, 0x9701U, 0xCE51U, 0xF961U, 0x7CF1U, 0x4BC1U, 0x1291U, 0x25A1U,
+        0x0990U, 0x3EA0U, 0x67F0U, 0x50C0U, 0xD550U, 0xE260U, 0xBB30U, 0x8C00U,
+        0xE352U, 0xD462U, 0x8D32U, 0xBA02U, 0x3F92U, 0x08A2U, 0x51F2U, 0x66C2U,
+        0x4AF3U, 0x7DC3U, 0x2493U, 0x13A3U, 0x9633U, 0xA103U, 0xF853U, 0xCF63U
+    },
+    {
+        0x0000U, 0x76B4U, 0xED68U, 0x9BDCU, 0xCAF1U, 0xBC45U, 0x2799U, 0x512DU,
+        0x85C3U, 0xF377U, 0x68ABU, 0x1E1FU, 0x4F32U, 0x3986U, 0xA25AU, 0xD4EEU,
+        0x1BA7U, 0x6D13U, 0xF6CFU, 0x807BU, 0xD156U, 0xA7E2U, 0x3C3EU, 0x4A8AU,
+        0x9E64U, 0xE8D0U, 0x730CU, 0x05B8U, 0x5495U, 0x2221U, 0xB9FDU, 0xCF49U,
+        0x374EU, 0x41FAU, 0xDA26U, 0xAC92U, 0xFDBFU, 0x8B0BU, 0x10D7U, 0x6663U,
+        0xB28DU, 0xC439U, 0x5FE5U, 0x2951U, 0x787CU, 0x0EC8U, 0x9514U, 0xE3A0U,
+        0x2CE9U, 0x5A5DU, 0xC181U, 0xB735U, 0xE618U, 0x90ACU, 0x0B70U, 0x7DC4U,
+        0xA92AU, 0xDF9EU, 0x4442U, 0x32F6U, 0x63DBU, 0x156FU, 0x8EB3U, 0xF807U,
+        0x6E9CU, 0x1828U, 0x83F4U, 0xF540U, 0xA46DU, 0xD2D9U, 0x4905U, 0x3FB1U,
+        0xEB5FU, 0x9DEBU, 0x0637U, 0x7083U, 0x21AEU, 0x571AU, 0xCCC6U, 0xBA72U,
+        0x753BU, 0x038FU, 0x9853U, 0xEEE7U, 0xBFCAU, 0xC97EU, 0x52A2U, 0x2416U,
+        0xF0F8U, 0x864CU, 0x1D90U, 0x6B24U, 0x3A09U, 0x4CBDU, 0xD761U, 0xA1D5U,
+        0x59D2U, 0x2F66U, 0xB4BAU, 0xC20EU, 0x9323U, 0xE597U, 0x7E4BU, 0x08FFU,
+        0xDC11U, 0xAAA5U, 0x3179U, 0x47CDU, 0x16E0U, 0x6054U, 0xFB88U, 0x8D3CU,
+        0x4275U, 0x34C1U, 0xAF1DU, 0xD9A9U, 0x8884U, 0xFE30U, 0x65ECU, 0x1358U,
+        0xC7B6U, 0xB102U, 0x2ADEU, 0x5C6AU, 0x0D47U, 0x7BF3U, 0xE02FU, 0x969BU,
+        0xDD38U, 0xAB8CU, 0x3050U, 0x46E4U, 0x17C9U, 0x617DU, 0xFAA1U, 0x8C15U,
+        0x58FBU, 0x2E4FU, 0xB593U, 0xC327U, 0x920AU, 0xE4BEU, 0x7F62U, 0x09D6U,
+        0xC69FU, 0xB02BU, 0x2BF7U, 0x5D43U, 0x0C6EU, 0x7ADAU, 0xE106U, 0x97B2U,
+        0x435CU, 0x35E8U, 0xAE34U, 0xD880U, 0x89ADU, 0xFF19U, 0x64C5U, 0x1271U,
+        0xEA76U, 0x9CC2U, 0x071EU, 0x71AAU, 0x2087U, 0x5633U, 0xCDEFU, 0xBB5BU,
+        0x6FB5U, 0x1901U, 0x82DDU, 0xF469U, 0xA544U, 0xD3F0U, 0x482CU, 0x3E98U,
+        0xF1D1U, 0x8765U, 0x1CB9U, 0x6A0DU, 0x3B20U, 0x4D94U, 0xD648U, 0xA0FCU,
+        0x7412U, 0x02A6U, 0x997AU, 0xEFCEU, 0xBEE3U, 0xC857U, 0x538BU, 0x253FU,
+        0xB3A4U, 0xC510U, 0x5ECCU, 0x2878U, 0x7955U, 0x0FE1U, 0x943DU, 0xE289U,
+        0x3667U, 0x40D3U, 0xDB0FU, 0xADBBU, 0xFC96U, 0x8A22U, 0x11FEU, 0x674AU,
+        0xA803U, 0xDEB7U, 0x456BU, 0x33DFU, 0x62F2U, 0x1446U, 0x8F9AU, 0xF92EU,
+        0x2DC0U, 0x5B74U, 0xC0A8U, 0xB61CU, 0xE731U, 0x9185U, 0x0A59U, 0x7CEDU,
+        0x84EAU, 0xF25EU, 0x6982U, 0x1F36U, 0x4E1BU, 0x38AFU, 0xA373U, 0xD5C7U,
+        0x0129U, 0x779DU, 0xEC41U, 0x9AF5U, 0xCBD8U, 0xBD6CU, 0x26B0U, 0x5004U,
+        0x9F4DU, 0xE9F9U, 0x7225U, 0x0491U, 0x55BCU, 0x2308U, 0xB8D4U, 0xCE60U,
+        0x1A8EU, 0x6C3AU, 0xF7E6U, 0x8152U, 0xD07FU, 0xA6CBU, 0x3D17U, 0x4BA3U
+    }
+#endif
+#elif (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_MODBUS)
+    {
+        0x0000U, 0xC0C1U, 0xC181U, 0x0140U, 0xC301U, 0x03C0U, 0x0280U, 0xC241U,
+        0xC601U, 0x06C0U, 0x0780U, 0xC741U, 0x0500U, 0xC5C1U, 0xC481U, 0x0440U,
+        0xCC01U, 0x0CC0U, 0x0D80U, 0xCD41U, 0x0F00U, 0xCFC1U, 0xCE81U, 0x0E40U,
+        0x0A00U, 0xCAC1U, 0xCB81U, 0x0B40U, 0xC901U, 0x09C0U, 0x0880U, 0xC841U,
+        0xD801U, 0x18C0U, 0x1980U, 0xD941U, 0x1B00U, 0xDBC1U, 0xDA81U, 0x1A40U,
+        0x1E00U, 0xDEC1U, 0xDF81U, 0x1F40U, 0xDD01U, 0x1DC0U, 0x1C80U, 0xDC41U,
+        0x1400U, 0xD4C1U, 0xD581U, 0x1540U, 0xD701U, 0x17C0U, 0x1680U, 0xD641U,
+        0xD201U, 0x12C0U, 0x1380U, 0xD341U, 0x1100U, 0xD1C1U, 0xD081U, 0x1040U,
+        0xF001U, 0x30C0U, 0x3180U, 0xF141U, 0x3300U, 0xF3C1U, 0xF281U, 0x3240U,
+        0x3600U, 0xF6C1U, 0xF781U, 0x3740U, 0xF501U, 0x35C0U, 0x3480U, 0xF441U,
+        0x3C00U, 0xFCC1U, 0xFD81U, 0x3D40U, 0xFF01U, 0x3FC0U, 0x3E80U, 0xFE41U,
+        0xFA01U, 0x3AC0U, 0x3B80U, 0xFB41U, 0x3900U, 0xF9C1U, 0xF881U, 0x3840U,
+        0x2800U, 0xE8C1U, 0xE981U, 0x2940U, 0xEB01U, 0x2BC0U, 0x2A80U, 0xEA41U,
+        0xEE01U, 0x2EC0U, 0x2F80U, 0xEF41U, 0x2D00U, 0xEDC1U, 0xEC81U, 0x2C40U,
+        0xE401U, 0x24C0U, 0x2580U, 0xE541U, 0x2700U, 0xE7C1U, 0xE681U, 0x2640U,
+        0x2200U, 0xE2C1U, 0xE381U, 0x2340U, 0xE101U, 0x21C0U, 0x2080U, 0xE041U,
+        0xA001U, 0x60C0U, 0x6180U, 0xA141U, 0x6300U, 0xA3C1U, 0xA281U, 0x6240U,
+        0x6600U, 0xA6C1U, 0xA781U, 0x6740U, 0xA501U, 0x65C0U, 0x6480U, 0xA441U,
+        0x6C00U, 0xACC1U, 0xAD81U, 0x6D40U, 0xAF01U, 0x6FC0U, 0x6E80U, 0xAE41U,
+        0xAA01U, 0x6AC0U, 0x6B80U, 0xAB41U, 0x6900U, 0xA9C1U, 0xA881U, 0x6840U,
+        0x7800U, 0xB8C1U, 0xB981U, 0x7940U, 0xBB01U, 0x7BC0U, 0x7A80U, 0xBA41U,
+        0xBE01U, 0x7EC0U, 0x7F80U, 0xBF41U, 0x7D00U, 0xBDC1U, 0xBC81U, 0x7C40U,
+        0xB401U, 0x74C0U, 0x7580U, 0xB541U, 0x7700U, 0xB7C1U, 0xB681U, 0x7640U,
+        0x7200U, 0xB2C1U, 0xB381U, 0x7340U, 0xB101U, 0x71C0U, 0x7080U, 0xB041U,
+        0x5000U, 0x90C1U, 0x9181U, 0x5140U, 0x9301U, 0x53C0U, 0x5280U, 0x9241U,
+        0x9601U, 0x56C0U, 0x5780U, 0x9741U, 0x5500U, 0x95C1U, 0x9481U, 0x5440U,
+        0x9C01U, 0x5CC0U, 0x5D80U, 0x9D41U, 0x5F00U, 0x9FC1U, 0x9E81U, 0x5E40U,
+        0x5A00U, 0x9AC1U, 0x9B81U, 0x5B40U, 0x9901U, 0x59C0U, 0x5880U, 0x9841U,
+        0x8801U, 0x48C0U, 0x4980U, 0x8941U, 0x4B00U, 0x8BC1U, 0x8A81U, 0x4A40U,
+        0x4E00U, 0x8EC1U, 0x8F81U, 0x4F40U, 0x8D01U, 0x4DC0U, 0x4C80U, 0x8C41U,
+        0x4400U, 0x84C1U, 0x8581U, 0x4540U, 0x8701U, 0x47C0U, 0x4680U, 0x8641U,
+        0x8201U, 0x42C0U, 0x4380U, 0x8341U, 0x4100U, 0x81C1U, 0x8081U, 0x4040U
+    }
+#if (PACKET_CRC_SLICE_BY_4 == 1)
+    ,
+    {
+        0x0000U, 0x9001U, 0x6001U, 0xF000U, 0xC002U, 0x5003U, 0xA003U, 0x3002U,
+        0xC007U, 0x5006U, 0xA006U, 0x3007U, 0x0005U, 0x9004U, 0x6004U, 0xF005U,
+        0xC00DU, 0x500CU, 0xA00CU, 0x300DU, 0x000FU, 0x900EU, 0x600EU, 0xF00FU,
+        0x000AU, 0x900BU, 0x600BU, 0xF00AU, 0xC008U, 0x5009U, 0xA009U, 0x3008U,
+        0xC019U, 0x5018U, 0xA018U, 0x3019U, 0x001BU, 0x901AU, 0x601AU, 0xF01BU,
+        0x001EU, 0x901FU, 0x601FU, 0xF01EU, 0xC01CU, 0x501DU, 0xA01DU, 0x301CU,
+        0x0014U, 0x9015U, 0x6015U, 0xF014U, 0xC016U, 0x5017U, 0xA017U, 0x3016U,
+        0xC013U, 0x5012U, 0xA012U, 0x3013U, 0x0011U, 0x9010U, 0x6010U, 0xF011U,
+        0xC031U, 0x5030U, 0xA030U, 0x3031U, 0x0033U, 0x9032U, 0x6032U, 0xF033U,
+        0x0036U, 0x9037U, 0x6037U, 0xF036U, 0xC034U, 0x5035U, 0xA035U, 0x3034U,
+        0x003CU, 0x903DU, 0x603DU, 0xF03CU, 0xC03EU, 0x503FU, 0xA03FU, 0x303EU,
+        0xC03BU, 0x503AU, 0xA03AU, 0x303BU, 0x0039U, 0x9038U, 0x6038U, 0xF039U,
+        0x0028U, 0x9029U, 0x6029U, 0xF028U, 0xC02AU, 0x502BU, 0xA02BU, 0x302AU,
+        0xC02FU, 0x502EU, 0xA02EU, 0x302FU, 0x002DU, 0x902CU, 0x602CU, 0xF02DU,
+        0xC025U, 0x5024U, 0xA024U, 0x3025U, 0x0027U, 0x9026U, 0x6026U, 0xF027U,
+        0x0022U, 0x9023U, 0x6023U, 0xF022U, 0xC020U, 0x5021U, 0xA021U, 0x3020U,
+        0xC061U, 0x5060U, 0xA060U, 0x3061U, 0x0063U, 0x9062U, 0x6062U, 0xF063U,
+        0x0066U, 0x9067U, 0x6067U, 0xF066U, 0xC064U, 0x5065U, 0xA065U, 0x3064U,
+        0x006CU, 0x906DU, 0x606DU, 0xF06CU, 0xC06EU, 0x506FU, 0xA06FU, 0x306EU,
+        0xC06BU, 0x506AU, 0xA06AU, 0x306BU, 0x0069U, 0x9068U, 0x6068U, 0xF069U,
+        0x0078U, 0x9079U, 0x6079U, 0xF078U, 0xC07AU, 0x507BU, 0xA07BU, 0x307AU,
+        0xC07FU, 0x507EU, 0xA07EU, 0x307FU, 0x007DU, 0x907CU, 0x607CU, 0xF07DU,
+        0xC075U, 0x5074U, 0xA074U, 0x3075U, 0x0077U, 0x9076U, 0x6076U, 0xF077U,
+        0x0072U, 0x9073U, 0x6073U, 0xF072U, 0xC070U, 0x5071U, 0xA071U, 0x3070U,
+        0x0050U, 0x9051U, 0x6051U, 0xF050U, 0xC052U, 0x5053U, 0xA053U, 0x3052U,
+        0xC057U, 0x5056U, 0xA056U, 0x3057U, 0x0055U, 0x9054U, 0x6054U, 0xF055U,
+        0xC05DU, 0x505CU, 0xA05CU, 0x305DU, 0x005FU, 0x905EU, 0x605EU, 0xF05FU,
+        0x005AU, 0x905BU, 0x605BU, 0xF05AU, 0xC058U, 0x5059U, 0xA059U, 0x3058U,
+        0xC049U, 0x5048U, 0xA048U, 0x3049U, 0x004BU, 0x904AU, 0x604AU, 0xF04BU,
+        0x004EU, 0x904FU, 0x604FU, 0xF04EU, 0xC04CU, 0x504DU, 0xA04DU, 0x304CU,
+        0x0044U, 0x9045U, 0x6045U, 0xF044U, 0xC046U, 0x5047U, 0xA047U, 0x3046U,
+        0xC043U, 0x5042U, 0xA042U, 0x3043U, 0x0041U, 0x9040U, 0x6040U, 0xF041U
+    },
+    {
+        0x0000U, 0xC051U, 0xC0A1U, 0x00F0U, 0xC141U, 0x0110U, 0x01E0U, 0xC1B1U,
+        0xC281U, 0x02D0U, 0x0220U, 0xC271U, 0x03C0U, 0xC391U, 0xC361U, 0x0330U,
+        0xC501U, 0x0550U, 0x05A0U, 0xC5F1U, 0x0440U, 0xC411U, 0xC4E1U, 0x04B0U,
+        0x0780U, 0xC7D1U, 0xC721U, 0x0770U, 0xC6C1U, 0x0690U, 0x0660U, 0xC631U,
+        0xCA01U, 0x0A50U, 0x0AA0U, 0xCAF1U, 0x0B40U, 0xCB11U, 0xCBE1U, 0x0BB0U,
+        0x0880U, 0xC8D1U, 0xC821U, 0x0870U, 0xC9C1U, 0x0990U, 0x0960U, 0xC931U,
+        0x0F00U, 0xCF51U, 0xCFA1U, 0x0FF0U, 0xCE41U, 0x0E10U, 0x0EE0U, 0xCEB1U,
+        0xCD81U, 0x0DD0U, 0x0D20U, 0xCD71U, 0x0CC0U, 0xCC91U, 0xCC61U, 0x0C30U,
+        0xD401U, 0x1450U, 0x14A0U, 0xD4F1U, 0x1540U, 0xD511U, 0xD5E1U, 0x15B0U,
+        0x1680U, 0xD6D1U, 0xD621U, 0x1670U, 0xD7C1U, 0x1790U, 0x1760U, 0xD731U,
+        0x1100U, 0xD151U, 0xD1A1U, 0x11F0U, 0xD041U, 0x1010U, 0x10E0U, 0xD0B1U,
+        0xD381U, 0x13D0U, 0x1320U, 0xD371U, 0x12C0U, 0xD291U, 0xD261U, 0x1230U,
+        0x1E00U, 0xDE51U, 0xDEA1U, 0x1EF0U, 0xDF41U, 0x1F10U, 0x1FE0U, 0xDFB1U,
+        0xDC81U, 0x1CD0U, 0x1C20U, 0xDC71U, 0x1DC0U, 0xDD91U, 0xDD61U, 0x1D30U,
+        0xDB01U, 0x1B50U, 0x1BA0U, 0xDBF1U, 0x1A40U, 0xDA11U, 0xDAE1U, 0x1AB0U,
+        0x1980U, 0xD9D1U, 0xD921U, 0x1970U, 0xD8C1U, 0x1890U, 0x1860U, 0xD831U,
+        0xE801U, 0x2850U, 0x28A0U, 0xE8F1U, 0x2940U, 0xE911U, 0xE9E1U, 0x29B0U,
+        0x2A80U, 0xEAD1U, 0xEA21U, 0x2A70U, 0xEBC1U, 0x2B90U, 0x2B60U, 0xEB31U,
+        0x2D00U, 0xED51U, 0xEDA1U, 0x2DF0U, 0xEC41U, 0x2C10U, 0x2CE0U, 0xECB1U,
+        0xEF81U, 0x2FD0U, 0x2F20U, 0xEF71U, 0x2EC0U, 0xEE91U, 0xEE61U, 0x2E30U,
+        0x2200U, 0xE251U, 0xE2A1U, 0x22F0U, 0xE341U, 0x2310U, 0x23E0U, 0xE3B1U,
+        0xE081U, 0x20D0U, 0x2020U, 0xE071U, 0x21C0U, 0xE191U, 0xE161U, 0x2130U,
+        0xE701U, 0x2750U, 0x27A0U, 0xE7F1U, 0x2640U, 0xE611U, 0xE6E1U, 0x26B0U,
+        0x2580U, 0xE5D1U, 0xE521U, 0x2570U, 0xE4C1U, 0x2490U, 0x2460U, 0xE431U,
+        0x3C00U, 0xFC51U, 0xFCA1U, 0x3CF0U, 0xFD41U, 0x3D10U, 0x3DE0U, 0xFDB1U,
+        0xFE81U, 0x3ED0U, 0x3E20U, 0xFE71U, 0x3FC0U, 0xFF91U, 0xFF61U, 0x3F30U,
+        0xF901U, 0x3950U, 0x39A0U, 0xF9F1U, 0x3840U, 0xF811U, 0xF8E1U, 0x38B0U,
+        0x3B80U, 0xFBD1U, 0xFB21U, 0x3B70U, 0xFAC1U, 0x3A90U, 0x3A60U, 0xFA31U,
+        0xF601U, 0x3650U, 0x36A0U, 0xF6F1U, 0x3740U, 0xF711U, 0xF7E1U, 0x37B0U,
+        0x3480U, 0xF4D1U, 0xF421U, 0x3470U, 0xF5C1U, 0x3590U, 0x3560U, 0xF531U,
+        0x3300U, 0xF351U, 0xF3A1U, 0x33F0U, 0xF241U, 0x3210U, 0x32E0U, 0xF2B1U,
+        0xF181U, 0x31D0U, 0x3120U, 0xF171U, 0x30C0U, 0xF091U, 0xF061U, 0x3030U
+    },
+    {
+        0x0000U, 0xFC01U, 0xB801U, 0x4400U, 0x3001U, 0xCC00U, 0x8800U, 0x7401U,
+        0x6002U, 0x9C03U, 0xD803U, 0x2402U, 0x5003U, 0xAC02U, 0xE802U, 0x1403U,
+        0xC004U, 0x3C05U, 0x7805U, 0x8404U, 0xF005U, 0x0C04U, 0x4804U, 0xB405U,
+        0xA006U, 0x5C07U, 0x1807U, 0xE406U, 0x9007U, 0x6C06U, 0x2806U, 0xD407U,
+        0xC00BU, 0x3C0AU, 0x780AU, 0x840BU, 0xF00AU, 0x0C0BU, 0x480BU, 0xB40AU,
+        0xA009U, 0x5C08U, 0x1808U, 0xE409U, 0x9008U, 0x6C09U, 0x2809U, 0xD408U,
+        0x000FU, 0xFC0EU, 0xB80EU, 0x440FU, 0x300EU, 0xCC0FU, 0x880FU, 0x740EU,
+        0x600DU, 0x9C0CU, 0xD80CU, 0x240DU, 0x500CU, 0xAC0DU, 0xE80DU, 0x140CU,
+        0xC015U, 0x3C14U, 0x7814U, 0x8415U, 0xF014U, 0x0C15U, 0x4815U, 0xB414U,
+        0xA017U, 0x5C16U, 0x1816U, 0xE417U, 0x9016U, 0x6C17U, 0x2817U, 0xD416U,
+        0x0011U, 0xFC10U, 0xB810U, 0x4411U, 0x3010U, 0xCC11U, 0x8811U, 0x7410U,
+        0x6013U, 0x9C12U, 0xD812U, 0x2413U, 0x5012U, 0xAC13U, 0xE813U, 0x1412U,
+        0x001EU, 0xFC1FU, 0xB81FU, 0x441EU, 0x301FU, 0xCC1EU, 0x881EU, 0x741FU,
+        0x601CU, 0x9C1DU, 0xD81DU, 0x241CU, 0x501DU, 0xAC1CU, 0xE81CU, 0x141DU,
+        0xC01AU, 0x3C1BU, 0x781BU, 0x841AU, 0xF01BU, 0x0C1AU, 0x481AU, 0xB41BU,
+        0xA018U, 0x5C19U, 0x1819U, 0xE418U, 0x9019U, 0x6C18U, 0x2818U, 0xD419U,
+        0xC029U, 0x3C28U, 0x7828U, 0x8429U, 0xF028U, 0x0C29U, 0x4829U, 0xB428U,
+        0xA02BU, 0x5C2AU, 0x182AU, 0xE42BU, 0x902AU, 0x6C2BU, 0x282BU, 0xD42AU,
+        0x002DU, 0xFC2CU, 0xB82CU, 0x442DU, 0x302CU, 0xCC2DU, 0x882DU, 0x742CU,
+        0x602FU, 0x9C2EU, 0xD82EU, 0x242FU, 0x502EU, 0xAC2FU, 0xE82FU, 0x142EU,
+        0x0022U, 0xFC23U, 0xB823U, 0x4422U, 0x3023U, 0xCC22U, 0x8822U, 0x7423U,
+        0x6020U, 0x9C21U, 0xD821U, 0x2420U, 0x5021U, 0xAC20U, 0xE820U, 0x1421U,
+        0xC026U, 0x3C27U, 0x7827U, 0x8426U, 0xF027U, 0x0C26U, 0x4826U, 0xB427U,
+        0xA024U, 0x5C25U, 0x1825U, 0xE424U, 0x9025U, 0x6C24U, 0x2824U, 0xD425U,
+        0x003CU, 0xFC3DU, 0xB83DU, 0x443CU, 0x303DU, 0xCC3CU, 0x883CU, 0x743DU,
+        0x603EU, 0x9C3FU, 0xD83FU, 0x243EU, 0x503FU, 0xAC3EU, 0xE83EU, 0x143FU,
+        0xC038U, 0x3C39U, 0x7839U, 0x8438U, 0xF039U, 0x0C38U, 0x4838U, 0xB439U,
+        0xA03AU, 0x5C3BU, 0x183BU, 0xE43AU, 0x903BU, 0x6C3AU, 0x283AU, 0xD43BU,
+        0xC037U, 0x3C36U, 0x7836U, 0x8437U, 0xF036U, 0x0C37U, 0x4837U, 0xB436U,
+        0xA035U, 0x5C34U, 0x1834U, 0xE435U, 0x9034U, 0x6C35U, 0x2835U, 0xD434U,
+        0x0033U, 0xFC32U, 0xB832U, 0x4433U, 0x3032U, 0xCC33U, 0x8833U, 0x7432U,
+        0x6031U, 0x9C30U, 0xD830U, 0x2431U, 0x5030U, 0xAC31U, 0xE831U, 0x1430U
+    }
+#endif
+#else
+#error "rs_packet: PACKET_CHECK_TYPE not supported"
+#endif
+};
+#endif
 
 /*==================================================================================================
 *                                    LOCAL FUNCTIONS PROTOTYPES
 ==================================================================================================*/
-static uint8_t CheckSum(uint8_t* pData, uint16_t Length);
+static uint16_t CheckSum(uint16_t CheckSumResult, uint8_t* pData, uint16_t Length);
+static uint16_t CheckSumPut(uint8_t* pData, uint16_t CheckSumResult);
+static bool CheckSumMatch(uint8_t* pData, uint16_t CheckSumResult);
+static uint16_t CheckSumUpdate(uint16_t CheckSumResult, uint8_t data);
+static void packet_parser_data(RsPacket *rspacket, uint8_t data);
+static void packet_parser_replay(RsPacket *rspacket);
 /*==================================================================================================
 *                                         LOCAL FUNCTIONS
 ==================================================================================================*/
-static uint8_t CheckSum(uint8_t* pData, uint16_t Length)
+/* fold Length bytes into a running check, start with CHECK_INIT */
+static uint16_t CheckSum(uint16_t CheckSumResult, uint8_t* pData, uint16_t Length)
 {
-    uint16_t CheckSumResult = 0;
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_BCC)
     uint16_t i=0;
     for(i=0;i<Length;i++)
     {
         CheckSumResult ^= pData[i];
     }
     return CheckSumResult;
+#else
+    uint16_t crc = CheckSumResult;
+#if (PACKET_CRC_SLICE_BY_4 == 1)
+    /* fold 4 bytes per step : the 16 bit crc only overlaps the first two bytes */
+    while(Length >= 4U)
+    {
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_CCITT)
+        crc = crc16_table[3][((crc >> 8) ^ pData[0]) & 0xFFU] ^
+              crc16_table[2][(crc ^ pData[1]) & 0xFFU]        ^
+              crc16_table[1][pData[2]]                         ^
+              crc16_table[0][pData[3]];
+#else
+        crc = crc16_table[3][(crc ^ pData[0]) & 0xFFU]        ^
+              crc16_table[2][((crc >> 8) ^ pData[1]) & 0xFFU] ^
+              crc16_table[1][pData[2]]                         ^
+              crc16_table[0][pData[3]];
+#endif
+        pData  += 4;
+        Length -= 4U;
+    }
+#endif
+    while(Length > 0U)
+    {
+        crc = CRC16_UPDATE(crc, *pData);
+        pData++;
+        Length--;
+    }
+    return crc;
+#endif
+}
+
+/* write check sequence behind ETX, return number of bytes written */
+static uint16_t CheckSumPut(uint8_t* pData, uint16_t CheckSumResult)
+{
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_BCC)
+    pData[0] = (uint8_t)CheckSumResult;
+#elif (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_CCITT)
+    pData[0] = (uint8_t)(CheckSumResult >> 8);
+    pData[1] = (uint8_t)(CheckSumResult);
+#else
+    pData[0] = (uint8_t)(CheckSumResult);
+    pData[1] = (uint8_t)(CheckSumResult >> 8);
+#endif
+    return PACKET_CHECK_SIZE;
+}
+
+static bool CheckSumMatch(uint8_t* pData, uint16_t CheckSumResult)
+{
+    uint8_t expect[PACKET_CHECK_SIZE];
+    CheckSumPut(expect, CheckSumResult);
+    return (0 == memcmp(expect, pData, PACKET_CHECK_SIZE));
+}
+
+static uint16_t CheckSumUpdate(uint16_t CheckSumResult, uint8_t data)
+{
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_BCC)
+    return CheckSumResult ^ data;
+#else
+    return CRC16_UPDATE(CheckSumResult, data);
+#endif
+}
+
+/* DATA state : an ETX may end the frame or be payload, keep it aside until the check arrives */
+static void packet_parser_data(RsPacket *rspacket, uint8_t data)
+{
+    if(ETX == data)
+    {
+        rspacket->etx_check     = CheckSumUpdate(rspacket->check, data);
+        rspacket->trailer_count = 0;
+        rspacket->state         = CHECKSUM;
+    }else if(rspacket->length < MAX_PACKET_LENGTH)
+    {
+        rspacket->data[rspacket->length++] = data;
+        rspacket->check = CheckSumUpdate(rspacket->check, data);
+    }else
+    {
+        /* too long for Packet_t, leave it to the line silence */
+        rspacket->state = PACKET_STATE_END;
+    }
+}
+
+/* the ETX seen was payload : take it as data and replay the trailer bytes received behind it */
+static void packet_parser_replay(RsPacket *rspacket)
+{
+    uint8_t trailer[PACKET_CHECK_SIZE];
+    uint8_t i;
+
+    memcpy(trailer, rspacket->trailer, PACKET_CHECK_SIZE);
+    if(rspacket->length < MAX_PACKET_LENGTH)
+    {
+        rspacket->data[rspacket->length++] = ETX;
+        rspacket->check = rspacket->etx_check;
+        rspacket->state = DATA;
+    }else
+    {
+        rspacket->state = PACKET_STATE_END;
+    }
+    for(i = 0; (i < PACKET_CHECK_SIZE) && (rspacket->state == DATA || rspacket->state == CHECKSUM); i++)
+    {
+        if(rspacket->state == DATA)
+        {
+            packet_parser_data(rspacket, trailer[i]);
+        }else
+        {
+            rspacket->trailer[rspacket->trailer_count++] = trailer[i];
+        }
+    }
 }
 
 /*==================================================================================================
 *                                         GLOBAL FUNCTIONS
 ==================================================================================================*/
 
-Frame_e packet_unframe(Packet_t *packet, uint8_t *frame, uint16_t len)
+void packet_parser_init(RsPacket *rspacket, bool eot_is_frame, uint8_t *data)
 {
-    ASSERT((packet!=NULL)&&(frame!=NULL));
+    ASSERT((rspacket!=NULL)&&(data!=NULL));
+    rspacket->eot_is_frame = eot_is_frame;
+    rspacket->data         = data;
+    rspacket->frame_type   = NONE_FRAME;
+    packet_parser_reset(rspacket);
+}
+
+/* drop a partial frame */
+void packet_parser_reset(RsPacket *rspacket)
+{
+    rspacket->state = SYNC;
+}
+
+/*
+ * feed one received byte, return true when a complete and valid frame has been seen.
+ * ACK / NACK / EOT / POLL are final. for STX-led frames true only means ETX and check matched :
+ * a payload byte equal to ETX can be followed by one that matches too, so the frame is complete
+ * only if the line then stays silent (t1.5); a further byte takes the ETX as payload and parsing goes on.
+ */
+bool packet_parser_put(RsPacket *rspacket, uint8_t data)
+{
+    bool frame_done = false;
+
+    switch(rspacket->state)
+    {
+        case SYNC:
+        {
+            rspacket->address = 0xFF;
+            rspacket->length  = 0;
+            switch(data)
+            {
+                case ACK:
+                    rspacket->frame_type = ACK_FRAME;
+                    frame_done = true;
+                    break;
+                case NACK:
+                    rspacket->frame_type = NACK_FRAME;
+                    frame_done = true;
+                    break;
+                case EOT:
+                    rspacket->frame_type = EOT_FRAME;
+                    if(true == rspacket->eot_is_frame)
+                    {
+                        frame_done = true;
+                    }else
+                    {
+                        rspacket->state = ADDRESS;
+                    }
+                    break;
+                case STX:
+                    rspacket->frame_type = RESPOND_FRAME;
+                    rspacket->check      = CHECK_INIT;
+                    rspacket->state      = ADDRESS;
+                    break;
+                default:
+                    /* not a frame start, skip until line silence */
+                    rspacket->frame_type = NONE_FRAME;
+                    rspacket->state      = PACKET_STATE_END;
+                    break;
+            }
+            break;
+        }
+        case ADDRESS:
+        {
+            if((EOT_FRAME == rspacket->frame_type) && (STX == data))
+            {
+                /* EOT(1B) | STX(1B) | SA(1B) ... */
+                rspacket->frame_type = SELLECT_FRAME;
+                rspacket->check      = CHECK_INIT;
+            }else
+            {
+                rspacket->address = data;
+                if(EOT_FRAME == rspacket->frame_type)
+                {
+                    /* EOT(1B) | SA(1B) | POL(1B) */
+                    rspacket->frame_type = POLL_FRAME;
+                }else
+                {
+                    rspacket->check = CheckSumUpdate(rspacket->check, data);
+                }
+                rspacket->state = OP_CODE;
+            }
+            break;
+        }
+        case OP_CODE:
+        {
+            if(POLL_FRAME == rspacket->frame_type)
+            {
+                if(POL == data)
+                {
+                    frame_done = true;
+                }else
+                {
+                    rspacket->state = PACKET_STATE_END;
+                }
+            }else
+            {
+                rspacket->opcode = data;
+                rspacket->check  = CheckSumUpdate(rspacket->check, data);
+                rspacket->state  = DATA;
+            }
+            break;
+        }
+        case DATA:
+        {
+            packet_parser_data(rspacket, data);
+            break;
+        }
+        case CHECKSUM:
+        {
+            if(rspacket->trailer_count == PACKET_CHECK_SIZE)
+            {
+                /* the check matched but the frame goes on : that ETX was payload */
+                packet_parser_replay(rspacket);
+                if(PACKET_STATE_END != rspacket->state)
+                {
+                    frame_done = packet_parser_put(rspacket, data);
+                }
+                break;
+            }
+            rspacket->trailer[rspacket->trailer_count++] = data;
+            if(rspacket->trailer_count == PACKET_CHECK_SIZE)
+            {
+                if(true == CheckSumMatch(rspacket->trailer, rspacket->etx_check))
+                {
+                    /* stays in CHECKSUM until a next byte or the line silence decides */
+                    frame_done = true;
+                }else
+                {
+                    packet_parser_replay(rspacket);
+                }
+            }
+            break;
+        }
+        case PACKET_STATE_END:
+        default:
+            break;
+    }
+
+    if((true == frame_done) && (CHECKSUM != rspacket->state))
+    {
+        rspacket->state = SYNC;
+    }
+    return frame_done;
+}
+
+/* last completed frame, the payload stays in the parser data buffer */
+Frame_e packet_parser_view(RsPacket *rspacket, PacketView_t *view)
+{
+    ASSERT((rspacket!=NULL)&&(view!=NULL));
+    view->address = rspacket->address;
+    view->opcode  = rspacket->opcode;
+    view->data    = rspacket->data;
+    view->length  = 0;
+    if((RESPOND_FRAME == rspacket->frame_type) || (SELLECT_FRAME == rspacket->frame_type))
+    {
+        view->length = rspacket->length;
+    }
+    return rspacket->frame_type;
+}
+
+/* validate a whole frame in place, the view data points into frame */
+Frame_e packet_unframe_view(PacketView_t *view, uint8_t *frame, uint16_t len)
+{
+    ASSERT((view!=NULL)&&(frame!=NULL));
     Frame_e ret = ERROR_FRAME;
-    uint8_t CheckSumResult = 0;
-    packet->address = 0xFF;
+    uint16_t CheckSumResult = 0;
+    view->address = 0xFF;
+    view->opcode  = 0;
+    view->data    = NULL;
+    view->length  = 0;
     if(len > 0)
     {
 		switch(frame[0])
@@ -93,22 +678,27 @@ Frame_e packet_unframe(Packet_t *packet, uint8_t *frame, uint16_t len)
 					/* EOT(1B) | SA(1B) | POL(1B) */
 					if(frame[2] == POL)
 					{
-						packet->address = frame[1];
+						view->address = frame[1];
 						ret = POLL_FRAME;
 					}
-				}else if(len > 3)
+				}else if(len >= (5 + PACKET_CHECK_SIZE))
 				{
 					/* Sellecting masssage*/
-					/* EOT(1B) | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B) */
-					if((frame[1] == STX) && (frame[len - 2] == ETX))
+					/* EOT(1B) | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B/2B) */
+					if((frame[1] == STX) && (frame[len - 1 - PACKET_CHECK_SIZE] == ETX))
 					{
-						CheckSumResult = CheckSum((uint8_t*)&frame[2],len - 3);
-						packet->address = frame[2];
-						packet->opcode  = frame[3];
-						packet->length  = len - 6;
-						if(CheckSumResult == frame[len - 1])
+						CheckSumResult = CheckSum(CHECK_INIT,(uint8_t*)&frame[2],len - 2 - PACKET_CHECK_SIZE);
+						view->address = frame[2];
+						view->opcode  = frame[3];
+						view->length  = len - 5 - PACKET_CHECK_SIZE;
+						if(view->length > MAX_PACKET_LENGTH)
+						{
+							/* does not fit Packet_t */
+							view->length = 0;
+							ret = ERROR_FRAME;
+						}else if(true == CheckSumMatch(&frame[len - PACKET_CHECK_SIZE], CheckSumResult))
 						{
-							memcpy(packet->data,&frame[4],packet->length);
+							view->data = &frame[4];
 							ret = SELLECT_FRAME;
 						}else
 						{
@@ -123,19 +713,23 @@ Frame_e packet_unframe(Packet_t *packet, uint8_t *frame, uint16_t len)
 			}
 			case STX:
 			{
-				if(len > 3)
+				if(len >= (4 + PACKET_CHECK_SIZE))
 				{
 					/* Respond masssage*/
-					/* STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B) */
-					if(frame[len - 2] == ETX)
+					/* STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B/2B) */
+					if(frame[len - 1 - PACKET_CHECK_SIZE] == ETX)
 					{
-						CheckSumResult = CheckSum((uint8_t*)&frame[1],len - 2);
-						packet->address = frame[1];
-						packet->opcode  = frame[2];
-						packet->length  = len - 5;
-						if(CheckSumResult == frame[len - 1])
+						CheckSumResult = CheckSum(CHECK_INIT,(uint8_t*)&frame[1],len - 1 - PACKET_CHECK_SIZE);
+						view->address = frame[1];
+						view->opcode  = frame[2];
+						view->length  = len - 4 - PACKET_CHECK_SIZE;
+						if(view->length > MAX_PACKET_LENGTH)
 						{
-							memcpy(packet->data,&frame[3],packet->length);
+							view->length = 0;
+							ret = ERROR_FRAME;
+						}else if(true == CheckSumMatch(&frame[len - PACKET_CHECK_SIZE], CheckSumResult))
+						{
+							view->data = &frame[3];
 							ret = RESPOND_FRAME;
 						}else{
 							ret = NONE_FRAME;
@@ -155,76 +749,99 @@ Frame_e packet_unframe(Packet_t *packet, uint8_t *frame, uint16_t len)
     return ret;
 }
 
-uint16_t packet_frame(uint8_t *frame, Packet_t *packet, Frame_e frame_type)
+Frame_e packet_unframe(Packet_t *packet, uint8_t *frame, uint16_t len)
 {
-    ASSERT(frame!=NULL);
-    uint16_t i = 0;
+    ASSERT((packet!=NULL)&&(frame!=NULL));
+    PacketView_t view;
+    Frame_e ret = packet_unframe_view(&view, frame, len);
+    packet->address = view.address;
+    if((SELLECT_FRAME == ret) || (RESPOND_FRAME == ret))
+    {
+        packet->opcode = view.opcode;
+        packet->length = view.length;
+        memcpy(packet->data, view.data, view.length);
+    }
+    return ret;
+}
+
+/* frame as header | packet->data | trailer, payload is only read to fold the check */
+uint16_t packet_frame_build(PacketBuilder_t *builder, Packet_t *packet, Frame_e frame_type)
+{
+    ASSERT(builder!=NULL);
     uint16_t j = 0;
+    uint16_t k = 0;
+    uint16_t CheckSumResult = CHECK_INIT;
     uint16_t FrameLength = 0;
-    uint16_t sumLength = 0;
-    if(frame_type <= NONE_FRAME)
+    builder->payload_len = 0;
+    switch(frame_type)
     {
-        switch(frame_type)
-        {
-            case ACK_FRAME:
+        case ACK_FRAME:
+            builder->header[j++] = ACK;
+            break;
+        case NACK_FRAME:
+            builder->header[j++] = NACK;
+            break;
+        case EOT_FRAME:
+            builder->header[j++] = EOT;
+            break;
+        case POLL_FRAME:
+            /* EOT(1B) | SA(1B) | POL(1B) */
+            ASSERT(packet!=NULL);
+            builder->header[j++] = EOT;
+            builder->header[j++] = packet->address;
+            builder->header[j++] = POL;
+            break;
+        case RESPOND_FRAME:
+        case SELLECT_FRAME:
+            /* [EOT(1B)] | STX(1B) | SA(1B) | OP(1B) | Data(nB) | ETX(1B) | BCC(1B/2B) */
+            ASSERT(packet!=NULL);
+            if(packet->length > MAX_PACKET_LENGTH)
             {
-                frame[0] = ACK;
-                FrameLength = 1;
+                /* no frame rather than reading past packet->data */
                 break;
             }
-            case NACK_FRAME:
+            if(SELLECT_FRAME == frame_type)
             {
-                frame[0] = NACK;
-                FrameLength = 1;
-                break;
+                builder->header[j++] = EOT;
             }
-            case EOT_FRAME:
-            {
-                frame[0] = EOT;
-                FrameLength = 1;
-                break;
-            }
-            case RESPOND_FRAME:
-            {
-                ASSERT(packet!=NULL);
-                frame[j++] = STX;
-                frame[j++] = packet->address;
-                frame[j++] = packet->opcode;
-                for(i=0;i<packet->length;i++)
-                {
-                    frame[j++] = packet->data[i];
-                }
-                frame[j++] = ETX;
-                sumLength = j - 1;
-                frame[j++] = CheckSum(&frame[1],sumLength);
-                FrameLength = j;
-                break;
-            }
-            case POLL_FRAME:
-            	frame[j++] = EOT;
-            	frame[j++] = packet->address;
-            	frame[j++] = POL;
-            	FrameLength = j;
-            	break;
-            case SELLECT_FRAME:
-            	frame[j++] = EOT;
-            	frame[j++] = STX;
-            	frame[j++] = packet->address;
-            	frame[j++] = packet->opcode;
-            	for(i=0;i<packet->length;i++)
-				{
-					frame[j++] = packet->data[i];
-				}
-            	frame[j++] = ETX;
-				sumLength = j - 2;
-				frame[j++] = CheckSum(&frame[2],sumLength);
-				FrameLength = j;
-            	break;
-            case ERROR_FRAME: // No error
-            case NONE_FRAME:
-            default:
-                break;
+            builder->header[j++] = STX;
+            builder->header[j++] = packet->address;
+            builder->header[j++] = packet->opcode;
+            builder->payload_len = packet->length;
+            CheckSumResult = CheckSum(CheckSumResult, &builder->header[j - 2], 2);
+            CheckSumResult = CheckSum(CheckSumResult, packet->data, packet->length);
+            builder->trailer[k++] = ETX;
+            CheckSumResult = CheckSum(CheckSumResult, &builder->trailer[0], 1);
+            k += CheckSumPut(&builder->trailer[k], CheckSumResult);
+            break;
+        case ERROR_FRAME: // No error
+        case NONE_FRAME:
+        default:
+            break;
+    }
+    builder->header_len  = j;
+    builder->trailer_len = k;
+    if(j > 0)
+    {
+        FrameLength = j + builder->payload_len + k;
+    }
+    return FrameLength;
+}
+
+uint16_t packet_frame(uint8_t *frame, Packet_t *packet, Frame_e frame_type)
+{
+    ASSERT(frame!=NULL);
+    PacketBuilder_t builder;
+    uint16_t FrameLength = packet_frame_build(&builder, packet, frame_type);
+    if(FrameLength > 0)
+    {
+        memcpy(frame, builder.header, builder.header_len);
+        if(builder.payload_len > 0)
+        {
+            /* control frames may come with packet == NULL */
+            memcpy(&frame[builder.header_len], packet->data, builder.payload_len);
         }
+        memcpy(&frame[builder.header_len + builder.payload_len], builder.trailer, builder.trailer_len);
     }
     return FrameLength;
 }
@@ -27,6 +27,7 @@ typedef enum
 typedef enum
 {
     SYNC,               /**< Looks for a sync character */
+    ADDRESS,            /**< Receives the slave address (or STX behind EOT) */
     OP_CODE,            /**< Receives the op code */
     DATA_LENGTH,        /**< Receives the data size */
     DATA,               /**< Receives the packet data */
@@ -40,6 +41,26 @@ typedef enum
 
 #define RS485_BROADCAST_ADDRESS				0xff
 #define MAX_PACKET_LENGTH       			50
+
+/* frame check sequence (trailer after ETX) */
+#define PACKET_CHECK_BCC					0		// 8-bit XOR, legacy frame format
+#define PACKET_CHECK_CRC16_CCITT			1		// poly 0x1021, init 0xFFFF, MSB sent first
+#define PACKET_CHECK_CRC16_MODBUS			2		// poly 0xA001 (reflected), init 0xFFFF, LSB sent first
+
+#ifndef PACKET_CHECK_TYPE
+#define PACKET_CHECK_TYPE					PACKET_CHECK_BCC
+#endif
+
+/* 1 : CRC-16 runs 4 bytes per step (slicing-by-4), costs 1.5KB more const table */
+#ifndef PACKET_CRC_SLICE_BY_4
+#define PACKET_CRC_SLICE_BY_4				0
+#endif
+
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_BCC)
+#define PACKET_CHECK_SIZE					1
+#else
+#define PACKET_CHECK_SIZE					2
+#endif
 /*==================================================================================================
 *                                  STRUCTURES AND OTHER TYPEDEFS
 ==================================================================================================*/
@@ -50,8 +71,35 @@ typedef struct{
     uint16_t length;
 }Packet_t;
 
+/* frame content left in place : data points into the buffer the frame was received in */
+typedef struct{
+    uint8_t  address;
+    uint8_t  opcode;
+    uint8_t  *data;
+    uint16_t length;
+}PacketView_t;
+
+/* scatter-gather frame : header | packet data (not copied) | trailer */
+typedef struct{
+    uint8_t  header[4];                             // [EOT] | STX | SA | OP, or a whole control frame
+    uint8_t  trailer[1 + PACKET_CHECK_SIZE];        // ETX | BCC
+    uint8_t  header_len;
+    uint8_t  trailer_len;
+    uint16_t payload_len;
+}PacketBuilder_t;
+
 typedef struct{
     PacketRxState_e state;
+    Frame_e         frame_type;                     // frame being received | last completed frame
+    bool            eot_is_frame;                   // true : a lone EOT completes a frame (no EOT-led frame expected)
+    uint8_t         address;
+    uint8_t         opcode;
+    uint16_t        length;                         // data bytes received so far
+    uint16_t        check;                          // running BCC/CRC over SA..data
+    uint16_t        etx_check;                      // running BCC/CRC including the candidate ETX
+    uint8_t         trailer[PACKET_CHECK_SIZE];
+    uint8_t         trailer_count;
+    uint8_t         *data;                          // payload lands here as it arrives, MAX_PACKET_LENGTH bytes
 }RsPacket;
 
 typedef struct{
@@ -62,11 +110,18 @@ typedef struct{
 /*==================================================================================================
 *                                  GLOBAL FUNCTION PROTOTYPES
 ==================================================================================================*/
-//void packet_parser_init(RsPacket *rspacket);
+void packet_parser_init(RsPacket *rspacket, bool eot_is_frame, uint8_t *data);
+void packet_parser_reset(RsPacket *rspacket);
+bool packet_parser_put(RsPacket *rspacket, uint8_t data);
+Frame_e packet_parser_view(RsPacket *rspacket, PacketView_t *view);
 
 uint16_t packet_frame(uint8_t *frame, Packet_t *packet, Frame_e frame_type);
 
+uint16_t packet_frame_build(PacketBuilder_t *builder, Packet_t *packet, Frame_e frame_type);
+
 Frame_e packet_unframe(Packet_t *packet, uint8_t *frame, uint16_t len);
 
+Frame_e packet_unframe_view(PacketView_t *view, uint8_t *frame, uint16_t len);
+
 address_valid_t rs485_address_validate(uint8_t address_src, uint8_t address_dest);
 #endif /* RS_PACKET_H */
@@ -0,0 +1,10 @@
+#ifndef ASSERT_HANDLER_H
+#define ASSERT_HANDLER_H
+
+/* host stand-in for the target assert handler, used by the programs in this folder */
+#include <assert.h>
+#include <stddef.h>
+
+#define ASSERT(x)	assert(x)
+
+#endif /* ASSERT_HANDLER_H */
@@ -0,0 +1,8 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+/* host stand-in for the target debug pins, used by the programs in this folder */
+#define TRIGGER3_PORT_PIN			0
+#define DEV_Digital_Toggle(pin)		((void)(pin))
+
+#endif /* DEBUG_H */
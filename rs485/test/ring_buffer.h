@@ -0,0 +1,63 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+/* host stand-in for the target ring buffer, used by the programs in this folder : fixed size elements, storage from calloc */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_NOT_EMPTY	false
+
+typedef struct{
+	uint8_t		*buf;
+	uint16_t	size;			// elements
+	uint16_t	elem;			// bytes per element
+	uint16_t	count;
+	uint16_t	head;
+	uint16_t	tail;
+}ring_buffer_t;
+
+static inline void ring_buffer_init(ring_buffer_t *rb, uint16_t size, uint16_t elem)
+{
+	rb->buf		= calloc(size, elem);
+	rb->size	= size;
+	rb->elem	= elem;
+	rb->count	= 0;
+	rb->head	= 0;
+	rb->tail	= 0;
+}
+
+static inline bool ring_buffer_is_empty(ring_buffer_t *rb)
+{
+	return (rb->count == 0U);
+}
+
+static inline bool ring_buffer_is_full(ring_buffer_t *rb)
+{
+	return (rb->count == rb->size);
+}
+
+static inline bool ring_buffer_put(ring_buffer_t *rb, void *pdata)
+{
+	if(ring_buffer_is_full(rb)){
+		return false;
+	}
+	memcpy(&rb->buf[rb->head * rb->elem], pdata, rb->elem);
+	rb->head = (uint16_t)((rb->head + 1U) % rb->size);
+	rb->count++;
+	return true;
+}
+
+static inline bool ring_buffer_get(ring_buffer_t *rb, void *pdata)
+{
+	if(ring_buffer_is_empty(rb)){
+		return false;
+	}
+	memcpy(pdata, &rb->buf[rb->tail * rb->elem], rb->elem);
+	rb->tail = (uint16_t)((rb->tail + 1U) % rb->size);
+	rb->count--;
+	return true;
+}
+
+#endif /* RING_BUFFER_H */
@@ -0,0 +1,306 @@
+/*
+ * host runs of a master and a slave on the bus model (rs485_sim.h), one build per check type, run from rs485/ :
+ *   gcc -O2 -Itest test/rs485_bus_sim.c -o bus_sim && ./bus_sim
+ *   (-DPACKET_CHECK_TYPE=1 | 2 as for rs_packet_bench.c, -fsanitize=address,undefined works too)
+ * both sides send a message every 500 ticks (100 ms), every message received is checked against the one sent :
+ * default traffic, payloads full of ETX, two channels, frames sent as iovec, 921600 baud negotiation,
+ * the same traffic through rs485_multi, four absent slaves next to a live one.
+ * exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../rs_packet.c"
+#include "../rs485_trace.c"
+#include "../rs485.c"
+#include "../rs485_multi.c"
+#include "rs485_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define BUS_PERIOD			500UL			// ticks between two messages of a side
+#define BUS_TICKS			200000UL		// 40 s
+#define BUS_ETX_TICKS		2000000UL		// 400 s
+#define BUS_DEAD_TICKS		(300UL * SIM_TICKS_PER_S)
+#define BUS_DEAD_SLAVES		4
+#define BUS_FAST_BAUD		921600UL
+#define BUS_OPCODE			1
+#define BUS_OPCODE_SECOND	2				// messages of the second channel
+#define BUS_RESYNC			8				// messages looked ahead for after a loss
+
+#define BUS_EXPECT(cond, ...)	do{ if(!(cond)){ if(bus_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+typedef struct{
+    const char              *name;
+    unsigned long           ticks;
+    bool                    is_etx;             // payloads full of ETX, odd bytes all ETX
+    bool                    is_txv;
+    bool                    is_multi;
+    bool                    is_second;          // a second channel (0x22) on both sides
+    uint32_t                baud_max;           // 0 : no negotiation
+    uint8_t                 dead;               // absent slaves polled by the master
+    const rs485_backoff_t   *backoff;           // re-poll of the absent slaves, NULL : default
+}bus_case_t;
+
+/* one direction of a channel : message n sent, message n expected next */
+typedef struct{
+    uint8_t                 channel_id;
+    uint8_t                 opcode;
+    unsigned long           sent;
+    unsigned long           got;                // messages accounted for : received, wrong or lost
+    unsigned long           wrong;              // received but not the message sent (truncated, corrupted)
+    unsigned long           lost;
+}bus_flow_t;
+
+typedef struct{
+    bus_flow_t                  flow[4];        // master -> slave, slave -> master, then the second channel
+    unsigned long               probes;         // no response count of the absent slaves
+    rs485_channel_telemetry_t   channel;        // master side of the first channel
+    rs485_bus_telemetry_t       bus;            // master
+}bus_result_t;
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long bus_fail = 0;
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+/* message n of a flow, rebuilt on the receiving side to check it */
+static void bus_message(const bus_case_t *test, const bus_flow_t *flow, unsigned long n, rs485_msg *msg)
+{
+    uint8_t seed = (uint8_t)(n * 13U + 7U);
+    memset(msg, 0, sizeof(rs485_msg));
+    msg->opcode = flow->opcode;
+    msg->length = (uint16_t)((true == test->is_etx) ? (1U + (n % 50U)) : (10U + (n % 40U)));
+    for(uint16_t i = 0; i < msg->length; i++)
+    {
+        if(true == test->is_etx)
+        {
+            msg->data[i] = (i == 0) ? seed : ((i % 2U) ? ETX : (uint8_t)((i * 151U + msg->length * 17U) ^ (seed * 29U)));
+        }
+        else
+        {
+            msg->data[i] = (uint8_t)(i * 7U + msg->length + seed);
+        }
+    }
+}
+
+static void bus_send(const bus_case_t *test, rs485_t *bus, bus_flow_t *flow)
+{
+    rs485_msg msg;
+    bus_message(test, flow, flow->sent, &msg);
+    if(true == rs485_transmit(bus, flow->channel_id, &msg))
+    {
+        flow->sent++;
+    }
+}
+
+/* the next expected message or one a little further : the ones skipped are lost, a message matching none is wrong */
+static void bus_receive(const bus_case_t *test, rs485_t *bus, bus_flow_t *flow)
+{
+    rs485_msg msg;
+    rs485_msg expected;
+    while(true == rs485_receive(bus, flow->channel_id, &msg))
+    {
+        unsigned long n;
+        for(n = flow->got; n < flow->got + BUS_RESYNC; n++)
+        {
+            bus_message(test, flow, n, &expected);
+            if((msg.opcode == expected.opcode) && (msg.length == expected.length) && (0 == memcmp(msg.data, expected.data, msg.length)))
+            {
+                break;
+            }
+        }
+        if(n == flow->got + BUS_RESYNC)
+        {
+            flow->wrong++;
+            flow->got++;
+        }
+        else
+        {
+            flow->lost += n - flow->got;
+            flow->got = n + 1U;
+        }
+    }
+}
+
+static void bus_run(const bus_case_t *test, bus_result_t *result)
+{
+    uint8_t dead_id[BUS_DEAD_SLAVES];
+    rs485_t *master = &sim_master.bus;
+    rs485_t *slave = &sim_slave.bus;
+
+    memset(result, 0, sizeof(bus_result_t));
+    sim_init(test->is_txv, test->is_multi);
+    result->flow[0].opcode = BUS_OPCODE;
+    result->flow[1].opcode = BUS_OPCODE;
+    rs485_channel_init(master, SIM_SLAVE_ADDRESS, &result->flow[0].channel_id, true, true, 4, 4);
+    rs485_channel_init(slave, SIM_SLAVE_ADDRESS, &result->flow[1].channel_id, true, true, 4, 4);
+    if(true == test->is_second)
+    {
+        result->flow[2].opcode = BUS_OPCODE_SECOND;
+        result->flow[3].opcode = BUS_OPCODE_SECOND;
+        rs485_channel_init(master, SIM_SLAVE_ADDRESS + 1, &result->flow[2].channel_id, true, true, 4, 4);
+        rs485_channel_init(slave, SIM_SLAVE_ADDRESS + 1, &result->flow[3].channel_id, true, true, 4, 4);
+    }
+    for(uint8_t i = 0; i < test->dead; i++)
+    {
+        rs485_channel_init(master, (uint8_t)(SIM_SLAVE_ADDRESS + 1 + i), &dead_id[i], false, true, 4, 4);
+        if(test->backoff != NULL)
+        {
+            BUS_EXPECT(true == rs485_channel_set_backoff(master, dead_id[i], test->backoff), "%s : backoff refused", test->name);
+        }
+    }
+    if(test->baud_max != 0)
+    {
+        rs485_channel_set_baud(master, result->flow[0].channel_id, test->baud_max);
+        rs485_set_baud_max(slave, test->baud_max);
+    }
+    sim_start();
+
+    for(unsigned long t = 0; t < test->ticks; t++)
+    {
+        sim_run_tick();
+        if((t % BUS_PERIOD) == 0)
+        {
+            if(RS485_CHANNEL_ONLINE_STATE == rs485_get_channelState(master, result->flow[0].channel_id))
+            {
+                bus_send(test, master, &result->flow[0]);
+            }
+            bus_send(test, slave, &result->flow[1]);
+            if(true == test->is_second)
+            {
+                bus_send(test, master, &result->flow[2]);
+                bus_send(test, slave, &result->flow[3]);
+            }
+        }
+        bus_receive(test, slave, &result->flow[0]);
+        bus_receive(test, master, &result->flow[1]);
+        if(true == test->is_second)
+        {
+            bus_receive(test, slave, &result->flow[2]);
+            bus_receive(test, master, &result->flow[3]);
+        }
+    }
+
+    for(uint8_t i = 0; i < test->dead; i++)
+    {
+        rs485_channel_telemetry_t dead;
+        rs485_get_channel_telemetry(master, dead_id[i], &dead);
+        result->probes += dead.no_resp_count;
+    }
+    rs485_get_channel_telemetry(master, result->flow[0].channel_id, &result->channel);
+    rs485_get_bus_telemetry(master, &result->bus);
+    sim_free();
+}
+
+/* every message sent arrived, in order and intact, at most the ones still queued or on the line missing */
+static void bus_check(const bus_case_t *test, const bus_result_t *result)
+{
+    uint8_t flows = (true == test->is_second) ? 4 : 2;
+    for(uint8_t i = 0; i < flows; i++)
+    {
+        const bus_flow_t *flow = &result->flow[i];
+        BUS_EXPECT((flow->wrong == 0) && (flow->lost == 0), "%s : flow %u, %lu wrong %lu lost of %lu", test->name, i, flow->wrong, flow->lost, flow->got);
+        BUS_EXPECT((flow->got <= flow->sent) && (flow->got + 4U >= flow->sent) && (flow->sent >= (test->ticks / BUS_PERIOD) - 4U),
+                   "%s : flow %u, %lu sent %lu got", test->name, i, flow->sent, flow->got);
+    }
+}
+
+static void bus_print(const bus_case_t *test, const bus_result_t *result)
+{
+    unsigned long wrong = 0;
+    unsigned long lost = 0;
+    for(uint8_t i = 0; i < 4; i++)
+    {
+        wrong += result->flow[i].wrong;
+        lost += result->flow[i].lost;
+    }
+    printf("%-26s : M->S %5lu/%5lu  S->M %5lu/%5lu  wrong %lu  lost %lu  busy %4.1f %%  err %u  no resp %u\n", test->name,
+           result->flow[0].got - result->flow[0].lost, result->flow[0].sent, result->flow[1].got - result->flow[1].lost, result->flow[1].sent,
+           wrong, lost, 100.0 * result->bus.busy_ticks / result->bus.total_ticks, result->channel.err_count, result->channel.no_resp_count);
+}
+
+static void bus_traffic(void)
+{
+    static const bus_case_t tests[] = {
+        {.name = "default",                 .ticks = BUS_TICKS},
+        {.name = "payloads full of ETX",    .ticks = BUS_ETX_TICKS, .is_etx = true},
+        {.name = "ETX payloads, iovec",     .ticks = BUS_TICKS, .is_etx = true, .is_txv = true},
+        {.name = "two channels",            .ticks = BUS_TICKS, .is_second = true},
+        {.name = "921600 baud",             .ticks = BUS_TICKS, .baud_max = BUS_FAST_BAUD},
+    };
+    bus_result_t result;
+
+    for(uint8_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    {
+        bus_run(&tests[i], &result);
+        bus_print(&tests[i], &result);
+        bus_check(&tests[i], &result);
+        if(tests[i].is_second)
+        {
+            printf("%-26s   0x22 M->S %5lu/%5lu  S->M %5lu/%5lu\n", "", result.flow[2].got - result.flow[2].lost, result.flow[2].sent, result.flow[3].got - result.flow[3].lost, result.flow[3].sent);
+        }
+        if(tests[i].baud_max != 0)
+        {
+            BUS_EXPECT((sim_master.baud == tests[i].baud_max) && (sim_slave.baud == tests[i].baud_max), "%s : line at %u / %u",
+                       tests[i].name, sim_master.baud, sim_slave.baud);
+        }
+    }
+}
+
+/* the same traffic serviced by rs485_multi : counts and telemetry as with rs485_process on each bus every tick */
+static void bus_runtime(void)
+{
+    static const bus_case_t direct = {.name = "default, rs485_process", .ticks = BUS_TICKS};
+    static const bus_case_t multi = {.name = "default, rs485_multi", .ticks = BUS_TICKS, .is_multi = true};
+    static bus_result_t expected;
+    static bus_result_t result;
+
+    bus_run(&direct, &expected);
+    bus_run(&multi, &result);
+    bus_print(&multi, &result);
+    bus_check(&multi, &result);
+    BUS_EXPECT(0 == memcmp(expected.flow, result.flow, sizeof(result.flow)), "rs485_multi : message counts differ");
+    BUS_EXPECT(0 == memcmp(&expected.channel, &result.channel, sizeof(result.channel)), "rs485_multi : channel telemetry differs");
+    BUS_EXPECT(0 == memcmp(&expected.bus, &result.bus, sizeof(result.bus)), "rs485_multi : bus telemetry differs");
+}
+
+/* absent slaves next to a live one : probes with the default backoff, then a fixed 5 s re-poll */
+static void bus_dead(void)
+{
+    static const rs485_backoff_t fixed = {.min_us = 5000000UL, .max_us = 5000000UL, .jitter_percent = 0};
+    static const bus_case_t backoff = {.name = "4 absent slaves, backoff", .ticks = BUS_DEAD_TICKS, .dead = BUS_DEAD_SLAVES};
+    static const bus_case_t every_5s = {.name = "4 absent slaves, every 5 s", .ticks = BUS_DEAD_TICKS, .dead = BUS_DEAD_SLAVES, .backoff = &fixed};
+    bus_result_t result;
+    unsigned long probes;
+
+    bus_run(&backoff, &result);
+    bus_print(&backoff, &result);
+    bus_check(&backoff, &result);
+    probes = result.probes;
+    bus_run(&every_5s, &result);
+    bus_print(&every_5s, &result);
+    bus_check(&every_5s, &result);
+    printf("%-26s : %lu with backoff, %lu every 5 s\n", "probes to absent slaves, 300 s", probes, result.probes);
+    BUS_EXPECT(probes < result.probes, "backoff : %lu probes, fixed : %lu", probes, result.probes);
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+    printf("check type %u, tick %u us\n", PACKET_CHECK_TYPE, RS485_TICK_US);
+    bus_traffic();
+    bus_runtime();
+    bus_dead();
+    printf("bus sim : %lu failed\n", bus_fail);
+    return (bus_fail > 255U) ? 255 : (int)bus_fail;
+}
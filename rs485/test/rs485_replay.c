@@ -0,0 +1,371 @@
+/*
+ * host replay of an rs485 trace dump (rs485_trace_dump, layout in rs485_trace.h) into the bus model (rs485_sim.h),
+ * run from rs485/ :
+ *   gcc -O2 -Itest test/rs485_replay.c -o replay && ./replay [dump]
+ * without a dump : 20 s of bursty traffic on the model is captured from the master first, dumped, then replayed.
+ * the messages the traced node sent (acked) and received are queued again on the model at their captured tick,
+ * on as many channels as the trace names, payload = the 8 bytes kept then filler.
+ * every replayed message has to arrive intact, exit code = number of failures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RS485_TRACE_RECORD_NUMBER	32768
+
+#include "../rs_packet.c"
+#include "../rs485_trace.c"
+#include "../rs485.c"
+#include "../rs485_multi.c"
+#include "rs485_sim.h"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define REPLAY_RECORD_SIZE		24					// dump format, little endian
+#define REPLAY_MAX_EVENTS		8192
+#define REPLAY_MAX_CHANNELS		8
+#define REPLAY_DRAIN_TICKS		SIM_TICKS_PER_S		// after the last message
+#define CAPTURE_TICKS			(20UL * SIM_TICKS_PER_S)
+#define CAPTURE_CHANNELS		2
+
+#define REPLAY_EXPECT(cond, ...)	do{ if(!(cond)){ if(replay_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+/* one message of the trace : sent by the master (to the slave) or by the slave */
+typedef struct{
+    uint32_t    tick;                       // from the first record
+    uint8_t     channel;                    // channel_id on the traced node
+    bool        is_from_master;
+    uint8_t     opcode;
+    uint16_t    length;
+    uint8_t     data[RS485_TRACE_DATA_BYTES];
+}replay_event_t;
+
+/* one direction of a channel : next message to queue, next message expected */
+typedef struct{
+    uint32_t    event[REPLAY_MAX_EVENTS];   // index in replay_events, in order
+    uint32_t    count;
+    uint32_t    sent;
+    uint32_t    got;
+    uint32_t    wrong;
+    uint64_t    delay;                      // ticks from the captured tick to delivery, summed
+}replay_flow_t;
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long replay_fail = 0;
+static uint8_t replay_dump[RS485_TRACE_RECORD_NUMBER * REPLAY_RECORD_SIZE];
+static uint32_t replay_dump_size;
+static replay_event_t replay_events[REPLAY_MAX_EVENTS];
+static uint32_t replay_event_count;
+static replay_flow_t replay_flow[REPLAY_MAX_CHANNELS][2];    // [channel][0 : master -> slave, 1 : slave -> master]
+static uint8_t replay_channels;
+static rs485_trace_t capture_trace;
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static uint32_t replay_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void replay_record(const uint8_t *p, rs485_trace_record_t *record)
+{
+    record->seq         = replay_le32(&p[0]);
+    record->tick        = replay_le32(&p[4]);
+    record->type        = p[8];
+    record->frame       = p[9];
+    record->address     = p[10];
+    record->opcode      = p[11];
+    record->length      = (uint16_t)(p[12] | (p[13] << 8));
+    record->channel_id  = p[14];
+    record->bus_mode    = p[15];
+    memcpy(record->data, &p[16], RS485_TRACE_DATA_BYTES);
+}
+
+/* message of an event : the bytes the trace kept, then filler the receiver can rebuild */
+static void replay_message(const replay_event_t *event, rs485_msg *msg)
+{
+    memset(msg, 0, sizeof(rs485_msg));
+    msg->opcode = event->opcode;
+    msg->length = event->length;
+    for(uint16_t i = 0; i < event->length; i++)
+    {
+        msg->data[i] = (i < RS485_TRACE_DATA_BYTES) ? event->data[i] : (uint8_t)(i * 7U + event->length);
+    }
+}
+
+static void replay_add(const rs485_trace_record_t *record, uint32_t first_tick, bool is_from_master)
+{
+    replay_event_t *event;
+    replay_flow_t *flow;
+
+    if((replay_event_count == REPLAY_MAX_EVENTS) || (record->channel_id >= REPLAY_MAX_CHANNELS) || (record->length > MAX_PACKET_LENGTH))
+    {
+        REPLAY_EXPECT(false, "record %u : event dropped, channel %u length %u", record->seq, record->channel_id, record->length);
+        return;
+    }
+    event = &replay_events[replay_event_count];
+    event->tick             = record->tick - first_tick;
+    event->channel          = record->channel_id;
+    event->is_from_master   = is_from_master;
+    event->opcode           = record->opcode;
+    event->length           = record->length;
+    memcpy(event->data, record->data, RS485_TRACE_DATA_BYTES);
+    flow = &replay_flow[event->channel][is_from_master ? 0 : 1];
+    flow->event[flow->count++] = replay_event_count++;
+    if(event->channel >= replay_channels)
+    {
+        replay_channels = (uint8_t)(event->channel + 1U);
+    }
+}
+
+/*
+ * frames of the traced node -> messages : a data frame it sent counts once the next frame it receives is an ACK
+ * (a retry shows up as a second frame), a data frame received from the other side counts as is.
+ */
+static void replay_parse(void)
+{
+    rs485_trace_record_t record;
+    rs485_trace_record_t pending;
+    bool is_pending = false;
+    uint32_t first_tick = 0;
+
+    for(uint32_t offset = 0; offset + REPLAY_RECORD_SIZE <= replay_dump_size; offset += REPLAY_RECORD_SIZE)
+    {
+        replay_record(&replay_dump[offset], &record);
+        bool is_master = (MASTER_MODE == record.bus_mode);
+        if(offset == 0)
+        {
+            first_tick = record.tick;
+        }
+        if(RS485_TRACE_TX == record.type)
+        {
+            is_pending = ((true == is_master) ? SELLECT_FRAME : RESPOND_FRAME) == record.frame;
+            pending = record;
+        }
+        else if(RS485_TRACE_RX == record.type)
+        {
+            if((true == is_pending) && (ACK_FRAME == record.frame))
+            {
+                replay_add(&pending, first_tick, is_master);
+            }
+            else if(((true == is_master) ? RESPOND_FRAME : SELLECT_FRAME) == record.frame)
+            {
+                replay_add(&record, first_tick, !is_master);
+            }
+            is_pending = false;
+        }
+    }
+}
+
+static void replay_receive(rs485_t *bus, uint8_t channel, replay_flow_t *flow)
+{
+    rs485_msg msg;
+    rs485_msg expected;
+    while(true == rs485_receive(bus, channel, &msg))
+    {
+        if(flow->got == flow->sent)
+        {
+            flow->wrong++;
+            continue;
+        }
+        const replay_event_t *event = &replay_events[flow->event[flow->got]];
+        replay_message(event, &expected);
+        if((msg.opcode != expected.opcode) || (msg.length != expected.length) || (0 != memcmp(msg.data, expected.data, msg.length)))
+        {
+            flow->wrong++;
+        }
+        flow->delay += sim_tick - event->tick;
+        flow->got++;
+    }
+}
+
+/* the model with one channel per channel the trace names, each message queued at its tick (or as soon as there is room) */
+static void replay_run(void)
+{
+    uint8_t master_id[REPLAY_MAX_CHANNELS];
+    uint8_t slave_id[REPLAY_MAX_CHANNELS];
+    uint32_t last_tick = 0;
+    rs485_bus_telemetry_t bus;
+    rs485_channel_telemetry_t channel;
+    rs485_msg msg;
+
+    sim_init(false, false);
+    for(uint8_t i = 0; i < replay_channels; i++)
+    {
+        rs485_channel_init(&sim_master.bus, (uint8_t)(SIM_SLAVE_ADDRESS + i), &master_id[i], true, true, 8, 8);
+        rs485_channel_init(&sim_slave.bus, (uint8_t)(SIM_SLAVE_ADDRESS + i), &slave_id[i], true, true, 8, 8);
+    }
+    for(uint32_t i = 0; i < replay_event_count; i++)
+    {
+        last_tick = (replay_events[i].tick > last_tick) ? replay_events[i].tick : last_tick;
+    }
+    sim_start();
+
+    while(sim_tick < last_tick + REPLAY_DRAIN_TICKS)
+    {
+        sim_run_tick();
+        for(uint8_t i = 0; i < replay_channels; i++)
+        {
+            for(uint8_t side = 0; side < 2; side++)
+            {
+                replay_flow_t *flow = &replay_flow[i][side];
+                rs485_t *bus = (side == 0) ? &sim_master.bus : &sim_slave.bus;
+                uint8_t id = (side == 0) ? master_id[i] : slave_id[i];
+                while((flow->sent < flow->count) && (replay_events[flow->event[flow->sent]].tick <= sim_tick))
+                {
+                    replay_message(&replay_events[flow->event[flow->sent]], &msg);
+                    if(false == rs485_transmit(bus, id, &msg))
+                    {
+                        break;
+                    }
+                    flow->sent++;
+                }
+            }
+            replay_receive(&sim_slave.bus, slave_id[i], &replay_flow[i][0]);
+            replay_receive(&sim_master.bus, master_id[i], &replay_flow[i][1]);
+        }
+    }
+
+    rs485_get_bus_telemetry(&sim_master.bus, &bus);
+    printf("replay, %u channels, %.1f s : busy %.1f %%, bus msg %u, err %u, overrun %u\n", replay_channels,
+           (double)sim_tick / SIM_TICKS_PER_S, 100.0 * bus.busy_ticks / bus.total_ticks,
+           bus.diagnostic._bus_msg_count, bus.diagnostic._bus_err_count, bus.diagnostic._bus_overrun_count);
+    for(uint8_t i = 0; i < replay_channels; i++)
+    {
+        rs485_get_channel_telemetry(&sim_master.bus, master_id[i], &channel);
+        for(uint8_t side = 0; side < 2; side++)
+        {
+            const replay_flow_t *flow = &replay_flow[i][side];
+            printf("  channel %u %s : %u / %u delivered, %u wrong, %.1f ms from the captured tick\n", i, (side == 0) ? "M->S" : "S->M",
+                   flow->got, flow->count, flow->wrong, flow->got ? (double)flow->delay * RS485_TICK_US / 1000.0 / flow->got : 0.0);
+            REPLAY_EXPECT((flow->got == flow->count) && (flow->wrong == 0), "channel %u side %u : %u of %u delivered, %u wrong",
+                          i, side, flow->got, flow->count, flow->wrong);
+        }
+        printf("  channel %u latency", i);
+        for(uint8_t bin = 0; bin < RS485_LATENCY_HIST_BINS; bin++)
+        {
+            printf(" %u", channel.latency_hist[bin]);
+        }
+        printf(" (ticks 0-1, 2-3, 4-7 ...)\n");
+    }
+    sim_free();
+}
+
+static void capture_write(void *ctx, uint32_t offset, uint8_t *pdata, uint32_t len)
+{
+    (void)ctx;
+    memcpy(&replay_dump[offset], pdata, len);
+}
+
+/*
+ * bursts of up to 4 messages a side at random gaps, random lengths, two channels, the master traced.
+ * returns the messages delivered, the replay has to find as many in the dump.
+ */
+static uint32_t capture(void)
+{
+    uint8_t master_id[CAPTURE_CHANNELS];
+    uint8_t slave_id[CAPTURE_CHANNELS];
+    uint32_t next[CAPTURE_CHANNELS][2] = {{0}};
+    uint32_t delivered = 0;
+    rs485_msg msg;
+
+    srand(36);
+    sim_init(false, false);
+    for(uint8_t i = 0; i < CAPTURE_CHANNELS; i++)
+    {
+        rs485_channel_init(&sim_master.bus, (uint8_t)(SIM_SLAVE_ADDRESS + i), &master_id[i], true, true, 8, 8);
+        rs485_channel_init(&sim_slave.bus, (uint8_t)(SIM_SLAVE_ADDRESS + i), &slave_id[i], true, true, 8, 8);
+    }
+    rs485_trace_init(&capture_trace);
+    rs485_set_trace(&sim_master.bus, &capture_trace);
+    sim_start();
+
+    while(sim_tick < CAPTURE_TICKS)
+    {
+        sim_run_tick();
+        for(uint8_t i = 0; i < CAPTURE_CHANNELS; i++)
+        {
+            for(uint8_t side = 0; side < 2; side++)
+            {
+                if((sim_tick >= next[i][side]) && (sim_tick + REPLAY_DRAIN_TICKS < CAPTURE_TICKS))
+                {
+                    uint8_t burst = (uint8_t)(1 + rand() % 4);
+                    for(uint8_t n = 0; n < burst; n++)
+                    {
+                        memset(&msg, 0, sizeof(msg));
+                        msg.opcode = (uint8_t)(1 + rand() % 20);
+                        msg.length = (uint16_t)(rand() % (MAX_PACKET_LENGTH + 1));
+                        for(uint16_t b = 0; b < msg.length; b++)
+                        {
+                            msg.data[b] = (b < RS485_TRACE_DATA_BYTES) ? (uint8_t)rand() : (uint8_t)(b * 7U + msg.length);
+                        }
+                        rs485_transmit((side == 0) ? &sim_master.bus : &sim_slave.bus, (side == 0) ? master_id[i] : slave_id[i], &msg);
+                    }
+                    next[i][side] = sim_tick + 100 + (uint32_t)(rand() % 5000);
+                }
+            }
+            while(true == rs485_receive(&sim_slave.bus, slave_id[i], &msg))
+            {
+                delivered++;
+            }
+            while(true == rs485_receive(&sim_master.bus, master_id[i], &msg))
+            {
+                delivered++;
+            }
+        }
+    }
+    rs485_trace_freeze(&capture_trace, true);
+    REPLAY_EXPECT(capture_trace._seq <= RS485_TRACE_RECORD_NUMBER, "capture : %u records, ring of %u overwritten", capture_trace._seq, RS485_TRACE_RECORD_NUMBER);
+    replay_dump_size = rs485_trace_dump(&capture_trace, NULL, capture_write) * REPLAY_RECORD_SIZE;
+    printf("capture, 20 s : %u messages delivered, %u records\n", delivered, replay_dump_size / REPLAY_RECORD_SIZE);
+    sim_free();
+    return delivered;
+}
+
+static bool replay_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        printf("%s : cannot open\n", path);
+        return false;
+    }
+    replay_dump_size = (uint32_t)fread(replay_dump, 1, sizeof(replay_dump), file);
+    fclose(file);
+    replay_dump_size -= replay_dump_size % REPLAY_RECORD_SIZE;
+    printf("%s : %u records\n", path, replay_dump_size / REPLAY_RECORD_SIZE);
+    return true;
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(int argc, char **argv)
+{
+    uint32_t delivered = 0;
+
+    _Static_assert(sizeof(rs485_trace_record_t) == REPLAY_RECORD_SIZE, "dump record is 24 bytes");
+    if(argc > 1)
+    {
+        if(false == replay_load(argv[1]))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        delivered = capture();
+    }
+    replay_parse();
+    printf("trace : %u messages\n", replay_event_count);
+    REPLAY_EXPECT((argc > 1) || (replay_event_count == delivered), "capture : %u messages delivered, %u found in the dump", delivered, replay_event_count);
+    replay_run();
+    printf("replay : %lu failed\n", replay_fail);
+    return (replay_fail > 255U) ? 255 : (int)replay_fail;
+}
@@ -0,0 +1,204 @@
+#ifndef RS485_SIM_H
+#define RS485_SIM_H
+
+/*
+ * host model of a two node rs485 bus (master + slave), used by the programs in this folder.
+ * include after ../rs_packet.c, ../rs485_trace.c, ../rs485.c and ../rs485_multi.c, build with -Itest.
+ * one shared wire : every byte sent reaches both nodes (own echo included), SIM_BYTES_PER_TICK a tick,
+ * a byte sent at another rate than the receiver's arrives garbled. the tick is RS485_TICK_US of bus time.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define SIM_WIRE_SIZE				4096		// power of 2, bytes in flight
+#define SIM_BYTES_PER_TICK			2			// 115200 baud, 200 us tick : 2.3 characters
+#define SIM_GARBLE					0x5A		// xor applied to a byte sent at another rate
+#define SIM_MASTER_ADDRESS			0x00
+#define SIM_SLAVE_ADDRESS			0x21
+#define SIM_TICKS_PER_S				(1000000UL / RS485_TICK_US)
+
+/*==================================================================================================
+*                                  STRUCTURES AND OTHER TYPEDEFS
+==================================================================================================*/
+typedef struct{
+	rs485_t			bus;
+	rs485IF_t		itf;
+	uint8_t			*rx_byte;					// armed by uart_rx, NULL : not listening
+	uint32_t		baud;
+	uint32_t		baud_switches;
+	bool			is_baud_fixed;				// set_baud ignored : the line never follows the node
+}sim_node_t;
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static sim_node_t sim_master;
+static sim_node_t sim_slave;
+static rs485_multi_t sim_multi;
+static bool sim_is_multi;						// serviced through rs485_multi_process
+static uint8_t sim_wire[SIM_WIRE_SIZE];
+static uint32_t sim_wire_baud[SIM_WIRE_SIZE];	// rate each byte was sent at
+static uint32_t sim_wire_put;
+static uint32_t sim_wire_get;
+static uint32_t sim_tick;
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static void sim_line_mode(void)
+{
+}
+
+static void sim_wire_send(sim_node_t *node, uint8_t *pdata, uint16_t len)
+{
+    for(uint16_t i = 0; i < len; i++)
+    {
+        sim_wire_baud[sim_wire_put % SIM_WIRE_SIZE] = node->baud;
+        sim_wire[sim_wire_put % SIM_WIRE_SIZE] = pdata[i];
+        sim_wire_put++;
+    }
+}
+
+static void sim_wire_sendv(sim_node_t *node, rs485_iovec_t *iov, uint8_t iovcnt)
+{
+    for(uint8_t i = 0; i < iovcnt; i++)
+    {
+        sim_wire_send(node, iov[i].pdata, iov[i].len);
+    }
+}
+
+static void sim_set_baud(sim_node_t *node, uint32_t baud)
+{
+    node->baud_switches++;
+    if(false == node->is_baud_fixed)
+    {
+        node->baud = baud;
+    }
+}
+
+static void sim_receive(sim_node_t *node, uint8_t bus_id, uint8_t byte, uint32_t baud)
+{
+    if(node->rx_byte == NULL)
+    {
+        return;
+    }
+    *node->rx_byte = (baud == node->baud) ? byte : (uint8_t)(byte ^ SIM_GARBLE);
+    if(true == sim_is_multi)
+    {
+        rs485_multi_RxByte_callback(&sim_multi, bus_id);
+    }
+    else
+    {
+        rs485_RxByte_callback(&node->bus);
+    }
+}
+
+/* the interface callbacks carry no context : one set per node */
+static void sim_master_uart_rx(uint8_t *pdata, uint16_t len)			{ (void)len; sim_master.rx_byte = pdata; }
+static void sim_master_uart_tx(uint8_t *pdata, uint16_t len)			{ sim_wire_send(&sim_master, pdata, len); }
+static void sim_master_uart_txv(rs485_iovec_t *iov, uint8_t iovcnt)	{ sim_wire_sendv(&sim_master, iov, iovcnt); }
+static void sim_master_set_baud(uint32_t baud)							{ sim_set_baud(&sim_master, baud); }
+static void sim_slave_uart_rx(uint8_t *pdata, uint16_t len)			{ (void)len; sim_slave.rx_byte = pdata; }
+static void sim_slave_uart_tx(uint8_t *pdata, uint16_t len)			{ sim_wire_send(&sim_slave, pdata, len); }
+static void sim_slave_uart_txv(rs485_iovec_t *iov, uint8_t iovcnt)		{ sim_wire_sendv(&sim_slave, iov, iovcnt); }
+static void sim_slave_set_baud(uint32_t baud)							{ sim_set_baud(&sim_slave, baud); }
+
+static void sim_node_init(sim_node_t *node, uint8_t address, rs485_bus_mode_e bus_mode)
+{
+    bool is_master = (MASTER_MODE == bus_mode);
+
+    memset(node, 0, sizeof(sim_node_t));
+    node->itf.txMode	= sim_line_mode;
+    node->itf.rxMode	= sim_line_mode;
+    node->itf.uart_rx	= is_master ? sim_master_uart_rx : sim_slave_uart_rx;
+    node->itf.uart_tx	= is_master ? sim_master_uart_tx : sim_slave_uart_tx;
+    node->itf.set_baud	= is_master ? sim_master_set_baud : sim_slave_set_baud;
+    node->baud			= RS485_DEFAULT_BAUD;
+    rs485_init(&node->bus, &node->itf, address, bus_mode);
+}
+
+/*
+ * fresh bus : channels are added by the caller, then sim_start, sim_free once done.
+ * is_txv : frames sent as header | data | trailer, is_multi : both buses serviced from one rs485_multi_t
+ */
+static inline void sim_init(bool is_txv, bool is_multi)
+{
+    sim_node_init(&sim_master, SIM_MASTER_ADDRESS, MASTER_MODE);
+    sim_node_init(&sim_slave, SIM_SLAVE_ADDRESS, SLAVE_MODE);
+    if(true == is_txv)
+    {
+        sim_master.itf.uart_txv	= sim_master_uart_txv;
+        sim_slave.itf.uart_txv	= sim_slave_uart_txv;
+    }
+    sim_is_multi	= is_multi;
+    sim_wire_put	= 0;
+    sim_wire_get	= 0;
+    sim_tick		= 0;
+}
+
+static inline void sim_start(void)
+{
+    if(true == sim_is_multi)
+    {
+        rs485_multi_init(&sim_multi);
+        rs485_multi_add(&sim_multi, &sim_master.bus);
+        rs485_multi_add(&sim_multi, &sim_slave.bus);
+        rs485_multi_start(&sim_multi);
+    }
+    else
+    {
+        rs485_bus_start(&sim_master.bus);
+        rs485_bus_start(&sim_slave.bus);
+    }
+}
+
+/* channels are malloc'ed by rs485_channel_init and never freed on target, the model frees them between runs */
+static void sim_node_free(sim_node_t *node)
+{
+    for(uint8_t i = 0; i < RS485_MAX_CHANNEL_NUMBER; i++)
+    {
+        rs485_channel_t *channel = node->bus.channel_list[i];
+        if(channel != NULL)
+        {
+            free(channel->txPacket_rb.buf);
+            free(channel->rxPacket_rb.buf);
+            free(channel->_staged);
+            free(channel);
+            node->bus.channel_list[i] = NULL;
+        }
+    }
+}
+
+static inline void sim_free(void)
+{
+    sim_node_free(&sim_master);
+    sim_node_free(&sim_slave);
+}
+
+/* one RS485_TICK_US : the bytes on the line reach both nodes, then both run */
+static inline void sim_run_tick(void)
+{
+    for(uint8_t i = 0; (i < SIM_BYTES_PER_TICK) && (sim_wire_get != sim_wire_put); i++)
+    {
+        uint8_t byte = sim_wire[sim_wire_get % SIM_WIRE_SIZE];
+        uint32_t baud = sim_wire_baud[sim_wire_get % SIM_WIRE_SIZE];
+        sim_wire_get++;
+        sim_receive(&sim_master, 0, byte, baud);
+        sim_receive(&sim_slave, 1, byte, baud);
+    }
+    if(true == sim_is_multi)
+    {
+        rs485_multi_process(&sim_multi);
+    }
+    else
+    {
+        rs485_process(&sim_master.bus);
+        rs485_process(&sim_slave.bus);
+    }
+    sim_tick++;
+}
+
+#endif /* RS485_SIM_H */
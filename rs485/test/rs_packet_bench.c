@@ -0,0 +1,153 @@
+/*
+ * host benchmark of the rs_packet frame check : cycles (x86) and ns per byte,
+ * then frame build / validate / parse throughput.
+ * one build per check type, run from rs485/ :
+ *   gcc -O2 -Itest test/rs_packet_bench.c -o bench                                                  BCC
+ *   gcc -O2 -Itest -DPACKET_CHECK_TYPE=1 test/rs_packet_bench.c -o bench                             CRC-16 CCITT
+ *   gcc -O2 -Itest -DPACKET_CHECK_TYPE=1 -DPACKET_CRC_SLICE_BY_4=1 test/rs_packet_bench.c -o bench   CCITT, slicing-by-4
+ *   (PACKET_CHECK_TYPE=2 : MODBUS)
+ * the table result is checked against a bitwise reference first.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES()		__rdtsc()
+#else
+#define BENCH_CYCLES()		0ULL
+#endif
+
+#include "../rs_packet.c"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define BENCH_BYTES			(64UL * 1024UL * 1024UL)
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+static uint16_t bench_reference(uint8_t *pData, uint32_t Length)
+{
+    uint16_t crc = CHECK_INIT;
+    while(Length-- > 0U)
+    {
+#if (PACKET_CHECK_TYPE == PACKET_CHECK_BCC)
+        crc ^= *pData++;
+#elif (PACKET_CHECK_TYPE == PACKET_CHECK_CRC16_CCITT)
+        crc ^= (uint16_t)(*pData++) << 8;
+        for(uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+        }
+#else
+        crc ^= *pData++;
+        for(uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x0001U) ? (uint16_t)((crc >> 1) ^ 0xA001U) : (uint16_t)(crc >> 1);
+        }
+#endif
+    }
+    return crc;
+}
+
+static double bench_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* check over the whole budget in blocks of block bytes, a frame payload or a bigger buffer */
+static void bench_run(uint8_t *buf, uint16_t block)
+{
+    volatile uint16_t sink = 0;
+    uint32_t rounds = BENCH_BYTES / block;
+    double t0 = bench_ns();
+    unsigned long long c0 = BENCH_CYCLES();
+    for(uint32_t i = 0; i < rounds; i++)
+    {
+        sink ^= CheckSum(CHECK_INIT, buf, block);
+    }
+    unsigned long long c1 = BENCH_CYCLES();
+    double t1 = bench_ns();
+    double bytes = (double)rounds * block;
+    printf("  block %5u : %6.2f cycles/byte  %6.3f ns/byte  %7.1f MB/s\n",
+           block, (c1 - c0) / bytes, (t1 - t0) / bytes, bytes / ((t1 - t0) / 1e3));
+    (void)sink;
+}
+
+/* frames of MAX_PACKET_LENGTH payload : build, validate in place, byte-wise parse, payload MB/s */
+static void bench_frame(uint8_t *buf)
+{
+    static uint8_t sink[MAX_PACKET_LENGTH];
+    Packet_t packet;
+    PacketView_t view;
+    RsPacket parser;
+    uint8_t frame[MAX_PACKET_LENGTH + 5 + PACKET_CHECK_SIZE];
+    volatile uint32_t done = 0;
+    uint32_t rounds = BENCH_BYTES / MAX_PACKET_LENGTH / 4U;
+    uint16_t len = 0;
+    double t[4];
+
+    packet.address = 0x21;
+    packet.opcode  = 0x01;
+    packet.length  = MAX_PACKET_LENGTH;
+    memcpy(packet.data, buf, MAX_PACKET_LENGTH);
+    packet_parser_init(&parser, true, sink);
+
+    t[0] = bench_ns();
+    for(uint32_t i = 0; i < rounds; i++)
+    {
+        packet.data[0] = (uint8_t)i;
+        len = packet_frame(frame, &packet, RESPOND_FRAME);
+    }
+    t[1] = bench_ns();
+    for(uint32_t i = 0; i < rounds; i++)
+    {
+        frame[3] = (uint8_t)i;
+        done += (RESPOND_FRAME == packet_unframe_view(&view, frame, len));
+    }
+    t[2] = bench_ns();
+    for(uint32_t i = 0; i < rounds; i++)
+    {
+        packet_parser_reset(&parser);
+        for(uint16_t j = 0; j < len; j++)
+        {
+            done += packet_parser_put(&parser, frame[j]);
+        }
+    }
+    t[3] = bench_ns();
+    double bytes = (double)rounds * MAX_PACKET_LENGTH;
+    printf("  frame %2u B payload : packet_frame %7.1f MB/s  packet_unframe_view %7.1f MB/s  packet_parser_put %7.1f MB/s\n",
+           MAX_PACKET_LENGTH, bytes / ((t[1] - t[0]) / 1e3), bytes / ((t[2] - t[1]) / 1e3), bytes / ((t[3] - t[2]) / 1e3));
+    (void)done;
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+    static uint8_t buf[4096];
+    static const char *name[] = {"BCC", "CRC-16 CCITT", "CRC-16 MODBUS"};
+    srand(1);
+    for(uint16_t i = 0; i < sizeof(buf); i++)
+    {
+        buf[i] = (uint8_t)rand();
+    }
+    for(uint16_t len = 0; len <= sizeof(buf); len += 1 + len / 4)
+    {
+        if(CheckSum(CHECK_INIT, buf, len) != bench_reference(buf, len))
+        {
+            printf("check mismatch at length %u\n", len);
+            return 1;
+        }
+    }
+    printf("%s%s\n", name[PACKET_CHECK_TYPE], ((PACKET_CHECK_TYPE != PACKET_CHECK_BCC) && PACKET_CRC_SLICE_BY_4) ? ", slicing-by-4" : "");
+    bench_run(buf, MAX_PACKET_LENGTH + 2);
+    bench_run(buf, sizeof(buf));
+    bench_frame(buf);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * fuzz target of the rs_packet receive side : packet_unframe, packet_unframe_view, packet_parser_put.
+ * libFuzzer, run from rs485/ :
+ *   clang -g -O1 -fsanitize=fuzzer,address,undefined -DRS_PACKET_FUZZ_LIBFUZZER -Itest test/rs_packet_fuzz.c -o fuzz && ./fuzz
+ * any host compiler, random frames (or the files given as arguments) :
+ *   gcc -g -O1 -fsanitize=address,undefined -Itest test/rs_packet_fuzz.c -o fuzz && ./fuzz [file ...]
+ * (-DPACKET_CHECK_TYPE=1 | 2 as for rs_packet_bench.c)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../rs_packet.c"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define FUZZ_MAX_INPUT			300U		// longer than any valid frame, rxframe is 256
+#define FUZZ_ROUNDS				500000UL
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+/* the parser never writes past its MAX_PACKET_LENGTH data buffer, a completed frame agrees with packet_unframe_view */
+static void fuzz_parser(const uint8_t *data, uint16_t size, bool eot_is_frame, Frame_e whole, const PacketView_t *whole_view)
+{
+    uint8_t *sink = (uint8_t*)malloc(MAX_PACKET_LENGTH);
+    RsPacket parser;
+    PacketView_t view;
+    bool is_done = false;
+    Frame_e type;
+
+    packet_parser_init(&parser, eot_is_frame, sink);
+    for(uint16_t i = 0; i < size; i++)
+    {
+        is_done = packet_parser_put(&parser, data[i]);
+        type = packet_parser_view(&parser, &view);
+        ASSERT(view.length <= MAX_PACKET_LENGTH);
+        if((true == is_done) && ((RESPOND_FRAME == type) || (SELLECT_FRAME == type)))
+        {
+            ASSERT(parser.length <= MAX_PACKET_LENGTH);
+        }
+    }
+    /* line silence after the input : a frame packet_unframe_view takes as a whole, the parser takes too */
+    if((SELLECT_FRAME == whole) || (RESPOND_FRAME == whole))
+    {
+        type = packet_parser_view(&parser, &view);
+        ASSERT(true == is_done);
+        ASSERT(type == whole);
+        ASSERT((view.address == whole_view->address) && (view.opcode == whole_view->opcode) && (view.length == whole_view->length));
+        ASSERT(0 == memcmp(view.data, whole_view->data, view.length));
+    }
+    free(sink);
+}
+
+static void fuzz_one(const uint8_t *data, size_t size)
+{
+    uint8_t *frame;
+    Packet_t packet;
+    PacketView_t view;
+    Frame_e whole;
+
+    if(size > FUZZ_MAX_INPUT)
+    {
+        return;
+    }
+    /* own copy, exactly size bytes : ASan sees any read past the frame */
+    frame = (uint8_t*)malloc((size > 0U) ? size : 1U);
+    memcpy(frame, data, size);
+
+    whole = packet_unframe_view(&view, frame, (uint16_t)size);
+    if((SELLECT_FRAME == whole) || (RESPOND_FRAME == whole))
+    {
+        ASSERT(view.length <= MAX_PACKET_LENGTH);
+        ASSERT((view.data >= frame) && ((view.data + view.length) <= (frame + size)));
+    }
+    ASSERT(whole == packet_unframe(&packet, frame, (uint16_t)size));
+    if((SELLECT_FRAME == whole) || (RESPOND_FRAME == whole))
+    {
+        ASSERT((packet.length == view.length) && (0 == memcmp(packet.data, view.data, view.length)));
+    }
+
+    /* master side takes a lone EOT, slave side EOT-led POLL / SELLECT */
+    fuzz_parser(frame, (uint16_t)size, true, (RESPOND_FRAME == whole) ? whole : NONE_FRAME, &view);
+    fuzz_parser(frame, (uint16_t)size, false, whole, &view);
+    free(frame);
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzz_one(data, size);
+    return 0;
+}
+
+#ifndef RS_PACKET_FUZZ_LIBFUZZER
+/* random inputs shaped like frames (start byte, ETX in the trailer spot, valid check now and then) */
+static size_t fuzz_random(uint8_t *buf)
+{
+    static const uint8_t start[] = {STX, EOT, ACK, NACK};
+    size_t len = (size_t)(rand() % (FUZZ_MAX_INPUT + 1U));
+    uint8_t head = 1U;
+    for(size_t i = 0; i < len; i++)
+    {
+        buf[i] = (rand() % 4 == 0) ? ETX : (uint8_t)rand();
+    }
+    if(len > 0U)
+    {
+        buf[0] = start[rand() % sizeof(start)];
+        if((EOT == buf[0]) && (len > 1U) && (rand() & 1))
+        {
+            buf[1] = STX;
+            head = 2U;
+        }
+    }
+    if((len > (size_t)(head + PACKET_CHECK_SIZE)) && (rand() & 1))
+    {
+        buf[len - 1U - PACKET_CHECK_SIZE] = ETX;
+        CheckSumPut(&buf[len - PACKET_CHECK_SIZE], CheckSum(CHECK_INIT, &buf[head], (uint16_t)(len - head - PACKET_CHECK_SIZE)));
+    }
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buf[FUZZ_MAX_INPUT];
+    if(argc > 1)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            FILE *file = fopen(argv[i], "rb");
+            if(file == NULL)
+            {
+                printf("can't open %s\n", argv[i]);
+                return 1;
+            }
+            size_t len = fread(buf, 1, sizeof(buf), file);
+            fclose(file);
+            fuzz_one(buf, len);
+        }
+        printf("%d inputs ok\n", argc - 1);
+        return 0;
+    }
+    srand(1);
+    for(unsigned long round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        fuzz_one(buf, fuzz_random(buf));
+    }
+    printf("%lu random inputs ok, check type %d\n", FUZZ_ROUNDS, PACKET_CHECK_TYPE);
+    return 0;
+}
+#endif
@@ -0,0 +1,164 @@
+/*
+ * host property tests of the rs_packet framing, one build per check type, run from rs485/ :
+ *   gcc -O1 -g -fsanitize=address,undefined -Itest test/rs_packet_prop.c -o prop && ./prop
+ *   (-DPACKET_CHECK_TYPE=1 | 2, -DPACKET_CRC_SLICE_BY_4=1 as for rs_packet_bench.c)
+ * exit code = number of failed properties.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../rs_packet.c"
+
+/*==================================================================================================
+                                       DEFINES AND MACROS
+==================================================================================================*/
+#define PROP_ROUNDS			20000UL
+#define PROP_FRAME_SIZE		(MAX_PACKET_LENGTH + 5 + PACKET_CHECK_SIZE)	// EOT STX SA OP data ETX check
+
+#define PROP_EXPECT(cond, ...)	do{ if(!(cond)){ if(prop_fail++ < 10){ printf(__VA_ARGS__); printf("\n"); } } }while(0)
+
+/*==================================================================================================
+*                                         LOCAL VARIABLES
+==================================================================================================*/
+static unsigned long prop_fail = 0;
+static uint8_t prop_sink[MAX_PACKET_LENGTH];
+
+/*==================================================================================================
+*                                         LOCAL FUNCTIONS
+==================================================================================================*/
+/* payload rich in ETX / STX / EOT so the parser has to take them as data, SA never a control byte (EOT STX would be a SELLECT) */
+static void prop_packet(Packet_t *packet, uint16_t length)
+{
+    static const uint8_t special[] = {STX, ETX, EOT, ACK, NACK, POL};
+    packet->address = (uint8_t)(0x20 + rand() % 0xE0);
+    packet->opcode  = (uint8_t)rand();
+    packet->length  = length;
+    for(uint16_t i = 0; i < length; i++)
+    {
+        packet->data[i] = (rand() % 3 == 0) ? special[rand() % sizeof(special)] : (uint8_t)rand();
+    }
+}
+
+static bool prop_same(const Packet_t *packet, const PacketView_t *view, Frame_e type)
+{
+    if(view->address != packet->address)
+    {
+        return false;
+    }
+    if(POLL_FRAME == type)
+    {
+        return true;
+    }
+    return (view->opcode == packet->opcode) && (view->length == packet->length) &&
+           ((0 == packet->length) || (0 == memcmp(view->data, packet->data, packet->length)));
+}
+
+/*
+ * byte-wise parser over a whole frame followed by line silence : the last byte must complete it.
+ * an STX-led frame may report true earlier (ETX and check inside the payload), the next byte then
+ * has to take the parse on, so only the result after the last byte counts.
+ */
+static Frame_e prop_parse(RsPacket *parser, uint8_t *frame, uint16_t len, PacketView_t *view)
+{
+    bool is_done = false;
+    packet_parser_reset(parser);
+    for(uint16_t i = 0; i < len; i++)
+    {
+        is_done = packet_parser_put(parser, frame[i]);
+    }
+    return (true == is_done) ? packet_parser_view(parser, view) : NONE_FRAME;
+}
+
+/* packet_frame -> packet_unframe / packet_unframe_view / parser give the packet back */
+static void prop_round_trip(void)
+{
+    static const Frame_e types[] = {POLL_FRAME, SELLECT_FRAME, RESPOND_FRAME};
+    RsPacket parser;
+    Packet_t packet;
+    Packet_t out;
+    PacketView_t view;
+    PacketBuilder_t builder;
+    uint8_t frame[PROP_FRAME_SIZE];
+    uint8_t gather[PROP_FRAME_SIZE];
+    uint16_t len;
+
+    for(unsigned long round = 0; round < PROP_ROUNDS; round++)
+    {
+        Frame_e type = types[round % 3];
+        prop_packet(&packet, (uint16_t)(round / 3 % (MAX_PACKET_LENGTH + 1)));
+        len = packet_frame(frame, &packet, type);
+        PROP_EXPECT(len > 0, "round %lu : no frame built", round);
+
+        /* scatter-gather build puts the same bytes on the line */
+        PROP_EXPECT(len == packet_frame_build(&builder, &packet, type), "round %lu : build length", round);
+        memcpy(gather, builder.header, builder.header_len);
+        memcpy(&gather[builder.header_len], packet.data, builder.payload_len);
+        memcpy(&gather[builder.header_len + builder.payload_len], builder.trailer, builder.trailer_len);
+        PROP_EXPECT(0 == memcmp(frame, gather, len), "round %lu : build bytes", round);
+
+        memset(&out, 0, sizeof(out));
+        PROP_EXPECT(type == packet_unframe(&out, frame, len), "round %lu : unframe type", round);
+        view.address = out.address; view.opcode = out.opcode; view.data = out.data; view.length = out.length;
+        PROP_EXPECT(prop_same(&packet, &view, type), "round %lu : unframe content", round);
+
+        PROP_EXPECT(type == packet_unframe_view(&view, frame, len), "round %lu : unframe_view type", round);
+        PROP_EXPECT(prop_same(&packet, &view, type), "round %lu : unframe_view content", round);
+
+        /* slave side (EOT-led frames expected) for POLL / SELLECT, master side for RESPOND */
+        packet_parser_init(&parser, (RESPOND_FRAME == type), prop_sink);
+        PROP_EXPECT(type == prop_parse(&parser, frame, len, &view), "round %lu : parser type, length %u", round, packet.length);
+        PROP_EXPECT(prop_same(&packet, &view, type), "round %lu : parser content, length %u", round, packet.length);
+    }
+}
+
+/* a single flipped bit in SA..check never passes as a valid frame of the same content */
+static void prop_corruption(void)
+{
+    Packet_t packet;
+    PacketView_t view;
+    uint8_t frame[PROP_FRAME_SIZE];
+    uint16_t len;
+    uint16_t start;
+
+    for(unsigned long round = 0; round < PROP_ROUNDS; round++)
+    {
+        Frame_e type = (round & 1U) ? SELLECT_FRAME : RESPOND_FRAME;
+        prop_packet(&packet, (uint16_t)(rand() % (MAX_PACKET_LENGTH + 1)));
+        len = packet_frame(frame, &packet, type);
+        start = (SELLECT_FRAME == type) ? 2U : 1U;
+        uint16_t at = (uint16_t)(start + rand() % (len - start));
+        frame[at] ^= (uint8_t)(1U << (rand() % 8));
+        Frame_e ret = packet_unframe_view(&view, frame, len);
+        PROP_EXPECT((ret != type) || !prop_same(&packet, &view, type), "round %lu : bit flip at %u accepted", round, at);
+    }
+}
+
+/* control frames are final on their single byte */
+static void prop_control(void)
+{
+    RsPacket parser;
+    PacketView_t view;
+    uint8_t frame[1];
+    static const Frame_e types[] = {ACK_FRAME, NACK_FRAME, EOT_FRAME};
+
+    packet_parser_init(&parser, true, prop_sink);
+    for(uint8_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        PROP_EXPECT(1U == packet_frame(frame, NULL, types[i]), "control %u : length", i);
+        PROP_EXPECT(types[i] == packet_unframe_view(&view, frame, 1), "control %u : unframe", i);
+        PROP_EXPECT(types[i] == prop_parse(&parser, frame, 1, &view), "control %u : parser", i);
+    }
+}
+
+/*==================================================================================================
+*                                         GLOBAL FUNCTIONS
+==================================================================================================*/
+int main(void)
+{
+    srand(1);
+    prop_round_trip();
+    prop_corruption();
+    prop_control();
+    printf("rs_packet properties, check type %d : %lu failed\n", PACKET_CHECK_TYPE, prop_fail);
+    return (prop_fail > 255U) ? 255 : (int)prop_fail;
+}
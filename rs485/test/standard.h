@@ -0,0 +1,8 @@
+#ifndef STANDARD_H
+#define STANDARD_H
+
+/* host stand-in for the target standard types, used by the programs in this folder */
+#include <stdint.h>
+#include <stdbool.h>
+
+#endif /* STANDARD_H */